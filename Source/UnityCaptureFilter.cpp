@@ -28,6 +28,9 @@
 */
 
 #include "shared.inl"
+#include "process.inl"
+#include "workers.inl"
+#include "pipeline.inl"
 #include "streams.h"
 #include <cguid.h>
 #include <strsafe.h>
@@ -70,15 +73,38 @@ static struct { int width, height; } _media[] =
 	{ 2560, 1600 }, //16:10
 	{ 1680, 1050 }, //16:10
 	{ 1440,  900 }, //16:10
+	{ 7680, 4320 }, //16:9
 	{    0,    0 }, //This slot is used for custom resolutions if requested by the target application
 };
 
+//List of output formats offered for every resolution, the FOURCC formats are stored top-down and the YUV ones need an even width and height
+//P010, RGB48 and ARGB64 keep the precision of half float input (10 and 16 bits per channel)
+static const struct { ProcessJob::EOutput Output; DWORD Compression; WORD BitCount; } _formats[] =
+{
+	{ ProcessJob::OUTPUT_BGR8,   BI_RGB, 24 },
+	{ ProcessJob::OUTPUT_BGRA8,  BI_RGB, 32 },
+	{ ProcessJob::OUTPUT_NV12,   MAKEFOURCC('N','V','1','2'), 12 },
+	{ ProcessJob::OUTPUT_YUY2,   MAKEFOURCC('Y','U','Y','2'), 16 },
+	{ ProcessJob::OUTPUT_I420,   MAKEFOURCC('I','4','2','0'), 12 },
+	{ ProcessJob::OUTPUT_P010,   MAKEFOURCC('P','0','1','0'), 24 },
+	{ ProcessJob::OUTPUT_RGB48,  MAKEFOURCC('b','4','8','r'), 48 },
+	{ ProcessJob::OUTPUT_ARGB64, MAKEFOURCC('b','6','4','a'), 64 },
+};
+
 //Error draw modes (what to display on screen in case of errors/warnings)
 enum EErrorDrawCase { EDC_ResolutionMismatch, EDC_UnityNeverStarted, EDC_UnitySendingStopped, _EDC_MAX };
 enum EErrorDrawMode { EDM_GREENKEY, EDM_BLUEPINK, EDM_GREENYELLOW, EDM_BLACK };
 static EErrorDrawMode ErrorDrawModes[_EDC_MAX] = { EDM_BLUEPINK, EDM_GREENYELLOW, EDM_GREENKEY };
 static wchar_t* ErrorDrawModeNames[] = { L"Green Key (RGB #00FE00)", L"Blue/Pink Pattern", L"Green/Yellow Pattern", L"Fill Black" };
 static bool OutputFrameRate = false;
+static bool ReuseOutputBuffer = false; //skip filling a repeated frame if the allocator hands out the sample buffer that still holds it
+static int ReceivePipelineDepth = 0; //frames a receive thread can queue ahead of FillBuffer (0 receives only when a sample is filled)
+static ProcessJob::EColorSpace YUVColorSpace = ProcessJob::COLORSPACE_BT601_LIMITED; //matrix and range of the YUV output formats
+static wchar_t* YUVColorSpaceNames[] = { L"BT.601 limited range", L"BT.601 full range", L"BT.709 limited range", L"BT.709 full range" };
+static ProcessToneMap HDRToneMap; //curve and exposure applied to half float input before it gets limited to the output range
+static wchar_t* HDRToneMapNames[] = { L"Off (clip above 1.0)", L"Reinhard", L"ACES filmic", L"Hable filmic" };
+static wchar_t* HDRExposureNames[] = { L"-3 EV", L"-2 EV", L"-1 EV", L"0 EV", L"+1 EV", L"+2 EV", L"+3 EV" }; //index is the exposure plus 3
+static bool ConvertInUnity = false; //ask the Unity plugin to send frames already converted into the output format so they only need to be copied
 
 #ifdef _DEBUG
 void DebugLog(const char *format, ...)
@@ -97,26 +123,32 @@ void DebugLog(const char *format, ...)
 DEFINE_GUID(IID_ICamSource, 0xdd20e647, 0xf3e5, 0x4156, 0xb3, 0x7b, 0x54, 0x6f, 0xcf, 0x88, 0xec, 0x50);
 DECLARE_INTERFACE_(ICamSource, IUnknown) { };
 
-class CCaptureStream : CSourceStream, IKsPropertySet, IAMStreamConfig, IAMStreamControl, IAMPushSource
+class CCaptureStream : CSourceStream, IKsPropertySet, IAMStreamConfig, IAMStreamControl, IAMPushSource, IAMDroppedFrames
 {
 public:
 	CCaptureStream(CSource* pOwner, HRESULT* phr, int CapNum) : CSourceStream("Stream", phr, pOwner, L"Output")
 	{
-		m_llFrame = m_llFrameMissCount = 0;
-		m_prevStartTime = 0;
+		m_llFrame = 0;
+		m_llFramesReceived = m_llFramesDropped = m_llFramesRepeated = 0;
+		m_LastFrameSequence = 0;
+		m_prevStartTime = m_lastLatency = 0;
+		m_SampleDue = m_LastFrameTime = 0;
+		m_SendTimeout = 1000;
 		m_avgTimePerFrame = 10000000 / 30;
 		m_pReceiver = new SharedImageMemory(CapNum);
-		m_iUnscaledBufSize = 0;
-		m_pUnscaledBuf = NULL;
-		m_RGBA16Table = NULL;
+		m_pPipeline = NULL;
+		m_RequestSerial = m_ForeignRequest = 0;
+		m_RequestConflict = false;
+		memset(&m_OutputCache, 0, sizeof(m_OutputCache));
 		GetMediaType(0, &m_mt);
 	}
 
 	virtual ~CCaptureStream()
 	{
+		delete m_pPipeline;
+		m_pReceiver->WithdrawOutput(m_RequestSerial);
 		delete m_pReceiver;
-		if (m_pUnscaledBuf) free(m_pUnscaledBuf);
-		if (m_RGBA16Table) free(m_RGBA16Table);
+		if (m_OutputCache.Buf) free(m_OutputCache.Buf);
 	}
 
 private:
@@ -125,340 +157,212 @@ private:
 		HRESULT hr;
 		BYTE* pBuf;
 		VIDEOINFO *pvi = (VIDEOINFO*)m_mt.Format();
-		REFERENCE_TIME startTime = m_prevStartTime, endTime = startTime + m_avgTimePerFrame;
 		LONGLONG mtStart = m_llFrame, mtEnd = mtStart + 1;
-		m_prevStartTime = endTime;
 		m_llFrame = mtEnd;
 		UCASSERT(pSamp->GetSize() == pvi->bmiHeader.biSizeImage);
-		UCASSERT(DIBSIZE(pvi->bmiHeader) == pvi->bmiHeader.biSizeImage);
+		UCASSERT(ImageSize(pvi->bmiHeader) == pvi->bmiHeader.biSizeImage);
 
 		if (FAILED(hr = pSamp->GetPointer(&pBuf))) return hr;
 		if (FAILED(hr = pSamp->SetActualDataLength(pvi->bmiHeader.biSizeImage))) return hr;
-		if (FAILED(hr = pSamp->SetTime(&startTime, &endTime))) return hr;
 		if (FAILED(hr = pSamp->SetMediaTime(&mtStart, &mtEnd))) return hr;
 
-		ProcessState State = { pBuf, pvi->bmiHeader.biWidth, pvi->bmiHeader.biHeight, pvi->bmiHeader.biBitCount / 8, this };
-		switch (m_pReceiver->Receive((SharedImageMemory::ReceiveCallbackFunc)ProcessImage, &State))
+		//With a pipeline depth set, frames get picked up by a receive thread while the previous frame is being processed
+		//That thread only starts once the shared memory is open so it can't race the output requests made here to open it
+		if ((m_pPipeline ? m_pPipeline->GetDepth() : 0) != ReceivePipelineDepth && (!ReceivePipelineDepth || m_pReceiver->ReceiveIsReady()))
+		{
+			delete m_pPipeline;
+			m_pPipeline = (ReceivePipelineDepth ? new ReceivePipeline(m_pReceiver, ReceivePipelineDepth) : NULL);
+		}
+
+		//Samples are due one frame interval apart, wait for a new frame until the next one is due and repeat the last frame after that
+		//If the stream fell behind by more than a frame the schedule restarts from now instead of trying to catch up
+		const REFERENCE_TIME Now = SharedImageMemory::GetTimestamp();
+		if (m_SampleDue < Now - m_avgTimePerFrame) m_SampleDue = Now;
+		const uint32_t MaxWait = (m_SampleDue > Now ? (uint32_t)((m_SampleDue - Now + 9999) / 10000) : 0);
+		m_SampleDue += m_avgTimePerFrame;
+
+		ProcessState State = { pBuf, pvi->bmiHeader.biWidth, pvi->bmiHeader.biHeight, pvi->bmiHeader.biBitCount / 8, OutputFormat(pvi->bmiHeader), pvi->bmiHeader.biSizeImage, this };
+		UpdateOutputRequest(State);
+		SharedImageMemory::EReceiveResult Res = (m_pPipeline ? m_pPipeline->Receive((SharedImageMemory::ReceiveCallbackFunc)ProcessImage, &State, MaxWait) : m_pReceiver->Receive((SharedImageMemory::ReceiveCallbackFunc)ProcessImage, &State, MaxWait));
+		switch (Res)
 		{
 			case SharedImageMemory::RECEIVERES_CAPTUREINACTIVE:{
 				//Show color pattern indicating that Unity is not sending frame data yet
 				char DisplayString[128], *DisplayStrings[] = { DisplayString };
 				int DisplayStringLens[] = { sprintf_s(DisplayString, sizeof(DisplayString), "Unity has not started sending image data (Capture Device #%d)", 1+m_pReceiver->GetCapNum()) };
 				FillErrorPattern(ErrorDrawModes[EDC_UnityNeverStarted], &State, 1, DisplayStrings, DisplayStringLens, m_llFrame);
-				Sleep((DWORD)(m_avgTimePerFrame / 10000 - 1)); //just wait a bit until capturing next frame
+				m_OutputCache.LastSampleBuf = NULL;
 				break;}
 
-			case SharedImageMemory::RECEIVERES_NEWFRAME:
-				if (m_llFrameMissCount) m_llFrameMissCount = 0;
-				break;
+			case SharedImageMemory::RECEIVERES_NEWFRAME:{
+				//Frames sent while we were busy got replaced in the shared memory before we could pick them up
+				uint64_t Sequence = GetFrameSequence();
+				if (m_LastFrameSequence && Sequence > m_LastFrameSequence + 1) m_llFramesDropped += (LONGLONG)(Sequence - m_LastFrameSequence - 1);
+				m_LastFrameSequence = Sequence;
+				m_llFramesReceived++;
+				m_LastFrameTime = (m_pPipeline ? m_pPipeline->GetFrameTimestamp() : m_pReceiver->GetFrameTimestamp());
+				m_lastLatency = SharedImageMemory::GetTimestamp() - m_LastFrameTime;
+				break;}
 
 			case SharedImageMemory::RECEIVERES_OLDFRAME:{
-				if (++m_llFrameMissCount < m_llFrameMissMax) break;
-				//Show color pattern when received more than X frames without new image (probably Unity stopped sending data)
+				m_llFramesRepeated++;
+				if (SharedImageMemory::GetTimestamp() - m_LastFrameTime < (REFERENCE_TIME)m_SendTimeout * 10000) break;
+				//Show color pattern when no new frame was sent for longer than the timeout set in Unity (probably Unity stopped sending data)
 				char DisplayString[] = "Unity has stopped sending image data", *DisplayStrings[] = { DisplayString };
 				int DisplayStringLens[] = { sizeof(DisplayString) - 1 };
 				FillErrorPattern(ErrorDrawModes[EDC_UnitySendingStopped], &State, 1, DisplayStrings, DisplayStringLens, m_llFrame);
+				m_OutputCache.LastSampleBuf = NULL;
 				break;}
 		}
+
+		//New frames are stamped with the stream time at which Unity sent them, everything else with the current stream time
+		//Without a reference clock the times just advance by the frame interval
+		REFERENCE_TIME startTime = m_prevStartTime, endTime;
+		CRefTime StreamNow;
+		if (m_pFilter->StreamTime(StreamNow) == S_OK)
+		{
+			startTime = (REFERENCE_TIME)StreamNow - (Res == SharedImageMemory::RECEIVERES_NEWFRAME ? m_lastLatency : 0);
+			if (startTime < m_prevStartTime) startTime = m_prevStartTime; //sample times need to keep increasing
+			endTime = startTime + m_avgTimePerFrame;
+			m_prevStartTime = startTime + 1;
+		}
+		else m_prevStartTime = endTime = startTime + m_avgTimePerFrame;
+		if (FAILED(hr = pSamp->SetTime(&startTime, &endTime))) return hr;
+
 		if (OutputFrameRate) RenderFPSDisplay(&State);
 		return S_OK;
 	}
 
-	struct ProcessJob
-	{
-		enum EType { JOB_NONE, JOB_RGBA8toBGR8, JOB_RGBA8toBGRA8, JOB_RGBA16toBGR8, JOB_RGBA16toBGRA8, JOB_BGR_RESIZE_LINEAR, JOB_BGRA_RESIZE_LINEAR, JOB_BGR_MIRROR_HORIZONTAL, JOB_BGRA_MIRROR_HORIZONTAL } Type;
-		const void *BufIn; void *BufOut;
-		size_t Width, RowStart, RowEnd, RGBAInStride, ResizeToHeight, ResizeFromWidth, ResizeFromHeight;
-		const uint8_t* RGBA16Table;
-
-		inline void Execute()
-		{
-			UCASSERT(RowEnd >= RowStart);
-			if (RowStart == RowEnd) return;
-			if      (Type == JOB_RGBA8toBGR8)            RGBA8toBGR8();
-			else if (Type == JOB_RGBA8toBGRA8)           RGBA8toBGRA8();
-			else if (Type == JOB_RGBA16toBGR8)           RGBA16toBGR8();
-			else if (Type == JOB_RGBA16toBGRA8)          RGBA16toBGRA8();
-			else if (Type == JOB_BGR_RESIZE_LINEAR)      BGRResizeLinear();
-			else if (Type == JOB_BGRA_RESIZE_LINEAR)     BGRAResizeLinear();
-			else if (Type == JOB_BGR_MIRROR_HORIZONTAL)  BGRMirrorHorizontal();
-			else if (Type == JOB_BGRA_MIRROR_HORIZONTAL) BGRAMirrorHorizontal();
-		}
+	uint64_t GetFrameSequence() { return (m_pPipeline ? m_pPipeline->GetFrameSequence() : m_pReceiver->GetFrameSequence()); }
+	uint32_t GetFrameDataSize() { return (m_pPipeline ? m_pPipeline->GetFrameDataSize() : m_pReceiver->GetFrameDataSize()); }
+	int32_t GetFrameRequest() { return (m_pPipeline ? m_pPipeline->GetFrameRequest() : m_pReceiver->GetFrameRequest()); }
+	const uint8_t* GetFrameDirtyTiles() { return (m_pPipeline ? m_pPipeline->GetFrameDirtyTiles() : m_pReceiver->GetFrameDirtyTiles()); }
 
-		void RGBA8toBGR8()
-		{
-			const uint32_t *src = (const uint32_t*)BufIn + (RowStart * RGBAInStride);
-			uint8_t *dst = (uint8_t*)BufOut + (RowStart * Width * 3), *dstEnd = (uint8_t*)BufOut + (RowEnd * Width * 3);
-			if (RGBAInStride != Width)
-			{
-				//Handle a case where the texture pitch does have a gap on the right side
-				const uint32_t *srcLastRow = (const uint32_t*)BufIn + ((RowEnd - 1) * RGBAInStride);
-				for (size_t srcStride = RGBAInStride, iMax = Width; src != srcLastRow; src += srcStride)
-					for (size_t i = 0; i != iMax; i++, dst += 3)
-						*(uint32_t*)dst = _byteswap_ulong(src[i]) >> 8;
-				for (size_t i = 0, iMax = Width - 1; i != iMax; i++, dst += 3, src++)
-					*(uint32_t*)dst = _byteswap_ulong(*src) >> 8;
-			}
-			else
-			{
-				//The fastest (implemented) path to convert from RGBA to BGR
-				const uint32_t *srcEnd8 = src + (((RowEnd-RowStart)*Width-1)&~7), *srcEnd1 = src + ((RowEnd-RowStart)*Width-1);
-				for (; src != srcEnd8; dst += 24, src += 8)
-				{
-					*(uint32_t*)(dst     ) = _byteswap_ulong(src[0]) >> 8;
-					*(uint32_t*)(dst +  3) = _byteswap_ulong(src[1]) >> 8;
-					*(uint32_t*)(dst +  6) = _byteswap_ulong(src[2]) >> 8;
-					*(uint32_t*)(dst +  9) = _byteswap_ulong(src[3]) >> 8;
-					*(uint32_t*)(dst + 12) = _byteswap_ulong(src[4]) >> 8;
-					*(uint32_t*)(dst + 15) = _byteswap_ulong(src[5]) >> 8;
-					*(uint32_t*)(dst + 18) = _byteswap_ulong(src[6]) >> 8;
-					*(uint32_t*)(dst + 21) = _byteswap_ulong(src[7]) >> 8;
-				}
-				for (; src != srcEnd1; dst += 3, src++)
-					*(uint32_t*)(dst) = _byteswap_ulong(*src) >> 8;
-			}
-			uint32_t FinalPixel = _byteswap_ulong(*src) >> 8;
-			memcpy(dst, &FinalPixel, 3);
-		}
+	static ProcessJob::EOutput OutputFormat(const BITMAPINFOHEADER& bmi)
+	{
+		for (int i = 0; i < sizeof(_formats)/sizeof(_formats[0]); i++)
+			if (_formats[i].Compression == bmi.biCompression && _formats[i].BitCount == bmi.biBitCount) return _formats[i].Output;
+		return ProcessJob::OUTPUT_BGR8;
+	}
 
-		void RGBA8toBGRA8()
-		{
-			#define RGBATOBGRA(x) ((x&0xFF00FF00)|((x&0x00FF0000)>>16)|((x&0x000000FF)<<16))
-			const uint32_t *src = (const uint32_t*)BufIn + (RowStart * RGBAInStride);
-			uint32_t *dst = (uint32_t*)BufOut + (RowStart * Width), *dstEnd = (uint32_t*)BufOut + (RowEnd * Width);
-			if (RGBAInStride != Width)
-			{
-				//Handle a case where the texture pitch does have a gap on the right side
-				const uint32_t *srcEnd = (const uint32_t*)BufIn + ((RowEnd) * RGBAInStride);
-				for (size_t srcStride = RGBAInStride, iMax = Width; src != srcEnd; src += srcStride)
-					for (size_t i = 0; i != iMax; i++, dst++)
-						*dst = RGBATOBGRA(src[i]);
-			}
-			else
-			{
-				//The fastest (implemented) path to convert from RGBA to BGR
-				const uint32_t *srcEnd8 = src + (((RowEnd-RowStart)*Width)&~7), *srcEnd1 = src + ((RowEnd-RowStart)*Width);
-				for (; src != srcEnd8; dst += 8, src += 8)
-				{
-					dst[0] = RGBATOBGRA(src[0]);
-					dst[1] = RGBATOBGRA(src[1]);
-					dst[2] = RGBATOBGRA(src[2]);
-					dst[3] = RGBATOBGRA(src[3]);
-					dst[4] = RGBATOBGRA(src[4]);
-					dst[5] = RGBATOBGRA(src[5]);
-					dst[6] = RGBATOBGRA(src[6]);
-					dst[7] = RGBATOBGRA(src[7]);
-				}
-				for (; src != srcEnd1; dst++, src++)
-					*dst = RGBATOBGRA(*src);
-			}
-			#undef RGBATOBGRA
-		}
+	//DIBSIZE pads the rows of BI_RGB formats, the rows of the FOURCC formats are packed
+	static DWORD ImageSize(const BITMAPINFOHEADER& bmi)
+	{
+		return (bmi.biCompression == BI_RGB ? DIBSIZE(bmi) : (DWORD)(bmi.biWidth * abs(bmi.biHeight) * bmi.biBitCount / 8));
+	}
 
-		void RGBA16toBGR8()
-		{
-			//16 bit color downscaling (HDR (16 bit floats) to BGR)
-			const uint8_t* ttbl = RGBA16Table;
-			#define RGBAF16toBGRU8(psrc) ((ttbl[((uint16_t*)(psrc))[0]]<<16) | (ttbl[((uint16_t*)(psrc))[1]]<<8) | ttbl[((uint16_t*)(psrc))[2]])
-			const uint64_t *src = (const uint64_t*)BufIn + (RowStart * RGBAInStride);
-			uint8_t *dst = (uint8_t*)BufOut + (RowStart * Width * 3), *dstEnd = (uint8_t*)BufOut + (RowEnd * Width * 3);
-			if (RGBAInStride != Width)
-			{
-				//Handle a case where the texture pitch does have a gap on the right side
-				const uint64_t *srcLastRow = (const uint64_t*)BufIn + ((RowEnd - 1) * RGBAInStride);
-				for (size_t srcStride = RGBAInStride, iMax = Width; src != srcLastRow; src += srcStride)
-					for (size_t i = 0; i != iMax; i++, dst += 3)
-						*(uint32_t*)dst = RGBAF16toBGRU8(src + i);
-				for (size_t i = 0, iMax = Width - 1; i != iMax; i++, dst += 3, src++)
-					*(uint32_t*)dst = RGBAF16toBGRU8(src);
-			}
-			else
-			{
-				//The fastest (implemented) path to convert from RGBA to BGR
-				const uint64_t *srcEnd8 = src + (((RowEnd-RowStart)*Width-1)&~7), *srcEnd1 = src + ((RowEnd-RowStart)*Width-1);
-				for (; src != srcEnd8; dst += 24, src += 8)
-				{
-					*(uint32_t*)(dst     ) = RGBAF16toBGRU8(src    );
-					*(uint32_t*)(dst +  3) = RGBAF16toBGRU8(src + 1);
-					*(uint32_t*)(dst +  6) = RGBAF16toBGRU8(src + 2);
-					*(uint32_t*)(dst +  9) = RGBAF16toBGRU8(src + 3);
-					*(uint32_t*)(dst + 12) = RGBAF16toBGRU8(src + 4);
-					*(uint32_t*)(dst + 15) = RGBAF16toBGRU8(src + 5);
-					*(uint32_t*)(dst + 18) = RGBAF16toBGRU8(src + 6);
-					*(uint32_t*)(dst + 21) = RGBAF16toBGRU8(src + 7);
-				}
-				for (; src != srcEnd1; dst += 3, src++)
-					*(uint32_t*)(dst) = RGBAF16toBGRU8(src);
-			}
-			//For the final pixel we can't use 4 byte uint32_t copy so we call memcpy
-			uint32_t FinalPixel = RGBAF16toBGRU8(src);
-			memcpy(dst, &FinalPixel, 3);
-			#undef RGBAF16toBGRU8
-		}
+	struct ProcessState
+	{
+		uint8_t* Buf;
+		int BufWidth, BufHeight, BufBPP; //BufBPP is only used by the BI_RGB formats
+		ProcessJob::EOutput Format;
+		size_t BufSize;
+		CCaptureStream* Owner;
+	};
 
-		void RGBA16toBGRA8()
-		{
-			//16 bit color downscaling (HDR (16 bit floats) to BGRA)
-			const uint8_t* ttbl = RGBA16Table;
-			#define RGBAF16toBGRAU8(psrc) ((ttbl[((uint16_t*)(psrc))[3]]<<24) | (ttbl[((uint16_t*)(psrc))[0]]<<16) | (ttbl[((uint16_t*)(psrc))[1]]<<8) | ttbl[((uint16_t*)(psrc))[2]])
-			const uint64_t *src = (const uint64_t*)BufIn + (RowStart * RGBAInStride);
-			uint32_t *dst = (uint32_t*)BufOut + (RowStart * Width), *dstEnd = (uint32_t*)BufOut + (RowEnd * Width);
-			if (RGBAInStride != Width)
-			{
-				//Handle a case where the texture pitch does have a gap on the right side
-				const uint64_t *srcEnd = (const uint64_t*)BufIn + (RowEnd * RGBAInStride);
-				for (size_t srcStride = RGBAInStride, iMax = Width; src != srcEnd; src += srcStride)
-					for (size_t i = 0; i != iMax; i++, dst++)
-						*dst = RGBAF16toBGRAU8(src + i);
-			}
-			else
-			{
-				//The fastest (implemented) path to convert from RGBA to BGR
-				const uint64_t *srcEnd8 = src + (((RowEnd-RowStart)*Width-1)&~7), *srcEnd1 = src + ((RowEnd-RowStart)*Width-1);
-				for (; src != srcEnd8; dst += 8, src += 8)
-				{
-					dst[0] = RGBAF16toBGRAU8(src    );
-					dst[1] = RGBAF16toBGRAU8(src + 1);
-					dst[2] = RGBAF16toBGRAU8(src + 2);
-					dst[3] = RGBAF16toBGRAU8(src + 3);
-					dst[4] = RGBAF16toBGRAU8(src + 4);
-					dst[5] = RGBAF16toBGRAU8(src + 5);
-					dst[6] = RGBAF16toBGRAU8(src + 6);
-					dst[7] = RGBAF16toBGRAU8(src + 7);
-				}
-				for (; src != srcEnd1; dst++, src++)
-					*dst = RGBAF16toBGRAU8(src);
-			}
-			#undef RGBAF16toBGRAU8
-		}
+	//Source and settings a frame was converted with, a frame that only changed in some tiles since the frame before only needs
+	//those converted again if it gets converted the same way
+	struct ConvertKey { int InWidth, InHeight, InStride, InFormat, ResizeMode, MirrorMode, ColorSpace, ToneMap, Exposure, Width, Height, Format; };
 
-		void BGRResizeLinear()
-		{
-			const size_t w = Width, h = ResizeToHeight, ResizeFromPitch = ResizeFromWidth * 3;
-			const double aw = (double)w, ah = (double)h;
-			const double scale = max(ResizeFromWidth / aw, ResizeFromHeight / ah);
-			const double ax = (aw - (ResizeFromWidth  / scale)) / 2.0;
-			const double ay = (ah - (ResizeFromHeight / scale)) / 2.0;
-			const uint8_t *src = (const uint8_t*)BufIn, BlackPixel[3] = {0, 0, 0};
-			uint8_t *dst = (uint8_t*)BufOut + (RowStart * Width * 3);
-			for (size_t y = RowStart, yEnd = RowEnd, isMaxW = ResizeFromWidth, isOffsetMax = ResizeFromHeight * ResizeFromPitch; y != yEnd; y++)
-				for (size_t x = 0; x != w; x++, dst += 3)
-				{
-					const size_t isx = (size_t)((x-ax)*scale), isy = (size_t)((y-ay)*scale);
-					const size_t isOffset = (isx > isMaxW ? isOffsetMax : isy * ResizeFromPitch + isx * 3);
-					memcpy(dst, (isOffset >= isOffsetMax ? BlackPixel : src + isOffset), 3);
-				}
-		}
+	//The last fully processed output frame, used to fill samples that repeat a frame without processing it again
+	struct OutputCache
+	{
+		uint8_t* Buf; //copy of the output, only kept once the consumer has been seen pulling faster than frames arrive or while the sender tracks changed tiles
+		size_t BufSize;
+		uint64_t BufSequence, Sequence; //frame in Buf and frame last processed into a sample (0 if none)
+		ConvertKey BufKey, Key; //how the frame in Buf and the frame last processed were converted
+		const uint8_t* LastSampleBuf; //sample buffer that frame was written to, NULL once something else was drawn into it
+
+		//A repeated frame can only be reused if nothing about its conversion changed, including the color space and tone mapping settings
+		bool Matches(uint64_t Seq, const ConvertKey& k) const { return (Seq && Seq == Sequence && !memcmp(&Key, &k, sizeof(k))); }
+	};
 
-		void BGRAResizeLinear()
+	//With conversion in Unity enabled the output format and size get published so the plugin can send frames that only need to be copied
+	//There is one request for all applications using the capture device, after running into frames converted for another one this
+	//stream withdraws that request and stops making its own so the plugin goes back to sending unconverted frames that everyone can use
+	void UpdateOutputRequest(const ProcessState& State)
+	{
+		if (m_ForeignRequest)
 		{
-			const size_t w = Width, h = ResizeToHeight, fromw = ResizeFromWidth;
-			const double aw = (double)w, ah = (double)h;
-			const double scale = max(ResizeFromWidth / aw, ResizeFromHeight / ah);
-			const double ax = (aw - (ResizeFromWidth  / scale)) / 2.0;
-			const double ay = (ah - (ResizeFromHeight / scale)) / 2.0;
-			const uint32_t *src = (const uint32_t*)BufIn;
-			uint32_t *dst = (uint32_t*)BufOut + (RowStart * Width);
-			for (size_t y = RowStart, yEnd = RowEnd, isMaxW = ResizeFromWidth, isOffsetMax = ResizeFromHeight * fromw; y != yEnd; y++)
-				for (size_t x = 0; x != w; x++, dst++)
-				{
-					const size_t isx = (size_t)((x-ax)*scale), isy = (size_t)((y-ay)*scale);
-					const size_t isOffset = (isx > isMaxW ? isOffsetMax : isy * fromw + isx);
-					*dst = (isOffset >= isOffsetMax ? 0 : src[isOffset]);
-				}
-			UCASSERT(dst ==  (uint32_t*)BufOut + (RowEnd * Width));
+			m_pReceiver->WithdrawOutput(m_ForeignRequest);
+			m_RequestConflict |= (m_RequestSerial != 0);
+			m_ForeignRequest = 0;
 		}
-
-		void BGRMirrorHorizontal()
+		if (!ConvertInUnity || m_RequestConflict || State.BufHeight <= 0)
 		{
-			uint8_t *dst = (uint8_t*)BufOut + (RowStart * Width * 3), *dstEnd = (uint8_t*)BufOut + (RowEnd * Width * 3);
-			for (size_t dstPitch = Width * 3; dst != dstEnd; dst += dstPitch)
-				for (uint8_t tmp[3], *dstA = dst, *dstB = dst + dstPitch - 3; dstA < dstB; dstA += 3, dstB -= 3)
-					memcpy(tmp, dstA, 3), memcpy(dstA, dstB, 3), memcpy(dstB, tmp, 3);
+			m_pReceiver->WithdrawOutput(m_RequestSerial);
+			m_RequestSerial = 0;
+			return;
 		}
+		const SharedImageMemory::OutputRequest Request = { State.Format, State.BufWidth, State.BufHeight, YUVColorSpace, HDRToneMap.Operator, HDRToneMap.Exposure };
+		if (m_RequestSerial && !memcmp(&Request, &m_Request, sizeof(Request))) return;
+		m_RequestSerial = m_pReceiver->RequestOutput(Request);
+		m_Request = Request;
+	}
 
-		void BGRAMirrorHorizontal()
+	static void ProcessImage(int InWidth, int InHeight, int InStride, SharedImageMemory::EFormat Format, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, int Timeout, uint8_t* InBuf, ProcessState* State)
+	{
+		//Set how long no new frame may arrive until we show sending as having stopped
+		State->Owner->m_SendTimeout = Timeout;
+
+		//A repeated frame is filled from the last processed output with a single copy (or not at all if the sample buffer still holds it)
+		OutputCache& Cache = State->Owner->m_OutputCache;
+		const uint64_t Sequence = State->Owner->GetFrameSequence();
+		const size_t OutSize = State->BufSize;
+		const ConvertKey Key = { InWidth, InHeight, InStride, Format, ResizeMode, MirrorMode, YUVColorSpace, HDRToneMap.Operator, HDRToneMap.Exposure, State->BufWidth, State->BufHeight, State->Format };
+		if (Cache.Matches(Sequence, Key))
 		{
-			uint32_t *dst = (uint32_t*)BufOut + (RowStart * Width), *dstEnd = (uint32_t*)BufOut + (RowEnd * Width);
-			for (size_t w = Width; dst != dstEnd; dst += w)
-				for (uint32_t tmp, *dstA = dst, *dstB = dst + w - 1; dstA < dstB; dstA++, dstB--)
-					tmp = *dstA, *dstA = *dstB, *dstB = tmp;
+			if (ReuseOutputBuffer && Cache.LastSampleBuf == State->Buf) return;
+			if (Cache.BufSequence == Sequence) { memcpy(State->Buf, Cache.Buf, OutSize); Cache.LastSampleBuf = State->Buf; return; }
 		}
-	};
+		Cache.LastSampleBuf = NULL;
 
-	struct ProcessWorkers
-	{
-		ProcessWorkers() : WorkersRunning(WORKERCOUNT)
+		const uint8_t* DirtyTiles = State->Owner->GetFrameDirtyTiles();
+		bool Updated = false;
+		if (Format == SharedImageMemory::FORMAT_CONVERTED)
 		{
-			for (size_t i = 0; i != WORKERCOUNT; i++) Threads[i].Start((sThread::FUNC_t)&ProcessThread, (void*)this);
+			//The Unity plugin already converted the frame into the requested output, frames converted for an earlier request show
+			//as black and ones for a newer request (made by another application using this capture device) end the conversion
+			const int32_t Request = State->Owner->GetFrameRequest();
+			if (Request != State->Owner->m_RequestSerial || State->Owner->GetFrameDataSize() != OutSize || InWidth != State->BufWidth || InHeight != State->BufHeight)
+			{
+				if (Request > State->Owner->m_RequestSerial) State->Owner->m_ForeignRequest = Request;
+				FillErrorPattern(EDM_BLACK, State);
+				Cache.Sequence = 0;
+				return;
+			}
+			memcpy(State->Buf, InBuf, OutSize);
 		}
-
-		~ProcessWorkers()
+		else if (DirtyTiles && Cache.Buf && Cache.BufSequence && Cache.BufSequence + 1 == Sequence && !memcmp(&Cache.BufKey, &Key, sizeof(Key)))
 		{
-			WorkersRunning = 0;
-			for (size_t i = 0; i != WORKERCOUNT; i++) NewJobSemaphore.Post(); //wake up all threads
+			//The cache holds the frame before this one converted the same way, only the rows of changed tiles get converted into it
+			ProcessState CacheState = *State;
+			CacheState.Buf = Cache.Buf;
+			Cache.BufSequence = 0;
+			if (!ConvertImage(InWidth, InHeight, InStride, Format, ResizeMode, MirrorMode, InBuf, &CacheState, DirtyTiles)) { Cache.Sequence = 0; return; }
+			memcpy(State->Buf, Cache.Buf, OutSize);
+			Cache.BufSequence = Sequence;
+			Updated = true;
 		}
-	
-		void StartNewJob(ProcessJob NewJob)
+		else if (!ConvertImage(InWidth, InHeight, InStride, Format, ResizeMode, MirrorMode, InBuf, State))
 		{
-			//Notify threads of new work to do
-			WorkingJobCount = 0;
-			size_t Num = NewJob.RowEnd;
-			for (size_t i = 0; i != WORKERCOUNT; i++)
-			{
-				NewJob.RowStart = Num * (i  ) / (WORKERCOUNT + 1);
-				NewJob.RowEnd   = Num * (i+1) / (WORKERCOUNT + 1);
-				Jobs[i] = NewJob;
-				NewJobSemaphore.Post();
-			}
-
-			//Do work in the main thread as well
-			NewJob.RowStart = NewJob.RowEnd;
-			NewJob.RowEnd   = Num;
-			NewJob.Execute();
-
-			//Wait for threads to finish working
-			for (size_t i = 0; i != WORKERCOUNT && JobDoneSemaphore.WaitForPost(); i++) {}
+			Cache.Sequence = Cache.BufSequence = 0;
+			return;
 		}
 
-	private:
-		//Wrapper objects for Windows concurrency objects (thread, mutex, semaphore)
-		struct sThread { typedef DWORD (WINAPI *FUNC_t)(LPVOID); sThread() : h(0) {} sThread(FUNC_t f, void* p = NULL) : h(0) { Start(f, p); } void Start(FUNC_t f, void* p = NULL) { if (h) this->~sThread(); h = CreateThread(0,0,f,p,0,0); } ~sThread() { if (h) { WaitForSingleObject(h, INFINITE); CloseHandle(h); } } private:HANDLE h;sThread(const sThread&);sThread& operator=(const sThread&);};
-		struct sMutex { sMutex() : h(CreateMutexA(0,0,0)) {} ~sMutex() { CloseHandle(h); } __inline void Lock() { WaitForSingleObject(h,INFINITE); } __inline void Unlock() { ReleaseMutex(h); } private:HANDLE h;sMutex(const sMutex&);sMutex& operator=(const sMutex&);};
-		struct sSemaphore { sSemaphore() : h(CreateSemaphoreA(0,0,32768,0)) {} ~sSemaphore() { CloseHandle(h); } __inline void Post() { ReleaseSemaphore(h, 1, 0); } __inline bool WaitForPost() { return WaitForSingleObject(h,INFINITE) == WAIT_OBJECT_0; } private:HANDLE h;sSemaphore(const sSemaphore&);sSemaphore& operator=(const sSemaphore&);};
-
-		enum { WORKERCOUNT = 3 };
-		sMutex JobsMutex;
-		sThread Threads[WORKERCOUNT];
-		ProcessJob Jobs[WORKERCOUNT];
-		sSemaphore NewJobSemaphore, JobDoneSemaphore;
-		size_t WorkingJobCount, WorkersRunning;
-
-		static void ProcessThread(ProcessWorkers* mw)
+		Cache.Sequence = Sequence, Cache.Key = Key;
+		Cache.LastSampleBuf = State->Buf;
+		if (!Updated && (State->Owner->m_llFramesRepeated || DirtyTiles))
 		{
-			while (mw->NewJobSemaphore.WaitForPost() && mw->WorkersRunning)
-			{
-				mw->JobsMutex.Lock();
-				size_t MyJob = mw->WorkingJobCount++;
-				mw->JobsMutex.Unlock();
-				mw->Jobs[MyJob].Execute();
-				mw->JobDoneSemaphore.Post();
-			}
+			if (Cache.BufSize != OutSize) { free(Cache.Buf); Cache.Buf = (uint8_t*)malloc(OutSize); Cache.BufSize = (Cache.Buf ? OutSize : 0); }
+			if (Cache.Buf) { memcpy(Cache.Buf, State->Buf, OutSize); Cache.BufSequence = Sequence; Cache.BufKey = Key; }
 		}
-	};
-
-	struct ProcessState
-	{
-		uint8_t* Buf;
-		int BufWidth, BufHeight, BufBPP;
-		CCaptureStream* Owner;
-	};
+	}
 
-	static void ProcessImage(int InWidth, int InHeight, int InStride, SharedImageMemory::EFormat Format, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, int Timeout, uint8_t* InBuf, ProcessState* State)
+	//Converts a frame sent by Unity into the output format on the worker threads, returns false if it couldn't be converted
+	//With DirtyTiles set the output holds the frame before and only the rows that read changed tiles get converted
+	static bool ConvertImage(int InWidth, int InHeight, int InStride, SharedImageMemory::EFormat Format, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, const uint8_t* InBuf, ProcessState* State, const uint8_t* DirtyTiles = NULL)
 	{
-		//Set maximum number of missed frames allowed until we show sending as having stopped
-		State->Owner->m_llFrameMissMax = (Timeout + SharedImageMemory::RECEIVE_MAX_WAIT - 1) / SharedImageMemory::RECEIVE_MAX_WAIT;
-
 		const bool NeedResize = (InWidth != State->BufWidth || InHeight != State->BufHeight);
 		if (NeedResize && ResizeMode == SharedImageMemory::RESIZEMODE_DISABLED)
 		{
@@ -471,68 +375,49 @@ private:
 				sprintf_s(DisplayString3, sizeof(DisplayString3), "please set these to match"),
 			};
 			FillErrorPattern(ErrorDrawModes[EDC_ResolutionMismatch], State, 3, DisplayStrings, DisplayStringLens);
-			return;
+			return false;
 		}
 
-		if (NeedResize)
-		{
-			//Prepare buffer for image scaling
-			DWORD UnscaledBufSize = (InWidth * InHeight * State->BufBPP);
-			if (State->Owner->m_iUnscaledBufSize != UnscaledBufSize)
-			{
-				if (State->Owner->m_pUnscaledBuf) free(State->Owner->m_pUnscaledBuf);
-				State->Owner->m_pUnscaledBuf = (uint8_t*)malloc(UnscaledBufSize);
-				State->Owner->m_iUnscaledBufSize = UnscaledBufSize;
-			}
-		}
-
-		if (Format != SharedImageMemory::FORMAT_UINT8 && (!State->Owner->m_RGBA16Table || State->Owner->m_RGBA16TableFormat != Format))
-		{
-			//Build a 64k table that maps 16 bit float values (either linear SRGB or gamma RGB) to 8 bit color values
-			const bool SRGB = (Format == SharedImageMemory::FORMAT_FP16_LINEAR);
-			uint8_t* RGBA16Table = State->Owner->m_RGBA16Table;
-			if (!RGBA16Table) RGBA16Table = State->Owner->m_RGBA16Table = (uint8_t*)malloc(0xFFFF+1);
-			for(int i = 0; i <= 0xFFFF; i++)
-			{
-				float f;
-				(i & 0x8000 ? f = 0 : (*(uint32_t*)&f = (i << 13) + 0x38000000));
-				if (SRGB) f = (f <= 0.0031308f ? (f * 12.92f) : (powf(f, 1.0f / 2.4f) * 1.055f - 0.055f));
-				RGBA16Table[i] = (f < 1.0f ? (uint8_t)(f * 255.9999f) : 255);
-			}
-			State->Owner->m_RGBA16TableFormat = Format;
-		}
-
-		//Multi-threaded conversion of RGBA source to 8-bit BGR format while also eliminating possible row gaps (when stride != width)
+		//Pick the conversion kernel for this combination of formats, mirroring and resizing
+		const bool Mirror = (MirrorMode == SharedImageMemory::MIRRORMODE_HORIZONTALLY); //flipped horizontally while the rows get written
+		const ProcessResizeMap::EFilter Filter = (ResizeMode == SharedImageMemory::RESIZEMODE_BILINEAR ? ProcessResizeMap::FILTER_BILINEAR : (ResizeMode == SharedImageMemory::RESIZEMODE_AREA ? ProcessResizeMap::FILTER_AREA : ProcessResizeMap::FILTER_NEAREST));
+		const ProcessJob::EInput In = (Format == SharedImageMemory::FORMAT_UINT8 ? ProcessJob::INPUT_RGBA8 : (Format == SharedImageMemory::FORMAT_FP16_LINEAR ? ProcessJob::INPUT_RGBA16_LINEAR : ProcessJob::INPUT_RGBA16_GAMMA));
 		ProcessJob Job;
-		if (State->BufBPP == 4) Job.Type = (Format == SharedImageMemory::FORMAT_UINT8 ? ProcessJob::JOB_RGBA8toBGRA8 : ProcessJob::JOB_RGBA16toBGRA8);
-		else                    Job.Type = (Format == SharedImageMemory::FORMAT_UINT8 ? ProcessJob::JOB_RGBA8toBGR8  : ProcessJob::JOB_RGBA16toBGR8 );
-		Job.BufIn = InBuf, Job.BufOut = (NeedResize ? State->Owner->m_pUnscaledBuf : State->Buf);
-		Job.Width = InWidth, Job.RowStart = 0, Job.RowEnd = InHeight, Job.RGBAInStride = InStride;
-		Job.RGBA16Table = State->Owner->m_RGBA16Table;
-		State->Owner->m_ProcessWorkers.StartNewJob(Job);
+		if (!State->Owner->m_Frame.SetupJob(Job, In, InBuf, InWidth, InHeight, InStride, State->Format, State->Buf, State->BufWidth, State->BufHeight, Mirror, Filter, YUVColorSpace, HDRToneMap,
+			State->Owner->m_ProcessWorkers.GetThreadCount())) return false;
+		const size_t TilesPerRow = (InWidth + SharedImageMemory::DIRTYTILE_WIDTH - 1) / SharedImageMemory::DIRTYTILE_WIDTH;
+		if (DirtyTiles && !State->Owner->m_Frame.SetChangedRows(Job, DirtyTiles, TilesPerRow, SharedImageMemory::DIRTYTILE_HEIGHT)) return false;
 
-		if (NeedResize)
-		{
-			//Multi-threaded image scaling
-			Job.Type = (State->BufBPP == 4 ? ProcessJob::JOB_BGRA_RESIZE_LINEAR : ProcessJob::JOB_BGR_RESIZE_LINEAR);
-			Job.BufIn = State->Owner->m_pUnscaledBuf, Job.BufOut = State->Buf;
-			Job.Width = State->BufWidth, Job.RowStart = 0, Job.RowEnd = State->BufHeight;
-			Job.ResizeToHeight = State->BufHeight, Job.ResizeFromWidth = InWidth, Job.ResizeFromHeight = InHeight;
-			State->Owner->m_ProcessWorkers.StartNewJob(Job);
-		}
+		//Multi-threaded conversion (and scaling which converts only the needed source pixels) straight from the shared memory
+		State->Owner->m_ProcessWorkers.StartNewJob(Job);
+		return true;
+	}
 
-		if (MirrorMode == SharedImageMemory::MIRRORMODE_HORIZONTALLY)
-		{
-			//Multi-threaded horizontal image flipping
-			Job.Type = (State->BufBPP == 4 ? ProcessJob::JOB_BGRA_MIRROR_HORIZONTAL : ProcessJob::JOB_BGR_MIRROR_HORIZONTAL);
-			Job.BufOut = State->Buf;
-			Job.Width = State->BufWidth, Job.RowStart = 0, Job.RowEnd = State->BufHeight;
-			State->Owner->m_ProcessWorkers.StartNewJob(Job);
-		}
+	//Converts a bottom-up BGRA image with the output width into the bottom 'Rows' rows of the top-down (FOURCC) output
+	static void ConvertBGRAToTopDown(ProcessState* State, const void* BGRA, int Rows)
+	{
+		if (Rows > State->BufHeight) Rows = State->BufHeight;
+		const int JobRowHeight = (ProcessJob::IsYUV(State->Format) ? 2 : 1);
+		ProcessJob Job;
+		Job.Setup(ProcessJob::INPUT_BGRA8, State->Format, false, ProcessJob::RESIZE_NONE, YUVColorSpace);
+		Job.BufIn = BGRA, Job.BufOut = State->Buf, Job.Width = State->BufWidth, Job.Height = State->BufHeight, Job.RGBAInStride = State->BufWidth;
+		Job.RowStart = (State->BufHeight - Rows) / JobRowHeight, Job.RowEnd = State->BufHeight / JobRowHeight;
+		if (Job.RowStart) Job.Execute(); //the workers only split jobs that start at row 0
+		else State->Owner->m_ProcessWorkers.StartNewJob(Job);
 	}
 
 	static void FillErrorPattern(EErrorDrawMode edm, ProcessState* State, int LineCount = 0, char** LineStrings = NULL, int* LineLengths = NULL, LONGLONG FrameNumber = -1)
 	{
+		if (ProcessJob::IsTopDown(State->Format))
+		{
+			//The patterns are drawn in BGRA and then converted
+			ProcessState Pattern = { NULL, State->BufWidth, State->BufHeight, 4, ProcessJob::OUTPUT_BGRA8, (size_t)State->BufWidth * State->BufHeight * 4, State->Owner };
+			if (!(Pattern.Buf = State->Owner->m_Frame.GetScratch(Pattern.BufSize))) return;
+			FillErrorPattern(edm, &Pattern, LineCount, LineStrings, LineLengths, FrameNumber);
+			ConvertBGRAToTopDown(State, Pattern.Buf, State->BufHeight);
+			return;
+		}
+
 		if (FrameNumber >= 0 && FrameNumber < 5) edm = EDM_BLACK; //show errors as just black during the first 5 frames (when starting)
 		BYTE *p = State->Buf, *pEnd = State->Buf + (State->BufWidth * State->BufHeight * State->BufBPP), SkipCount = State->BufBPP - 3;
 		switch (edm)
@@ -571,17 +456,21 @@ private:
 		for (MyFPS++; GetTickCount64() - MyLastFPSTime > 1000; MyFPS = 0, MyLastFPSTime += 1000) { MyLastFPS = MyFPS; }
 		char DisplayString[128];
 		int DisplayStringLen = sprintf_s(DisplayString, sizeof(DisplayString), "%d FPS", MyLastFPS);
+		ReceivePipeline* Pipeline = State->Owner->m_pPipeline;
+		if (Pipeline) DisplayStringLen += sprintf_s(DisplayString + DisplayStringLen, sizeof(DisplayString) - DisplayStringLen, " - Queued %d/%d - Replaced %d", Pipeline->GetQueued(), Pipeline->GetDepth(), Pipeline->GetReplaced());
 
 		void* pTextBuf;
+		const int TextBPP = (ProcessJob::IsTopDown(State->Format) ? 4 : State->BufBPP); //text for FOURCC output gets drawn in BGRA and converted
 		HDC TextDC = CreateCompatibleDC(0);
-		BITMAPINFO TextBMI = { sizeof(BITMAPINFOHEADER), State->BufWidth, 20, 1, 8 * State->BufBPP, 0, 20 * State->BufWidth * State->BufBPP };
+		BITMAPINFO TextBMI = { sizeof(BITMAPINFOHEADER), State->BufWidth, 20, 1, 8 * TextBPP, 0, 20 * State->BufWidth * TextBPP };
 		HBITMAP TextHBitmap = CreateDIBSection(TextDC, &TextBMI, DIB_RGB_COLORS, &pTextBuf, NULL, 0);
 		SelectObject(TextDC, TextHBitmap);
 		SetBkMode(TextDC, TRANSPARENT);
 		SetTextColor(TextDC, RGB(0, 255, 0));
 		TextOutA(TextDC, 10, 0, DisplayString, DisplayStringLen);
-		if (State->BufBPP == 4) for (BYTE *p = (BYTE*)pTextBuf, *pEnd = p + 20 * State->BufWidth * 4; p != pEnd; p += 4) p[3] = 0xFF;
-		memcpy(State->Buf, pTextBuf, TextBMI.bmiHeader.biHeight * State->BufWidth * State->BufBPP);
+		if (TextBPP == 4) for (BYTE *p = (BYTE*)pTextBuf, *pEnd = p + 20 * State->BufWidth * 4; p != pEnd; p += 4) p[3] = 0xFF;
+		if (ProcessJob::IsTopDown(State->Format)) ConvertBGRAToTopDown(State, pTextBuf, TextBMI.bmiHeader.biHeight);
+		else memcpy(State->Buf, pTextBuf, TextBMI.bmiHeader.biHeight * State->BufWidth * State->BufBPP);
 		DeleteObject(TextHBitmap);
 		DeleteDC(TextDC);
 	}
@@ -592,6 +481,7 @@ private:
 		if (ppv == NULL) return E_POINTER;
 		else if (riid == _uuidof(IAMStreamConfig)) { *ppv = (IAMStreamConfig*)this; AddRef(); return S_OK; }
 		else if (riid == _uuidof(IKsPropertySet))  { *ppv = (IKsPropertySet*)this;  AddRef(); return S_OK; }
+		else if (riid == _uuidof(IAMDroppedFrames)) { *ppv = (IAMDroppedFrames*)this; AddRef(); return S_OK; }
 		return CSourceStream::QueryInterface(riid, ppv);
 	}
 
@@ -604,6 +494,7 @@ private:
 		else if (riid == IID_IKsPropertySet)  { *ppv = (IKsPropertySet*)this;  AddRef(); return S_OK; }
 		else if (riid == IID_IQualityControl) { *ppv = (IQualityControl*)this; AddRef(); return S_OK; }
 		else if (riid == IID_IAMStreamConfig) { *ppv = (IAMStreamConfig*)this; AddRef(); return S_OK; }
+		else if (riid == IID_IAMDroppedFrames) { *ppv = (IAMDroppedFrames*)this; AddRef(); return S_OK; }
 		return CSourceStream::NonDelegatingQueryInterface(riid, ppv);
 	}
 
@@ -681,11 +572,25 @@ private:
 		if (HasStrideBytes) DebugLog("[SetFormat] E_FAIL (has stride bytes)\n");
 		if (HasStrideBytes) return E_FAIL;
 
+		bool IsKnownFormat = false;
+		for (int i = 0; i < sizeof(_formats)/sizeof(_formats[0]); i++)
+			if (_formats[i].Compression == pvi->bmiHeader.biCompression && _formats[i].BitCount == pvi->bmiHeader.biBitCount) IsKnownFormat = true;
+		if (!IsKnownFormat) DebugLog("[SetFormat] E_FAIL (unsupported format)\n");
+		if (!IsKnownFormat) return E_FAIL;
+
+		bool HasOddSize = (ProcessJob::IsYUV(OutputFormat(pvi->bmiHeader)) && ((pvi->bmiHeader.biWidth & 1) || (pvi->bmiHeader.biHeight & 1)));
+		if (HasOddSize) DebugLog("[SetFormat] E_FAIL (YUV needs even size)\n");
+		if (HasOddSize) return E_FAIL;
+
+		bool HasNegativeHeight = (pvi->bmiHeader.biCompression != BI_RGB && pvi->bmiHeader.biHeight < 0);
+		if (HasNegativeHeight) DebugLog("[SetFormat] E_FAIL (FOURCC formats are always top-down)\n");
+		if (HasNegativeHeight) return E_FAIL;
+
 		DebugLog("[SetFormat] WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZE: %d - SIZE CALC: %d\n", (int)pvi->bmiHeader.biWidth, (int)pvi->bmiHeader.biHeight, (int)pvi->bmiHeader.biBitCount, (int)pvi->AvgTimePerFrame,
 			(int)pvi->bmiHeader.biSizeImage, (int)DIBSIZE(pvi->bmiHeader));
-		m_avgTimePerFrame = pvi->AvgTimePerFrame;
+		m_avgTimePerFrame = (pvi->AvgTimePerFrame > 0 ? pvi->AvgTimePerFrame : 10000000 / 30); //samples are paced by the frame interval, 0 means unspecified
 		m_mt = *pmt;
-		((VIDEOINFO*)m_mt.pbFormat)->bmiHeader.biSizeImage = DIBSIZE(((VIDEOINFO*)m_mt.pbFormat)->bmiHeader);
+		((VIDEOINFO*)m_mt.pbFormat)->bmiHeader.biSizeImage = ImageSize(((VIDEOINFO*)m_mt.pbFormat)->bmiHeader);
 		return S_OK;
 	}
 
@@ -702,7 +607,7 @@ private:
 	{
 		if (piCount == NULL || piSize == NULL) DebugLog("[GetNumberOfCapabilities] E_POINTER\n");
 		if (piCount == NULL || piSize == NULL) return E_POINTER;
-		*piCount = (sizeof(_media)/sizeof(_media[0])*2); //RGB and RGBA variations
+		*piCount = (sizeof(_media)/sizeof(_media[0])*sizeof(_formats)/sizeof(_formats[0])); //all resolutions in every format
 		*piSize = sizeof(VIDEO_STREAM_CONFIG_CAPS);
 		DebugLog("[GetNumberOfCapabilities] Returning Count: %d - Size: %d\n", *piCount, *piSize);
 		return S_OK;
@@ -777,10 +682,10 @@ private:
 	{
 		CheckPointer(pMediaType, E_POINTER);
 		if (iPos < 0) return E_INVALIDARG;
-		if (iPos >= (sizeof(_media)/sizeof(_media[0])*2)) return VFW_S_NO_MORE_ITEMS;
+		if (iPos >= (sizeof(_media)/sizeof(_media[0])*sizeof(_formats)/sizeof(_formats[0]))) return VFW_S_NO_MORE_ITEMS;
 		CAutoLock cAutoLock(m_pFilter->pStateLock()); 
 
-		int iMedia = iPos%(sizeof(_media)/sizeof(_media[0]));
+		int iMedia = iPos%(sizeof(_media)/sizeof(_media[0])), iFormat = iPos/(sizeof(_media)/sizeof(_media[0]));
 		UCASSERT(_media[iMedia].width * _media[iMedia].height * 4 * sizeof(short) <= MAX_SHARED_IMAGE_SIZE);
 		VIDEOINFO *pvi = (VIDEOINFO *)pMediaType->AllocFormatBuffer(sizeof(VIDEOINFO));
 		ZeroMemory(pvi, sizeof(VIDEOINFO));
@@ -790,15 +695,22 @@ private:
 		pBmi->biWidth  = (_media[iMedia].width  ? _media[iMedia].width  : ((VIDEOINFO*)m_mt.pbFormat)->bmiHeader.biWidth );
 		pBmi->biHeight = (_media[iMedia].height ? _media[iMedia].height : ((VIDEOINFO*)m_mt.pbFormat)->bmiHeader.biHeight);
 		pBmi->biPlanes = 1;
-		pBmi->biBitCount = (iPos >= (sizeof(_media)/sizeof(_media[0])) ? 32 : 24);
-		pBmi->biCompression = BI_RGB;
-		pvi->bmiHeader.biSizeImage = DIBSIZE(pvi->bmiHeader);
+		pBmi->biBitCount = _formats[iFormat].BitCount;
+		pBmi->biCompression = _formats[iFormat].Compression;
+		if (ProcessJob::IsYUV(_formats[iFormat].Output)) pBmi->biWidth &= ~1, pBmi->biHeight &= ~1; //custom resolution set with an RGB format
+		pvi->bmiHeader.biSizeImage = ImageSize(pvi->bmiHeader);
 
 		//DebugLog("[GetMediaType] iPos: %d - WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d\n", iPos, (int)pvi->bmiHeader.biWidth, (int)pvi->bmiHeader.biHeight, (int)pvi->bmiHeader.biBitCount, (int)pvi->AvgTimePerFrame);
 
 		pMediaType->SetType(&MEDIATYPE_Video);
 		pMediaType->SetFormatType(&FORMAT_VideoInfo);
-		pMediaType->SetSubtype(&(pBmi->biBitCount == 32 ? MEDIASUBTYPE_ARGB32 : MEDIASUBTYPE_RGB24));
+		if (pBmi->biCompression == BI_RGB) pMediaType->SetSubtype(&(pBmi->biBitCount == 32 ? MEDIASUBTYPE_ARGB32 : MEDIASUBTYPE_RGB24));
+		else
+		{
+			//FOURCC subtypes are the FOURCC in the base GUID XXXXXXXX-0000-0010-8000-00AA00389B71
+			const GUID FourCCSubtype = { pBmi->biCompression, 0x0000, 0x0010, { 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 } };
+			pMediaType->SetSubtype(&FourCCSubtype);
+		}
 		pMediaType->SetSampleSize(pvi->bmiHeader.biSizeImage);
 		pMediaType->SetTemporalCompression(FALSE);
 		return S_OK;
@@ -807,20 +719,42 @@ private:
 	HRESULT OnThreadStartPlay() override
 	{
 		DebugLog("[OnThreadStartPlay] OnThreadStartPlay\n");
-		m_llFrame = m_llFrameMissCount = 0;
-		m_llFrameMissMax = 5;
+		m_llFrame = 0;
+		m_llFramesReceived = m_llFramesDropped = m_llFramesRepeated = 0;
+		m_LastFrameSequence = 0;
+		m_prevStartTime = 0;
+		m_SampleDue = m_LastFrameTime = 0;
+		m_SendTimeout = 1000;
+		m_RequestConflict = false;
 		return CSourceStream::OnThreadStartPlay();
 	}
 
+	HRESULT OnThreadDestroy() override
+	{
+		//Stop prefetching while the stream isn't running
+		delete m_pPipeline;
+		m_pPipeline = NULL;
+		m_pReceiver->WithdrawOutput(m_RequestSerial);
+		m_RequestSerial = 0;
+		return CSourceStream::OnThreadDestroy();
+	}
+
 	CMediaType m_mt;
-	LONGLONG m_llFrame, m_llFrameMissCount, m_llFrameMissMax;
-	REFERENCE_TIME m_prevStartTime;
+	LONGLONG m_llFrame;
+	LONGLONG m_llFramesReceived, m_llFramesDropped, m_llFramesRepeated; //new frames, frames sent but never received, samples that repeated a frame
+	uint64_t m_LastFrameSequence;
+	REFERENCE_TIME m_prevStartTime, m_lastLatency;
+	REFERENCE_TIME m_SampleDue, m_LastFrameTime; //GetTimestamp when the next sample is due and when the last new frame was sent
+	int m_SendTimeout; //milliseconds without a new frame after which sending counts as stopped (set in Unity)
 	REFERENCE_TIME m_avgTimePerFrame;
 	SharedImageMemory* m_pReceiver;
+	ReceivePipeline* m_pPipeline;
 	ProcessWorkers m_ProcessWorkers;
-	DWORD m_iUnscaledBufSize;
-	uint8_t *m_pUnscaledBuf, *m_RGBA16Table;
-	SharedImageMemory::EFormat m_RGBA16TableFormat;
+	ProcessFrame m_Frame;
+	OutputCache m_OutputCache;
+	SharedImageMemory::OutputRequest m_Request; //output requested from the Unity plugin while m_RequestSerial is set
+	int32_t m_RequestSerial, m_ForeignRequest; //m_ForeignRequest is set after receiving a frame converted for another request
+	bool m_RequestConflict;
 
 	//IAMStreamControl
 	HRESULT STDMETHODCALLTYPE StartAt(const REFERENCE_TIME *ptStart, DWORD dwCookie) override { return NOERROR; }
@@ -828,13 +762,19 @@ private:
 	HRESULT STDMETHODCALLTYPE GetInfo(AM_STREAM_INFO *pInfo) override { return NOERROR; }
 
 	// IAMPushSource
-	HRESULT STDMETHODCALLTYPE GetLatency(REFERENCE_TIME *prtLatency) override { return NOERROR; }
+	HRESULT STDMETHODCALLTYPE GetLatency(REFERENCE_TIME *prtLatency) override { if (!prtLatency) return E_POINTER; *prtLatency = m_lastLatency; return NOERROR; }
 	HRESULT STDMETHODCALLTYPE GetPushSourceFlags(ULONG *pFlags) override { *pFlags = AM_PUSHSOURCECAPS_INTERNAL_RM; return NOERROR; }
 	HRESULT STDMETHODCALLTYPE SetPushSourceFlags(ULONG Flags) override { return E_NOTIMPL; }
 	HRESULT STDMETHODCALLTYPE SetStreamOffset(REFERENCE_TIME rtOffset) override { return NOERROR; }
 	HRESULT STDMETHODCALLTYPE GetStreamOffset(REFERENCE_TIME *prtOffset) override { *prtOffset = 0; return NOERROR; }
 	HRESULT STDMETHODCALLTYPE GetMaxStreamOffset(REFERENCE_TIME *prtMaxOffset) override { *prtMaxOffset = 0; return NOERROR; }
 	HRESULT STDMETHODCALLTYPE SetMaxStreamOffset(REFERENCE_TIME rtMaxOffset) override { return NOERROR; }
+
+	// IAMDroppedFrames (dropped are frames sent by Unity that never made it into a sample)
+	HRESULT STDMETHODCALLTYPE GetNumDropped(long *plDropped) override { if (!plDropped) return E_POINTER; *plDropped = (long)m_llFramesDropped; return NOERROR; }
+	HRESULT STDMETHODCALLTYPE GetNumNotDropped(long *plNotDropped) override { if (!plNotDropped) return E_POINTER; *plNotDropped = (long)m_llFramesReceived; return NOERROR; }
+	HRESULT STDMETHODCALLTYPE GetDroppedInfo(long lSize, long *plArray, long *plNumCopied) override { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE GetAverageFrameSize(long *plAverageSize) override { if (!plAverageSize) return E_POINTER; *plAverageSize = (long)((VIDEOINFO*)m_mt.Format())->bmiHeader.biSizeImage; return NOERROR; }
 };
 
 class CCaptureProperties : public CBasePropertyPage
@@ -866,7 +806,7 @@ private:
 				#pragma pack(2)
 				WORD FFFF, ClassID; wchar_t Text[2]; WORD NoData;
 				#pragma pack(4)
-			} Items[8];
+			} Items[20];
 			#pragma pack(4)
 		} md = {
 			{ WS_CHILD | WS_VISIBLE | DS_CENTER, NULL, sizeof(md.Items)/sizeof(MyData::Item) }, 0, 0, L"", {
@@ -878,6 +818,18 @@ private:
 			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | CBS_DROPDOWNLIST, NULL , 90, 53,  150, 100, 1005 }, 0xFFFF, 0x0085, L"-" }, //Combo Box
 			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5, 72,   80,  10, 1006 }, 0xFFFF, 0x0082, L"-" }, //Label
 			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | BS_CHECKBOX,      NULL , 90, 71,  150,  10, 1007 }, 0xFFFF, 0x0080, L"-" }, //Check Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5, 90,   80,  10, 1008 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | BS_CHECKBOX,      NULL , 90, 89,  150,  10, 1009 }, 0xFFFF, 0x0080, L"-" }, //Check Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5,108,   80,  10, 1010 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | CBS_DROPDOWNLIST, NULL , 90,107,  150, 100, 1011 }, 0xFFFF, 0x0085, L"-" }, //Combo Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5,126,   80,  10, 1012 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | CBS_DROPDOWNLIST, NULL , 90,125,  150, 100, 1013 }, 0xFFFF, 0x0085, L"-" }, //Combo Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5,144,   80,  10, 1014 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | CBS_DROPDOWNLIST, NULL , 90,143,  150, 100, 1015 }, 0xFFFF, 0x0085, L"-" }, //Combo Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5,162,   80,  10, 1016 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | CBS_DROPDOWNLIST, NULL , 90,161,  150, 100, 1017 }, 0xFFFF, 0x0085, L"-" }, //Combo Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5,180,   80,  10, 1018 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | BS_CHECKBOX,      NULL , 90,179,  150,  10, 1019 }, 0xFFFF, 0x0080, L"-" }, //Check Box
 		}};
 
 		HWND hwnd = CreateDialogIndirectParamW(NULL, &md.Header, hwndParent, &MyDialogProc, (LPARAM)this);
@@ -886,6 +838,14 @@ private:
 		SetDlgItemTextW(hwnd, 1004, L"Unity sending stopped:");
 		SetDlgItemTextW(hwnd, 1006, L"Display FPS:");
 		SetDlgItemTextW(hwnd, 1007, L"Show capture frame rate");
+		SetDlgItemTextW(hwnd, 1008, L"Repeated frames:");
+		SetDlgItemTextW(hwnd, 1009, L"Reuse sample buffer without copy");
+		SetDlgItemTextW(hwnd, 1010, L"Receive pipeline:");
+		SetDlgItemTextW(hwnd, 1012, L"YUV color space:");
+		SetDlgItemTextW(hwnd, 1014, L"HDR tone mapping:");
+		SetDlgItemTextW(hwnd, 1016, L"HDR exposure:");
+		SetDlgItemTextW(hwnd, 1018, L"Unity conversion:");
+		SetDlgItemTextW(hwnd, 1019, L"Let Unity convert into the output format");
 		for (int i = 0; i < 3; i++)
 		{
 			HWND hWndComboBox = GetDlgItem(hwnd, 1001 + i*2);
@@ -894,6 +854,25 @@ private:
 			SendMessageA(hWndComboBox, CB_SETCURSEL, (WPARAM)ErrorDrawModes[i], (LPARAM)0);
 		}
 		SendMessage(GetDlgItem(hwnd, 1007), BM_SETCHECK, (OutputFrameRate ? BST_CHECKED : BST_UNCHECKED), 0);
+		SendMessage(GetDlgItem(hwnd, 1009), BM_SETCHECK, (ReuseOutputBuffer ? BST_CHECKED : BST_UNCHECKED), 0);
+		SendMessage(GetDlgItem(hwnd, 1019), BM_SETCHECK, (ConvertInUnity ? BST_CHECKED : BST_UNCHECKED), 0);
+		HWND hWndPipelineBox = GetDlgItem(hwnd, 1011);
+		static const wchar_t* PipelineDepthNames[] = { L"Off (receive when filling a sample)", L"Queue up to 1 frame", L"Queue up to 2 frames", L"Queue up to 3 frames" };
+		for (int j = 0; j <= ReceivePipeline::MAXDEPTH; j++)
+			SendMessageW(hWndPipelineBox, (UINT)CB_ADDSTRING, (WPARAM)0, (LPARAM)PipelineDepthNames[j]);
+		SendMessageA(hWndPipelineBox, CB_SETCURSEL, (WPARAM)ReceivePipelineDepth, (LPARAM)0);
+		HWND hWndColorSpaceBox = GetDlgItem(hwnd, 1013);
+		for (int j = 0; j < sizeof(YUVColorSpaceNames)/sizeof(YUVColorSpaceNames[0]); j++)
+			SendMessageW(hWndColorSpaceBox, (UINT)CB_ADDSTRING, (WPARAM)0, (LPARAM)YUVColorSpaceNames[j]);
+		SendMessageA(hWndColorSpaceBox, CB_SETCURSEL, (WPARAM)YUVColorSpace, (LPARAM)0);
+		HWND hWndToneMapBox = GetDlgItem(hwnd, 1015);
+		for (int j = 0; j < sizeof(HDRToneMapNames)/sizeof(HDRToneMapNames[0]); j++)
+			SendMessageW(hWndToneMapBox, (UINT)CB_ADDSTRING, (WPARAM)0, (LPARAM)HDRToneMapNames[j]);
+		SendMessageA(hWndToneMapBox, CB_SETCURSEL, (WPARAM)HDRToneMap.Operator, (LPARAM)0);
+		HWND hWndExposureBox = GetDlgItem(hwnd, 1017);
+		for (int j = 0; j < sizeof(HDRExposureNames)/sizeof(HDRExposureNames[0]); j++)
+			SendMessageW(hWndExposureBox, (UINT)CB_ADDSTRING, (WPARAM)0, (LPARAM)HDRExposureNames[j]);
+		SendMessageA(hWndExposureBox, CB_SETCURSEL, (WPARAM)(HDRToneMap.Exposure + 3), (LPARAM)0);
 
 		SetWindowPos(hwnd, NULL, prect->left, prect->top, prect->right-prect->left, prect->bottom-prect->top, 0); //show in tab page
 		return S_OK;
@@ -912,6 +891,12 @@ private:
 			if (ItemID == 1003 && SubCommand == 1) ErrorDrawModes[EDC_UnityNeverStarted]   = (EErrorDrawMode)SelectionIndex;
 			if (ItemID == 1005 && SubCommand == 1) ErrorDrawModes[EDC_UnitySendingStopped] = (EErrorDrawMode)SelectionIndex;
 			if (ItemID == 1007) SendMessage(hWndItem, BM_SETCHECK, ((OutputFrameRate ^= 1) ? BST_CHECKED : BST_UNCHECKED), 0);
+			if (ItemID == 1009) SendMessage(hWndItem, BM_SETCHECK, ((ReuseOutputBuffer ^= 1) ? BST_CHECKED : BST_UNCHECKED), 0);
+			if (ItemID == 1011 && SubCommand == 1) ReceivePipelineDepth = SelectionIndex;
+			if (ItemID == 1013 && SubCommand == 1) YUVColorSpace = (ProcessJob::EColorSpace)SelectionIndex;
+			if (ItemID == 1015 && SubCommand == 1) HDRToneMap.Operator = (ProcessToneMap::EOperator)SelectionIndex;
+			if (ItemID == 1017 && SubCommand == 1) HDRToneMap.Exposure = SelectionIndex - 3;
+			if (ItemID == 1019) SendMessage(hWndItem, BM_SETCHECK, ((ConvertInUnity ^= 1) ? BST_CHECKED : BST_UNCHECKED), 0);
 			return TRUE;
 		}
 		return FALSE;
@@ -922,7 +907,7 @@ private:
 		pPageInfo->pszTitle = (WCHAR*)CoTaskMemAlloc(sizeof(CaptureSourceName));
 		memcpy(pPageInfo->pszTitle, CaptureSourceName, sizeof(CaptureSourceName));
 		pPageInfo->size.cx      = 490;
-		pPageInfo->size.cy      = 200;
+		pPageInfo->size.cy      = 290;
 		pPageInfo->pszDocString = NULL;
 		pPageInfo->pszHelpFile  = NULL;
 		pPageInfo->dwHelpContext= 0;
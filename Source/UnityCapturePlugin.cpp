@@ -24,6 +24,9 @@
 */
 
 #include "shared.inl"
+#include "process.inl"
+#include "workers.inl"
+#include "readback.inl"
 #include <chrono>
 #include <string>
 #include "IUnityGraphics.h"
@@ -45,13 +48,65 @@ enum
 static int g_GraphicsDeviceType = -1;
 static ID3D11Device* g_D3D11GraphicsDevice = 0;
 
+//Staging textures for the readback queue, frames still being copied by the GPU are polled with D3D11_MAP_FLAG_DO_NOT_WAIT
+struct D3D11Readback
+{
+	typedef ID3D11Texture2D Texture;
+	typedef ID3D11Texture2D* Source;
+	typedef D3D11_TEXTURE2D_DESC Desc;
+	ID3D11DeviceContext* Context; //immediate context, set before every use
+
+	Texture* Create(const Desc& desc)
+	{
+		//Allocate a Texture2D resource which holds the texture with CPU memory access
+		D3D11_TEXTURE2D_DESC textureDesc;
+		ZeroMemory(&textureDesc, sizeof(textureDesc));
+		textureDesc.Width = desc.Width;
+		textureDesc.Height = desc.Height;
+		textureDesc.MipLevels = desc.MipLevels;
+		textureDesc.ArraySize = 1;
+		textureDesc.Format = desc.Format;
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.SampleDesc.Quality = 0;
+		textureDesc.Usage = D3D11_USAGE_STAGING;
+		textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		textureDesc.MiscFlags = 0;
+		ID3D11Texture2D* t = NULL;
+		return (SUCCEEDED(g_D3D11GraphicsDevice->CreateTexture2D(&textureDesc, NULL, &t)) ? t : NULL);
+	}
+
+	void Release(Texture* t) { t->Release(); }
+	void Copy(Texture* t, Source Src) { Context->CopyResource(t, Src); }
+	void Unmap(Texture* t) { Context->Unmap(t, 0); }
+
+	EReadbackMap Map(Texture* t, bool Wait, const void*& Data, int& RowPitch)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapResource;
+		HRESULT hr = Context->Map(t, 0, D3D11_MAP_READ, (Wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT), &mapResource);
+		if (hr == DXGI_ERROR_WAS_STILL_DRAWING) return READBACKMAP_BUSY;
+		if (FAILED(hr)) return READBACKMAP_FAILED;
+		Data = mapResource.pData, RowPitch = (int)mapResource.RowPitch;
+		return READBACKMAP_OK;
+	}
+};
+
+//Parameters a frame was sent with, passed along until its copy can be read
+struct ReadbackFrame
+{
+	int Width, Height, Timeout;
+	SharedImageMemory::EFormat Format;
+	SharedImageMemory::EResizeMode ResizeMode;
+	SharedImageMemory::EMirrorMode MirrorMode;
+};
+
 struct UnityCaptureInstance
 {
 	SharedImageMemory* Sender;
-	int Width, Height;
-	DXGI_FORMAT Format;
-	bool UseDoubleBuffering, AlternativeBuffer;
-	ID3D11Texture2D* Textures[2];
+	ReadbackQueue<D3D11Readback, ReadbackFrame>* Readback; //created with the first texture sent
+	int ReadbackDepth; //0 to pick 1 or 2 by the double buffering setting of CaptureSendTexture
+	bool FrameBufferAcquired;
+	ProcessFrame* Frame; //created with the first frame converted into the output requested by the receiver
+	ProcessWorkers* Workers;
 };
 
 extern "C" __declspec(dllexport) UnityCaptureInstance* CaptureCreateInstance(int CapNum)
@@ -66,14 +121,43 @@ extern "C" __declspec(dllexport) void CaptureDeleteInstance(UnityCaptureInstance
 {
 	if (!c) return;
 	delete c->Sender;
-	if (c->Textures[0]) c->Textures[0]->Release();
-	if (c->Textures[1]) c->Textures[1]->Release();
+	delete c->Readback;
+	delete c->Frame;
+	delete c->Workers;
 	delete c;
 }
 
+//Converts a frame on the worker threads straight into the shared memory in the output format and size requested by the receiver
+//Returns false if the frame should be sent unconverted, because there is no valid request or the receiver shows a resolution mismatch
+static bool SendConverted(UnityCaptureInstance* c, int Width, int Height, int Stride, SharedImageMemory::EFormat Format, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, int Timeout, const void* Buf, SharedImageMemory::ESendResult& Res)
+{
+	SharedImageMemory::OutputRequest r;
+	const int32_t Request = c->Sender->GetOutputRequest(r);
+	if (!Request || (unsigned)r.output > ProcessJob::OUTPUT_ARGB64 || (unsigned)r.colorspace > ProcessJob::COLORSPACE_BT709_FULL || (unsigned)r.tonemap > ProcessToneMap::TONEMAP_HABLE) return false;
+	if (r.width <= 0 || r.height <= 0 || (uint64_t)r.width * r.height * 8 > MAX_SHARED_IMAGE_SIZE) return false;
+	if (ProcessJob::IsYUV((ProcessJob::EOutput)r.output) && ((r.width | r.height) & 1)) return false;
+	if ((Width != r.width || Height != r.height) && ResizeMode == SharedImageMemory::RESIZEMODE_DISABLED) return false;
+
+	const ProcessJob::EOutput Out = (ProcessJob::EOutput)r.output;
+	uint8_t* Slot = c->Sender->AcquireConvertedSlot(r.width, r.height, Request, (uint32_t)ProcessJob::OutputSize(Out, r.width, r.height));
+	if (!Slot) return false;
+
+	if (!c->Frame) c->Frame = new ProcessFrame();
+	if (!c->Workers) c->Workers = new ProcessWorkers();
+	const ProcessJob::EInput In = (Format == SharedImageMemory::FORMAT_UINT8 ? ProcessJob::INPUT_RGBA8 : (Format == SharedImageMemory::FORMAT_FP16_LINEAR ? ProcessJob::INPUT_RGBA16_LINEAR : ProcessJob::INPUT_RGBA16_GAMMA));
+	const ProcessResizeMap::EFilter Filter = (ResizeMode == SharedImageMemory::RESIZEMODE_BILINEAR ? ProcessResizeMap::FILTER_BILINEAR : (ResizeMode == SharedImageMemory::RESIZEMODE_AREA ? ProcessResizeMap::FILTER_AREA : ProcessResizeMap::FILTER_NEAREST));
+	ProcessJob Job;
+	if (!c->Frame->SetupJob(Job, In, Buf, Width, Height, Stride, Out, Slot, r.width, r.height, MirrorMode == SharedImageMemory::MIRRORMODE_HORIZONTALLY, Filter,
+		(ProcessJob::EColorSpace)r.colorspace, ProcessToneMap((ProcessToneMap::EOperator)r.tonemap, r.exposure), c->Workers->GetThreadCount())) return false;
+	c->Workers->StartNewJob(Job);
+	Res = c->Sender->CommitWriteSlot(ResizeMode, MirrorMode, Timeout);
+	return true;
+}
+
 extern "C" __declspec(dllexport) int CaptureSendTexture(UnityCaptureInstance* c, void* TextureNativePtr, int Timeout, bool UseDoubleBuffering, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, bool IsLinearColorSpace)
 {
 	if (!c || !TextureNativePtr) return RET_ERROR_PARAMETER;
+	if ((unsigned)ResizeMode > SharedImageMemory::RESIZEMODE_AREA) return RET_ERROR_PARAMETER; //resize modes unknown to the capture filter
 	if (g_GraphicsDeviceType != kUnityGfxRendererD3D11) return RET_ERROR_UNSUPPORTEDGRAPHICSDEVICE;
 	if (!c->Sender->SendIsReady()) return RET_WARNING_CAPTUREINACTIVE;
 
@@ -88,54 +172,31 @@ extern "C" __declspec(dllexport) int CaptureSendTexture(UnityCaptureInstance* c,
 	d3dtex->GetDesc(&desc);
 	if (!desc.Width || !desc.Height) return RET_ERROR_READTEXTURE;
 
-	if (c->Width != desc.Width || c->Height != desc.Height || c->Format != desc.Format || c->UseDoubleBuffering != UseDoubleBuffering)
-	{
-		//Allocate a Texture2D resource which holds the texture with CPU memory access
-		D3D11_TEXTURE2D_DESC textureDesc;
-		ZeroMemory(&textureDesc, sizeof(textureDesc));
-		textureDesc.Width = desc.Width;
-		textureDesc.Height = desc.Height;
-		textureDesc.MipLevels = desc.MipLevels;
-		textureDesc.ArraySize = 1;
-		textureDesc.Format = desc.Format;
-		textureDesc.SampleDesc.Count = 1;
-		textureDesc.SampleDesc.Quality = 0;
-		textureDesc.Usage = D3D11_USAGE_STAGING;
-		textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-		textureDesc.MiscFlags = 0;
-		if (c->Textures[0]) c->Textures[0]->Release();
-		g_D3D11GraphicsDevice->CreateTexture2D(&textureDesc, NULL, &c->Textures[0]);
-		if (c->Textures[1]) c->Textures[1]->Release(); 
-		if (UseDoubleBuffering) g_D3D11GraphicsDevice->CreateTexture2D(&textureDesc, NULL, &c->Textures[1]);
-		else c->Textures[1] = NULL;
-		c->Width = desc.Width;
-		c->Height = desc.Height;
-		c->Format = desc.Format;
-		c->UseDoubleBuffering = UseDoubleBuffering;
-	}
-
-	//Handle double buffer
-	if (c->UseDoubleBuffering) c->AlternativeBuffer ^= 1;
-	ID3D11Texture2D* WriteTexture = c->Textures[c->UseDoubleBuffering &&  c->AlternativeBuffer ? 1 : 0];
-	ID3D11Texture2D* ReadTexture  = c->Textures[c->UseDoubleBuffering && !c->AlternativeBuffer ? 1 : 0];
-
 	//Check texture format
-	SharedImageMemory::EFormat Format;
-	if      (desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM || desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB || desc.Format == DXGI_FORMAT_R8G8B8A8_UINT || desc.Format == DXGI_FORMAT_R8G8B8A8_TYPELESS) Format = SharedImageMemory::FORMAT_UINT8;
-	else if (desc.Format == DXGI_FORMAT_R16G16B16A16_FLOAT || desc.Format == DXGI_FORMAT_R16G16B16A16_TYPELESS) Format = (IsLinearColorSpace ? SharedImageMemory::FORMAT_FP16_LINEAR : SharedImageMemory::FORMAT_FP16_GAMMA);
+	ReadbackFrame Frame = { (int)desc.Width, (int)desc.Height, Timeout, SharedImageMemory::FORMAT_UINT8, ResizeMode, MirrorMode };
+	if      (desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM || desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB || desc.Format == DXGI_FORMAT_R8G8B8A8_UINT || desc.Format == DXGI_FORMAT_R8G8B8A8_TYPELESS) Frame.Format = SharedImageMemory::FORMAT_UINT8;
+	else if (desc.Format == DXGI_FORMAT_R16G16B16A16_FLOAT || desc.Format == DXGI_FORMAT_R16G16B16A16_TYPELESS) Frame.Format = (IsLinearColorSpace ? SharedImageMemory::FORMAT_FP16_LINEAR : SharedImageMemory::FORMAT_FP16_GAMMA);
 	else return RET_ERROR_TEXTUREFORMAT;
 
-	//Copy render texture to texture with CPU access and map the image data to RAM
-	ctx->CopyResource(WriteTexture, d3dtex);
-	D3D11_MAPPED_SUBRESOURCE mapResource;
-	if (FAILED(ctx->Map(ReadTexture, 0, D3D11_MAP_READ, 0, &mapResource))) return RET_ERROR_READTEXTURE;
-
-	//Push the captured data to the direct show filter
-	SharedImageMemory::ESendResult res = c->Sender->Send(desc.Width, desc.Height, mapResource.RowPitch / (Format == SharedImageMemory::FORMAT_UINT8 ? 4 : 8), mapResource.RowPitch * desc.Height, Format, ResizeMode, MirrorMode, Timeout, (const unsigned char*)mapResource.pData);
-
-	ctx->Unmap(ReadTexture, 0);
+	//Copy the render texture into a texture with CPU access and send the frames whose copies the GPU has finished
+	//Double buffering is a depth of 2, the frame before only gets waited for if the GPU hasn't finished copying it yet
+	struct SendFrame
+	{
+		UnityCaptureInstance* c;
+		SharedImageMemory::ESendResult Res;
+		void operator()(const ReadbackFrame& f, const void* Data, int RowPitch)
+		{
+			//Push the captured data to the direct show filter, converted into its output format if it asked for that
+			const int Stride = RowPitch / (f.Format == SharedImageMemory::FORMAT_UINT8 ? 4 : 8);
+			if (!SendConverted(c, f.Width, f.Height, Stride, f.Format, f.ResizeMode, f.MirrorMode, f.Timeout, Data, Res))
+				Res = c->Sender->Send(f.Width, f.Height, Stride, RowPitch * f.Height, f.Format, f.ResizeMode, f.MirrorMode, f.Timeout, (const unsigned char*)Data);
+		}
+	} Sent = { c, SharedImageMemory::SENDRES_OK };
+	if (!c->Readback) c->Readback = new ReadbackQueue<D3D11Readback, ReadbackFrame>();
+	c->Readback->Dev.Context = ctx;
+	if (c->Readback->Push(d3dtex, desc, (c->ReadbackDepth ? c->ReadbackDepth : (UseDoubleBuffering ? 2 : 1)), Frame, Sent) == READBACKMAP_FAILED) return RET_ERROR_READTEXTURE;
 
-	switch (res)
+	switch (Sent.Res)
 	{
 		case SharedImageMemory::SENDRES_TOOLARGE:        return RET_ERROR_TOOLARGERESOLUTION;
 		case SharedImageMemory::SENDRES_WARN_FRAMESKIP:  return RET_WARNING_FRAMESKIP;
@@ -143,6 +204,52 @@ extern "C" __declspec(dllexport) int CaptureSendTexture(UnityCaptureInstance* c,
 	return RET_SUCCESS;
 }
 
+//Sets how many frames CaptureSendTexture can have in flight between the GPU and the shared memory (up to 4, see readback.inl)
+//More frames let the GPU copy them while rendering continues at the cost of latency, 0 goes back to the double buffering setting
+extern "C" __declspec(dllexport) void CaptureSetReadbackDepth(UnityCaptureInstance* c, int Depth)
+{
+	if (c) c->ReadbackDepth = (Depth < 0 ? 0 : Depth);
+}
+
+//For CPU side producers, returns a pointer to shared memory to write a frame of RGBA8 or RGBA16 (half float) pixels into directly
+//Publish it with CaptureCommitFrameBuffer, this avoids the copy of the image data done by CaptureSendTexture
+extern "C" __declspec(dllexport) int CaptureAcquireFrameBuffer(UnityCaptureInstance* c, int Width, int Height, SharedImageMemory::EFormat Format, void** FrameBuffer, int* RowPitch)
+{
+	if (!c || !FrameBuffer || !RowPitch || Width <= 0 || Height <= 0) return RET_ERROR_PARAMETER;
+	if ((unsigned)Format > SharedImageMemory::FORMAT_FP16_LINEAR) return RET_ERROR_TEXTUREFORMAT;
+	*FrameBuffer = NULL;
+	c->FrameBufferAcquired = false;
+	if (!c->Sender->SendIsReady()) return RET_WARNING_CAPTUREINACTIVE;
+
+	int Stride;
+	*FrameBuffer = c->Sender->AcquireWriteSlot(Width, Height, Format, Stride);
+	if (!*FrameBuffer) return ((uint64_t)Width * Height * (Format == SharedImageMemory::FORMAT_UINT8 ? 4 : 8) > MAX_SHARED_IMAGE_SIZE ? RET_ERROR_TOOLARGERESOLUTION : RET_WARNING_FRAMESKIP);
+	*RowPitch = Stride * (Format == SharedImageMemory::FORMAT_UINT8 ? 4 : 8);
+	c->FrameBufferAcquired = true;
+	return RET_SUCCESS;
+}
+
+//DirtyTiles optionally marks the tiles changed since the previous frame (see CaptureSetDirtyTracking), it can be NULL
+extern "C" __declspec(dllexport) int CaptureCommitDirtyFrameBuffer(UnityCaptureInstance* c, int Timeout, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, const unsigned char* DirtyTiles)
+{
+	if (!c || !c->FrameBufferAcquired) return RET_ERROR_PARAMETER;
+	if ((unsigned)ResizeMode > SharedImageMemory::RESIZEMODE_AREA) return RET_ERROR_PARAMETER; //resize modes unknown to the capture filter
+	c->FrameBufferAcquired = false;
+	return (c->Sender->CommitWriteSlot(ResizeMode, MirrorMode, Timeout, DirtyTiles) == SharedImageMemory::SENDRES_WARN_FRAMESKIP ? RET_WARNING_FRAMESKIP : RET_SUCCESS);
+}
+
+extern "C" __declspec(dllexport) int CaptureCommitFrameBuffer(UnityCaptureInstance* c, int Timeout, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode)
+{
+	return CaptureCommitDirtyFrameBuffer(c, Timeout, ResizeMode, MirrorMode, NULL);
+}
+
+//For mostly static content, only the tiles of 64 x 16 pixels that changed since the previous frame get copied into the shared memory
+//and converted by the capture device. Without a mask of these tiles from the caller the frames get compared to find them.
+extern "C" __declspec(dllexport) void CaptureSetDirtyTracking(UnityCaptureInstance* c, bool Enable)
+{
+	if (c) c->Sender->SetDirtyTracking(Enable);
+}
+
 // If exported by a plugin, this function will be called when graphics device is created, destroyed, and before and after it is reset (ie, resolution changed).
 extern "C" void UNITY_INTERFACE_EXPORT UnitySetGraphicsDevice(void* device, int deviceType, int eventType)
 {
@@ -0,0 +1,168 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Receive pipeline which picks up frames from the shared memory on a thread of its own (needs shared.inl and workers.inl)
+//Every new frame gets copied into a private buffer and queued so waiting for and copying the next frame overlaps the
+//processing of the current one, the queue holds up to 'Depth' frames and once full the oldest queued frame gets replaced
+//Receive hands out the queued frames in order with the same callback and results as SharedImageMemory::Receive
+//The receiver needs to be opened (SharedImageMemory::ReceiveIsReady) before the pipeline starts its thread on it
+
+#include <string.h>
+
+struct ReceivePipeline : ProcessSync
+{
+	enum { MAXDEPTH = 3 };
+
+	ReceivePipeline(SharedImageMemory* Receiver, int Depth) : m_pReceiver(Receiver), m_Depth(Depth < 1 ? 1 : (Depth > MAXDEPTH ? MAXDEPTH : Depth)),
+		m_pHeld(NULL), m_pFilling(NULL), m_Filled(false), m_LastSequence(0), m_NextOrder(0), m_Queued(0), m_Replaced(0), m_Running(1)
+	{
+		m_Lock.Locked = 0;
+		m_Thread.Start(&ReceiveThread, this);
+	}
+
+	~ReceivePipeline()
+	{
+		Store32(&m_Running, 0); //the thread notices within SharedImageMemory::RECEIVE_MAX_WAIT, m_Thread gets destructed (joined) first
+	}
+
+	SharedImageMemory::EReceiveResult Receive(SharedImageMemory::ReceiveCallbackFunc callback, void* callback_data, uint32_t MaxWait = SharedImageMemory::RECEIVE_MAX_WAIT)
+	{
+		for (const int64_t Deadline = SharedImageMemory::GetTimestamp() + (int64_t)MaxWait * 10000;;) //see SharedImageMemory::Receive
+		{
+			//Reading the published count before looking at the queue makes sure a frame queued meanwhile ends the wait right away
+			const int32_t Published = Load32(&m_Published.Value);
+			m_Lock.Lock();
+			Buffer* b = FindOldestQueued();
+			if (b)
+			{
+				if (m_pHeld) m_pHeld->State = Buffer::FREE;
+				b->State = Buffer::HELD, m_pHeld = b;
+				AtomicAdd(&m_Queued, -1);
+			}
+			m_Lock.Unlock();
+			if (b) { Deliver(callback, callback_data); return SharedImageMemory::RECEIVERES_NEWFRAME; }
+			const int64_t Left = Deadline - SharedImageMemory::GetTimestamp();
+			if (Left <= 0) break;
+			m_Published.Wait(Published, (uint32_t)((Left + 9999) / 10000));
+		}
+		if (!m_pHeld) return SharedImageMemory::RECEIVERES_CAPTUREINACTIVE;
+		Deliver(callback, callback_data); //nothing new arrived in time, pass the last frame again
+		return SharedImageMemory::RECEIVERES_OLDFRAME;
+	}
+
+	//Sequence number, send time, data size, request and changed tiles of the frame passed to the callback by the last successful Receive (see SharedImageMemory)
+	uint64_t GetFrameSequence() { return (m_pHeld ? m_pHeld->Sequence : 0); }
+	int64_t GetFrameTimestamp() { return (m_pHeld ? m_pHeld->Timestamp : 0); }
+	uint32_t GetFrameDataSize() { return (m_pHeld ? m_pHeld->DataSize : 0); }
+	int32_t GetFrameRequest() { return (m_pHeld ? m_pHeld->Request : 0); }
+	const uint8_t* GetFrameDirtyTiles() { return (m_pHeld ? m_pHeld->DirtyTiles : NULL); }
+
+	//Maximum and current number of frames waiting in the queue, and how many queued frames were replaced before being received
+	int GetDepth() const { return m_Depth; }
+	int GetQueued() { return Load32(&m_Queued); }
+	int GetReplaced() { return Load32(&m_Replaced); }
+
+private:
+	struct Buffer
+	{
+		enum EState { FREE, FILLING, QUEUED, HELD } State; //HELD is the frame last handed out by Receive
+		uint8_t* Data;
+		const uint8_t* DirtyTiles; //copy of the tile mask following the frame data, NULL if the whole frame changed
+		size_t Size;
+		int Width, Height, Stride, Timeout;
+		int32_t Request;
+		uint32_t DataSize;
+		SharedImageMemory::EFormat Format;
+		SharedImageMemory::EResizeMode ResizeMode;
+		SharedImageMemory::EMirrorMode MirrorMode;
+		uint64_t Sequence, Order;
+		int64_t Timestamp;
+
+		Buffer() : State(FREE), Data(NULL), DirtyTiles(NULL), Size(0) {}
+		~Buffer() { free(Data); }
+	};
+
+	SharedImageMemory* m_pReceiver;
+	int m_Depth;
+	Buffer m_Buffers[MAXDEPTH + 2]; //queued frames plus the one being filled and the one held by the consumer
+	Buffer *m_pHeld, *m_pFilling;
+	bool m_Filled;
+	uint64_t m_LastSequence, m_NextOrder;
+	sSpinLock m_Lock; //guards the buffer states
+	sParkWord m_Published; //counts queued frames
+	volatile int32_t m_Queued, m_Replaced, m_Running;
+	sThread m_Thread; //declared last so it is joined before the buffers are freed
+
+	Buffer* FindOldestQueued()
+	{
+		Buffer* Res = NULL;
+		for (Buffer *b = m_Buffers, *bEnd = b + m_Depth + 2; b != bEnd; b++)
+			if (b->State == Buffer::QUEUED && (!Res || b->Order < Res->Order)) Res = b;
+		return Res;
+	}
+
+	void Deliver(SharedImageMemory::ReceiveCallbackFunc callback, void* callback_data)
+	{
+		Buffer* b = m_pHeld; //not touched by the receive thread while held
+		callback(b->Width, b->Height, b->Stride, b->Format, b->ResizeMode, b->MirrorMode, b->Timeout, b->Data, callback_data);
+	}
+
+	static void CopyFrame(int width, int height, int stride, SharedImageMemory::EFormat format, SharedImageMemory::EResizeMode resizemode, SharedImageMemory::EMirrorMode mirrormode, int timeout, uint8_t* buffer, void* callback_data)
+	{
+		ReceivePipeline* rp = (ReceivePipeline*)callback_data;
+		const uint64_t Sequence = rp->m_pReceiver->GetFrameSequence();
+		if (Sequence == rp->m_LastSequence) return; //old frame, already queued before
+
+		Buffer* b = rp->m_pFilling;
+		const uint8_t* DirtyTiles = rp->m_pReceiver->GetFrameDirtyTiles();
+		const size_t Size = rp->m_pReceiver->GetFrameDataSize(), MaskSize = (DirtyTiles ? SharedImageMemory::DirtyMaskSize(width, height) : 0);
+		if (b->Size < Size + MaskSize) { free(b->Data); b->Data = (uint8_t*)malloc(Size + MaskSize); b->Size = (b->Data ? Size + MaskSize : 0); }
+		if (!b->Data) return;
+		memcpy(b->Data, buffer, Size);
+		b->DirtyTiles = (DirtyTiles ? (const uint8_t*)memcpy(b->Data + Size, DirtyTiles, MaskSize) : NULL);
+		b->Width = width, b->Height = height, b->Stride = stride, b->Timeout = timeout;
+		b->Format = format, b->ResizeMode = resizemode, b->MirrorMode = mirrormode;
+		b->Sequence = Sequence, b->Timestamp = rp->m_pReceiver->GetFrameTimestamp();
+		b->Request = rp->m_pReceiver->GetFrameRequest(), b->DataSize = (uint32_t)Size;
+		rp->m_LastSequence = Sequence, rp->m_Filled = true;
+	}
+
+	static void ReceiveThread(void* p)
+	{
+		ReceivePipeline* rp = (ReceivePipeline*)p;
+		while (Load32(&rp->m_Running))
+		{
+			//There is always a free buffer because at most Depth are queued and one is held
+			rp->m_Lock.Lock();
+			Buffer* b = rp->m_Buffers;
+			while (b->State != Buffer::FREE) b++;
+			b->State = Buffer::FILLING;
+			rp->m_Lock.Unlock();
+
+			rp->m_pFilling = b, rp->m_Filled = false;
+			const SharedImageMemory::EReceiveResult Res = rp->m_pReceiver->Receive(&CopyFrame, rp);
+
+			rp->m_Lock.Lock();
+			b->State = (rp->m_Filled ? Buffer::QUEUED : Buffer::FREE);
+			if (rp->m_Filled && (b->Order = ++rp->m_NextOrder, AtomicAdd(&rp->m_Queued, 1) > rp->m_Depth))
+			{
+				rp->FindOldestQueued()->State = Buffer::FREE; //queue is full, drop the oldest frame
+				AtomicAdd(&rp->m_Queued, -1);
+				AtomicAdd(&rp->m_Replaced, 1);
+			}
+			rp->m_Lock.Unlock();
+
+			if (rp->m_Filled) { AtomicAdd(&rp->m_Published.Value, 1); rp->m_Published.WakeAll(); }
+			else if (Res == SharedImageMemory::RECEIVERES_CAPTUREINACTIVE) SleepMs(10); //don't spin if the shared memory can't be opened
+		}
+	}
+
+	ReceivePipeline(const ReceivePipeline&);
+	ReceivePipeline& operator=(const ReceivePipeline&);
+};
@@ -0,0 +1,1587 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Image processing jobs (format conversion, resizing, mirroring) used by the capture filter and by the Unity plugin when it converts frames
+//This file has no dependency on Windows headers so the kernels can be built and verified on any platform
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define UC_SIMD_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#define UC_TARGET(isa)
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define UC_TARGET(isa) __attribute__((target(isa)))
+#endif
+#if !defined(_MSC_VER) || _MSC_VER >= 1910
+#define UC_SIMD_AVX512 1 //AVX-512 intrinsics are available since Visual Studio 2017
+#endif
+#endif
+
+#if !defined(_MSC_VER)
+#define _byteswap_ulong __builtin_bswap32
+#endif
+
+#ifndef UCASSERT
+#define UCASSERT(cond) ((void)0)
+#endif
+
+typedef void (*ProcessRowFunc)(const void* src, void* dst, size_t count);
+typedef void (*ProcessFilterVFunc)(const uint8_t* const* rows, const int16_t* weights, size_t taps, int16_t* dst, size_t count);
+typedef void (*ProcessFilterHFunc)(const int16_t* src, const uint32_t* index, const int16_t* weights, size_t taps, uint8_t* dst, size_t count, size_t dstBPP);
+typedef void (*ProcessFilterVFloatFunc)(const float* const* rows, const int16_t* weights, size_t taps, float* dst, size_t count);
+typedef void (*ProcessFilterHFloatFunc)(const float* src, const uint32_t* index, const int16_t* weights, size_t taps, float scale, uint16_t* dst, size_t count);
+
+//RGB to YUV coefficients (for R, G, B and the offset of each row) scaled to the value range of the input read by a YUV kernel
+struct ProcessYUVMatrix { float Y[4], U[4], V[4]; };
+
+//Converts a pair of rows of 'count' pixels (count is even) to YUV, dst0/dst1 get the Y rows (packed rows for YUY2) and u/v the
+//chroma row (interleaved in u for NV12 and P010, unused for YUY2), P010 samples are 16 bit words with the 10 bit value at the top
+//Kernels for half floats through a table read the color channels from HalfTable (see ProcessToneMap), the others ignore it
+typedef void (*ProcessYUVFunc)(const void* src0, const void* src1, size_t count, const ProcessYUVMatrix* m, const float* HalfTable, uint8_t* dst0, uint8_t* dst1, uint8_t* u, uint8_t* v);
+typedef void (*ProcessHalfRowFunc)(const void* src, void* dst, size_t count, const float* HalfTable);
+
+//Mapping of the color channels of half float input to the [0, 1] output range, baked into the lookup tables read by the kernels so tone
+//mapping HDR input costs the same as the sRGB encoding of linear input (FORMAT_FP16_LINEAR) which goes through the same tables
+//The curves work on linear values, so with tone mapping or exposure set gamma input gets decoded first and everything gets encoded after
+//Gamma input to BGR8/BGRA8 that is only clamped gets converted in register by the F16C kernels, with tone mapping or exposure set it needs
+//the sRGB decode and encode and takes the table path instead which is 2 to 3 times slower (table vs F16C column of Tests/bench_fp16)
+struct ProcessToneMap
+{
+	enum EOperator { TONEMAP_CLAMP, TONEMAP_REINHARD, TONEMAP_ACES, TONEMAP_HABLE };
+	enum { HALFTABLESIZE = 0x7C00 + 1, RGBA16TABLESIZE = 0x20000 }; //the float table covers the bits of all positive half floats up to infinity
+	EOperator Operator;
+	int Exposure; //in stops, scales the linear values before the curve
+
+	ProcessToneMap(EOperator InOperator = TONEMAP_CLAMP, int InExposure = 0) : Operator(InOperator), Exposure(InExposure) {}
+	bool IsOff() const { return (Operator == TONEMAP_CLAMP && Exposure == 0); }
+	bool operator==(const ProcessToneMap& o) const { return (Operator == o.Operator && Exposure == o.Exposure); }
+	bool operator!=(const ProcessToneMap& o) const { return !(*this == o); }
+
+	//Output value of the half float with the bits h, all values with the sign bit set become 0, infinity and positive NaN the maximum
+	float Map(uint32_t h, bool Linear) const
+	{
+		if (h & 0x8000) return 0;
+		float f = (h < 0x400 ? h / 16777216.0f : ldexpf((float)(0x400 | (h & 0x3FF)), (int)(h >> 10) - 25)); //denormals and normals
+		if (IsOff()) { f = (f < 1.0f ? f : 1.0f); return (Linear ? SRGBEncode(f) : f); }
+		f = (Linear ? f : SRGBDecode(f)) * ldexpf(1.0f, Exposure);
+		if (Operator == TONEMAP_REINHARD) f = f / (1.0f + f);
+		if (Operator == TONEMAP_ACES)     f = (f * (2.51f * f + 0.03f)) / (f * (2.43f * f + 0.59f) + 0.14f); //fit of the ACES filmic curve by Krzysztof Narkowicz
+		if (Operator == TONEMAP_HABLE)    f = Hable(f * 2.0f) / Hable(11.2f); //filmic curve by John Hable with his exposure bias and white point
+		return SRGBEncode(f < 1.0f ? f : 1.0f);
+	}
+
+	//64k entries mapping half float colors to 8 bits followed by 64k for alpha which is only clamped (unless everything is off, then
+	//alpha gets mapped like the colors as it always has been)
+	void BuildRGBA16Table(uint8_t* Table, bool Linear) const
+	{
+		for (uint32_t i = 0; i <= 0xFFFF; i++)
+		{
+			Table[i] = (uint8_t)(Map(i, Linear) * 255.9999f);
+			Table[0x10000 + i] = (IsOff() ? Table[i] : (uint8_t)(ProcessToneMap().Map(i, false) * 255.9999f));
+		}
+	}
+
+	//Output values for the clamped bits of the half float color channels read by the vectorized kernels (see HALFTABLESIZE)
+	void BuildHalfTable(float* Table, bool Linear) const
+	{
+		for (uint32_t i = 0; i != HALFTABLESIZE; i++) Table[i] = Map(i, Linear);
+	}
+
+private:
+	static float SRGBEncode(float f) { return (f <= 0.0031308f ? (f * 12.92f) : (powf(f, 1.0f / 2.4f) * 1.055f - 0.055f)); }
+	static float SRGBDecode(float f) { return (f <= 0.04045f ? (f / 12.92f) : powf((f + 0.055f) / 1.055f, 2.4f)); }
+	static float Hable(float x) { return ((x * (0.15f * x + 0.10f * 0.50f) + 0.20f * 0.02f) / (x * (0.15f * x + 0.50f) + 0.20f * 0.30f)) - 0.02f / 0.30f; }
+};
+
+//Vectorized row kernels, each converts 'count' consecutive pixels and handles the remainder with the scalar reference code
+struct ProcessKernels
+{
+	enum ELevel { LEVEL_SCALAR, LEVEL_SSSE3, LEVEL_AVX2, LEVEL_AVX512 };
+	enum EYUVLayout { YUV_NV12, YUV_YUY2, YUV_I420, YUV_P010 };
+	ELevel Level;
+	bool F16C;
+	ProcessRowFunc RGBA8toBGR8, RGBA8toBGRA8;
+	ProcessRowFunc RGBA16toBGR8[2], RGBA16toBGRA8[2]; //indexed by sRGB encoding (for FORMAT_FP16_LINEAR), NULL if the lookup table is needed
+	ProcessFilterVFunc FilterV; //vertical resize filter pass, never NULL
+	ProcessFilterHFunc FilterH; //horizontal resize filter pass, never NULL
+	ProcessFilterVFloatFunc FilterVFloat; //vertical pass of the float resize filter used for outputs with more than 8 bits, never NULL
+	ProcessFilterHFloatFunc FilterHFloat; //horizontal pass of it into 16 bit RGBA, never NULL
+	ProcessYUVFunc ToYUV[4][4]; //indexed by input (RGBA8, half float clamped, half float through the table, 16 bit RGBA) and EYUVLayout
+	ProcessHalfRowFunc ToRGB16[5][2]; //to big endian 16 bit RGB (b48r) or ARGB (b64a), indexed by input (like ToYUV, 4 is BGRA8) and alpha
+
+	//The level and F16C can be limited below what the CPU supports to compare the kernel sets against each other (see Tests)
+	ProcessKernels(ELevel MaxLevel = LEVEL_AVX512, bool AllowF16C = true) : Level(DetectLevel() < MaxLevel ? DetectLevel() : MaxLevel), F16C(AllowF16C && DetectF16C()), RGBA8toBGR8(NULL), RGBA8toBGRA8(NULL), FilterV(FilterV_Scalar), FilterH(FilterH_Scalar),
+		FilterVFloat(FilterVFloat_Scalar), FilterHFloat(FilterHFloat_Scalar)
+	{
+		RGBA16toBGR8[0] = RGBA16toBGR8[1] = RGBA16toBGRA8[0] = RGBA16toBGRA8[1] = NULL;
+		SetYUVKernels<0, false>(), SetYUVKernels<1, false>(), SetYUVKernels<2, false>(), SetYUVKernels<3, false>();
+		SetRGB16Kernels<0, false>(), SetRGB16Kernels<1, false>(), SetRGB16Kernels<2, false>(), SetRGB16Kernels<3, false>(), SetRGB16Kernels<4, false>();
+		#if UC_SIMD_X86
+		if (Level >= LEVEL_SSSE3)  RGBA8toBGR8 = RGBA8toBGR8_SSSE3,  RGBA8toBGRA8 = RGBA8toBGRA8_SSSE3,  FilterV = FilterV_SSE2, FilterH = FilterH_SSE2, FilterHFloat = FilterHFloat_SSE2;
+		if (Level >= LEVEL_AVX2)   RGBA8toBGR8 = RGBA8toBGR8_AVX2,   RGBA8toBGRA8 = RGBA8toBGRA8_AVX2,   FilterV = FilterV_AVX2, FilterH = FilterH_AVX2, FilterVFloat = FilterVFloat_AVX2;
+		#if UC_SIMD_AVX512
+		if (Level >= LEVEL_AVX512) RGBA8toBGR8 = RGBA8toBGR8_AVX512, RGBA8toBGRA8 = RGBA8toBGRA8_AVX512;
+		#endif
+
+		//With AVX2 only the plain clamp of FORMAT_FP16_GAMMA is faster than the lookup table, the polynomial sRGB encode
+		//measured about half the speed of the table so FORMAT_FP16_LINEAR needs AVX-512 to be processed without it
+		if (Level >= LEVEL_AVX2 && F16C) RGBA16toBGR8[0] = RGBA16toBGR8_F16C, RGBA16toBGRA8[0] = RGBA16toBGRA8_F16C;
+		#if UC_SIMD_AVX512
+		if (Level >= LEVEL_AVX512)
+		{
+			RGBA16toBGR8[0]  = RGBA16toBGR8_AVX512<false>,  RGBA16toBGR8[1]  = RGBA16toBGR8_AVX512<true>;
+			RGBA16toBGRA8[0] = RGBA16toBGRA8_AVX512<false>, RGBA16toBGRA8[1] = RGBA16toBGRA8_AVX512<true>;
+		}
+		#endif
+
+		//The half float YUV and 16 bit RGB kernels read the source directly without going through BGRA8 rows, for FORMAT_FP16_LINEAR or
+		//tone mapping they gather the colors from a table of floats which is as fast as the 8-bit lookup table but keeps the precision
+		if (Level >= LEVEL_AVX2)
+		{
+			SetYUVKernels<0, true>(), SetYUVKernels<3, true>(), SetRGB16Kernels<0, true>(), SetRGB16Kernels<3, true>(), SetRGB16Kernels<4, true>();
+			if (F16C) SetYUVKernels<1, true>(), SetYUVKernels<2, true>(), SetRGB16Kernels<1, true>(), SetRGB16Kernels<2, true>();
+		}
+		#endif
+	}
+
+	static ELevel DetectLevel()
+	{
+		#if UC_SIMD_X86
+		int r1[4], r7[4] = {0};
+		CPUID(r1, 0, 0); int MaxLeaf = r1[0];
+		CPUID(r1, 1, 0);
+		if (MaxLeaf >= 7) CPUID(r7, 7, 0);
+		if (!(r1[2] & (1<<9))) return LEVEL_SCALAR; //SSSE3
+		if (!(r1[2] & (1<<27)) || !(r1[2] & (1<<28))) return LEVEL_SSSE3; //OSXSAVE and AVX
+		uint64_t XCR0 = XGETBV();
+		if ((XCR0 & 0x6) != 0x6 || !(r7[1] & (1<<5))) return LEVEL_SSSE3; //OS saves YMM state and AVX2
+		if ((XCR0 & 0xE0) != 0xE0 || !(r7[1] & (1<<16)) || !(r7[1] & (1<<30))) return LEVEL_AVX2; //OS saves ZMM state and AVX-512 F/BW
+		return LEVEL_AVX512;
+		#else
+		return LEVEL_SCALAR;
+		#endif
+	}
+
+	static bool DetectF16C()
+	{
+		#if UC_SIMD_X86
+		int r1[4];
+		CPUID(r1, 1, 0);
+		return ((r1[2] & (1<<29)) != 0);
+		#else
+		return false;
+		#endif
+	}
+
+	static void RGBA8toBGR8_Scalar(const void* pSrc, void* pDst, size_t n)
+	{
+		const uint32_t* src = (const uint32_t*)pSrc;
+		for (uint8_t* dst = (uint8_t*)pDst; n; n--, src++, dst += 3)
+			dst[0] = (uint8_t)(*src >> 16), dst[1] = (uint8_t)(*src >> 8), dst[2] = (uint8_t)*src;
+	}
+
+	static void RGBA8toBGRA8_Scalar(const void* pSrc, void* pDst, size_t n)
+	{
+		const uint32_t* src = (const uint32_t*)pSrc;
+		for (uint32_t* dst = (uint32_t*)pDst; n; n--, src++, dst++)
+			*dst = ((*src & 0xFF00FF00) | ((*src & 0x00FF0000) >> 16) | ((*src & 0x000000FF) << 16));
+	}
+
+	//Blends 'taps' rows of 8-bit channels with 2.14 fixed point weights into 9.7 fixed point channels
+	static void FilterV_Scalar(const uint8_t* const* rows, const int16_t* weights, size_t taps, int16_t* dst, size_t count)
+	{
+		FilterVRemainder(rows, weights, taps, dst, 0, count);
+	}
+
+	//Blends 'taps' neighboring 9.7 fixed point BGRA pixels starting at index[i] with 2.14 fixed point weights into 8-bit BGRA or BGR
+	static void FilterH_Scalar(const int16_t* src, const uint32_t* index, const int16_t* weights, size_t taps, uint8_t* dst, size_t count, size_t dstBPP)
+	{
+		for (; count; count--, index++, weights += taps, dst += dstBPP)
+			for (size_t c = 0; c != dstBPP; c++)
+			{
+				int32_t sum = (1 << 20);
+				for (size_t t = 0; t != taps; t++) sum += src[(*index + t) * 4 + c] * weights[t];
+				dst[c] = (uint8_t)(sum >> 21 > 255 ? 255 : sum >> 21);
+			}
+	}
+
+	//Blends 'taps' rows of float channels with 2.14 fixed point weights
+	static void FilterVFloat_Scalar(const float* const* rows, const int16_t* weights, size_t taps, float* dst, size_t count)
+	{
+		FilterVFloatRemainder(rows, weights, taps, dst, 0, count);
+	}
+
+	//Blends 'taps' neighboring float RGBA pixels starting at index[i] with 2.14 fixed point weights into 16 bit RGBA (scaled by 'scale')
+	static void FilterHFloat_Scalar(const float* src, const uint32_t* index, const int16_t* weights, size_t taps, float scale, uint16_t* dst, size_t count)
+	{
+		for (; count; count--, index++, weights += taps, dst += 4)
+			for (size_t c = 0; c != 4; c++)
+			{
+				float sum = 0;
+				for (size_t t = 0; t != taps; t++) sum += src[(*index + t) * 4 + c] * FilterWeight(weights[t]);
+				sum *= scale;
+				dst[c] = (uint16_t)lrintf(sum < 0 ? 0 : (sum > 65535.0f ? 65535.0f : sum));
+			}
+	}
+
+	//Reads n pixels as float R, G, B and A for the float resize filter, see LoadRGBA_Scalar for the inputs and their value ranges
+	template <int INPUT> static void ToFloatRow_Scalar(const void* pSrc, float* dst, size_t n, const float* HalfTable)
+	{
+		const uint8_t* src = (const uint8_t*)pSrc;
+		for (; n; n--, src += (INPUT == 0 || INPUT == 4 ? 4 : 8), dst += 4) LoadRGBA_Scalar<INPUT>(src, HalfTable, dst[0], dst[1], dst[2], dst[3]);
+	}
+
+	//RGBA8 (or BGRA8 with the R and B coefficients swapped) or half floats to YUV, chroma is computed from the sum of the 2x2 (4:2:0) or
+	//2x1 (YUY2) pixels it covers with the averaging folded into the coefficients, the operations are ordered like in the vector code to match it exactly
+	template <int INPUT, int LAYOUT> static void ToYUV_Scalar(const void* pSrc0, const void* pSrc1, size_t n, const ProcessYUVMatrix* m, const float* HalfTable, uint8_t* dst0, uint8_t* dst1, uint8_t* u, uint8_t* v)
+	{
+		enum { BPP = (INPUT ? 8 : 4) };
+		const float cs = (LAYOUT == YUV_YUY2 ? 0.5f : 0.25f);
+		const float U[4] = { m->U[0] * cs, m->U[1] * cs, m->U[2] * cs, m->U[3] }, V[4] = { m->V[0] * cs, m->V[1] * cs, m->V[2] * cs, m->V[3] };
+		const uint8_t* src[2] = { (const uint8_t*)pSrc0, (const uint8_t*)pSrc1 };
+		uint8_t* dst[2] = { dst0, dst1 };
+		for (size_t i = 0; i != n; i += 2)
+		{
+			float r[2][2], g[2][2], b[2][2], a;
+			uint16_t y[2][2];
+			for (int row = 0; row != 2; row++)
+				for (int px = 0; px != 2; px++)
+				{
+					LoadRGBA_Scalar<INPUT>(src[row] + (i + px) * BPP, HalfTable, r[row][px], g[row][px], b[row][px], a);
+					y[row][px] = YUVClamp<LAYOUT>(r[row][px] * m->Y[0] + g[row][px] * m->Y[1] + b[row][px] * m->Y[2] + m->Y[3]);
+				}
+			if (LAYOUT == YUV_YUY2)
+			{
+				for (int row = 0; row != 2; row++)
+				{
+					const float sr = r[row][0] + r[row][1], sg = g[row][0] + g[row][1], sb = b[row][0] + b[row][1];
+					uint8_t* d = dst[row] + i * 2;
+					d[0] = (uint8_t)y[row][0], d[1] = (uint8_t)YUVClamp<LAYOUT>(sr * U[0] + sg * U[1] + sb * U[2] + U[3]);
+					d[2] = (uint8_t)y[row][1], d[3] = (uint8_t)YUVClamp<LAYOUT>(sr * V[0] + sg * V[1] + sb * V[2] + V[3]);
+				}
+				continue;
+			}
+			const float sr = (r[0][0] + r[1][0]) + (r[0][1] + r[1][1]), sg = (g[0][0] + g[1][0]) + (g[0][1] + g[1][1]), sb = (b[0][0] + b[1][0]) + (b[0][1] + b[1][1]);
+			const uint16_t cu = YUVClamp<LAYOUT>(sr * U[0] + sg * U[1] + sb * U[2] + U[3]), cv = YUVClamp<LAYOUT>(sr * V[0] + sg * V[1] + sb * V[2] + V[3]);
+			if (LAYOUT == YUV_P010)
+			{
+				uint16_t *y0 = (uint16_t*)dst0, *y1 = (uint16_t*)dst1, *uv = (uint16_t*)u;
+				y0[i] = y[0][0], y0[i + 1] = y[0][1], y1[i] = y[1][0], y1[i + 1] = y[1][1], uv[i] = cu, uv[i + 1] = cv;
+				continue;
+			}
+			dst0[i] = (uint8_t)y[0][0], dst0[i + 1] = (uint8_t)y[0][1], dst1[i] = (uint8_t)y[1][0], dst1[i + 1] = (uint8_t)y[1][1];
+			if (LAYOUT == YUV_NV12) u[i] = (uint8_t)cu, u[i + 1] = (uint8_t)cv;
+			else u[i / 2] = (uint8_t)cu, v[i / 2] = (uint8_t)cv;
+		}
+	}
+
+	//RGBA8, BGRA8, half floats or 16 bit RGBA to big endian 16 bit channels in the order R, G, B (b48r) or A, R, G, B (b64a)
+	template <int INPUT, bool ALPHA> static void ToRGB16_Scalar(const void* pSrc, void* pDst, size_t n, const float* HalfTable)
+	{
+		enum { BPP = (INPUT == 0 || INPUT == 4 ? 4 : 8) };
+		const float Scale = (BPP == 4 ? 257.0f : (INPUT == 3 ? 1.0f : 65535.0f));
+		const uint8_t* src = (const uint8_t*)pSrc;
+		for (uint8_t* dst = (uint8_t*)pDst; n; n--, src += BPP, dst += (ALPHA ? 8 : 6))
+		{
+			float c[4];
+			LoadRGBA_Scalar<INPUT>(src, HalfTable, c[1], c[2], c[3], c[0]);
+			for (int i = (ALPHA ? 0 : 1), o = 0; i != 4; i++, o += 2)
+			{
+				const long l = lrintf(c[i] * Scale);
+				const uint16_t w = (uint16_t)(l < 0 ? 0 : (l > 65535 ? 65535 : l));
+				dst[o] = (uint8_t)(w >> 8), dst[o + 1] = (uint8_t)w;
+			}
+		}
+	}
+
+private:
+	template <int INPUT, bool SIMD> void SetYUVKernels()
+	{
+		#if UC_SIMD_X86
+		if (SIMD) { ToYUV[INPUT][YUV_NV12] = ToYUV_AVX2<INPUT, YUV_NV12>, ToYUV[INPUT][YUV_YUY2] = ToYUV_AVX2<INPUT, YUV_YUY2>, ToYUV[INPUT][YUV_I420] = ToYUV_AVX2<INPUT, YUV_I420>, ToYUV[INPUT][YUV_P010] = ToYUV_AVX2<INPUT, YUV_P010>; return; }
+		#endif
+		ToYUV[INPUT][YUV_NV12] = ToYUV_Scalar<INPUT, YUV_NV12>, ToYUV[INPUT][YUV_YUY2] = ToYUV_Scalar<INPUT, YUV_YUY2>, ToYUV[INPUT][YUV_I420] = ToYUV_Scalar<INPUT, YUV_I420>, ToYUV[INPUT][YUV_P010] = ToYUV_Scalar<INPUT, YUV_P010>;
+	}
+
+	template <int INPUT, bool SIMD> void SetRGB16Kernels()
+	{
+		#if UC_SIMD_X86
+		if (SIMD) { ToRGB16[INPUT][0] = ToRGB16_AVX2<INPUT, false>, ToRGB16[INPUT][1] = ToRGB16_AVX2<INPUT, true>; return; }
+		#endif
+		ToRGB16[INPUT][0] = ToRGB16_Scalar<INPUT, false>, ToRGB16[INPUT][1] = ToRGB16_Scalar<INPUT, true>;
+	}
+
+	//Reads a pixel as R, G, B and A, INPUT 0 is RGBA8 and 4 is BGRA8 (as [0, 255]), 1 and 2 are half floats (as [0, 1], 2 reads the colors
+	//from HalfTable) and 3 is 16 bit RGBA (as [0, 65535], the rows blended by the float resize filter)
+	template <int INPUT> static inline void LoadRGBA_Scalar(const uint8_t* p, const float* HalfTable, float& r, float& g, float& b, float& a)
+	{
+		if (INPUT == 0 || INPUT == 4) { r = p[INPUT == 4 ? 2 : 0], g = p[1], b = p[INPUT == 4 ? 0 : 2], a = p[3]; return; }
+		const uint16_t* h = (const uint16_t*)p;
+		if (INPUT == 3) { r = h[0], g = h[1], b = h[2], a = h[3]; return; }
+		r = HalfChannel_Scalar<INPUT == 2>(h[0], HalfTable), g = HalfChannel_Scalar<INPUT == 2>(h[1], HalfTable), b = HalfChannel_Scalar<INPUT == 2>(h[2], HalfTable), a = HalfChannel_Scalar<false>(h[3], NULL);
+	}
+
+	//Clamps a half float to [0, 1] like the lookup table (all values with the sign bit set become 0, positive NaN becomes 1)
+	//With TABLE the half float bits clamped to infinity index the table of ProcessToneMap instead
+	template <bool TABLE> static inline float HalfChannel_Scalar(uint16_t h, const float* Table)
+	{
+		if (TABLE) return Table[h & 0x8000 ? 0 : (h > 0x7C00 ? 0x7C00 : h)];
+		h = (h & 0x8000 ? 0 : (h > 0x3C00 ? 0x3C00 : h));
+		if (h < 0x400) return h / 16777216.0f; //denormal
+		float f; const uint32_t Bits = ((uint32_t)h << 13) + 0x38000000; memcpy(&f, &Bits, 4);
+		return f;
+	}
+
+	//Rounds to nearest even like the vector conversion and saturates to 8 bits (10 bits at the top of 16 for P010) like its packing
+	template <int LAYOUT> static inline uint16_t YUVClamp(float f)
+	{
+		const long l = lrintf(f), Max = (LAYOUT == YUV_P010 ? 1023 : 255);
+		return (uint16_t)((l < 0 ? 0 : (l > Max ? Max : l)) << (LAYOUT == YUV_P010 ? 6 : 0));
+	}
+
+	static void FilterVRemainder(const uint8_t* const* rows, const int16_t* weights, size_t taps, int16_t* dst, size_t i, size_t count)
+	{
+		for (; i != count; i++)
+		{
+			int32_t sum = 64;
+			for (size_t t = 0; t != taps; t++) sum += rows[t][i] * weights[t];
+			dst[i] = (int16_t)(sum >> 7);
+		}
+	}
+
+	//The float filter applies the same weights (exactly, 2.14 fixed point fits in a float), summed in tap order like the vector code
+	static inline float FilterWeight(int16_t w) { return w * (1.0f / 16384.0f); }
+
+	static void FilterVFloatRemainder(const float* const* rows, const int16_t* weights, size_t taps, float* dst, size_t i, size_t count)
+	{
+		for (; i != count; i++)
+		{
+			float sum = 0;
+			for (size_t t = 0; t != taps; t++) sum += rows[t][i] * FilterWeight(weights[t]);
+			dst[i] = sum;
+		}
+	}
+
+
+	#if UC_SIMD_X86
+	static void CPUID(int r[4], int Leaf, int SubLeaf)
+	{
+		#if defined(_MSC_VER)
+		__cpuidex(r, Leaf, SubLeaf);
+		#else
+		__cpuid_count(Leaf, SubLeaf, r[0], r[1], r[2], r[3]);
+		#endif
+	}
+
+	static uint64_t XGETBV()
+	{
+		#if defined(_MSC_VER)
+		return _xgetbv(0);
+		#else
+		uint32_t eax, edx;
+		__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((uint64_t)edx << 32) | eax;
+		#endif
+	}
+
+	//Shuffle masks that reorder RGBA to BGRA and RGBA to packed BGR (12 bytes with 4 zero bytes at the end) within 16 bytes
+	#define UC_SHUF_BGRA 2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15
+	#define UC_SHUF_BGR  2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1
+
+	UC_TARGET("ssse3") static void RGBA8toBGR8_SSSE3(const void* pSrc, void* pDst, size_t n)
+	{
+		//Convert 16 pixels per iteration into 3 full 16 byte stores (48 bytes)
+		const __m128i shuf = _mm_setr_epi8(UC_SHUF_BGR);
+		const __m128i *src = (const __m128i*)pSrc, *srcEnd16 = src + (n / 16) * 4;
+		__m128i* dst = (__m128i*)pDst;
+		for (; src != srcEnd16; src += 4, dst += 3)
+		{
+			__m128i a = _mm_shuffle_epi8(_mm_loadu_si128(src    ), shuf);
+			__m128i b = _mm_shuffle_epi8(_mm_loadu_si128(src + 1), shuf);
+			__m128i c = _mm_shuffle_epi8(_mm_loadu_si128(src + 2), shuf);
+			__m128i d = _mm_shuffle_epi8(_mm_loadu_si128(src + 3), shuf);
+			_mm_storeu_si128(dst    , _mm_or_si128(a, _mm_slli_si128(b, 12)));
+			_mm_storeu_si128(dst + 1, _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+			_mm_storeu_si128(dst + 2, _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+		}
+		RGBA8toBGR8_Scalar(src, dst, n % 16);
+	}
+
+	UC_TARGET("ssse3") static void RGBA8toBGRA8_SSSE3(const void* pSrc, void* pDst, size_t n)
+	{
+		const __m128i shuf = _mm_setr_epi8(UC_SHUF_BGRA);
+		const __m128i *src = (const __m128i*)pSrc, *srcEnd16 = src + (n / 16) * 4;
+		__m128i* dst = (__m128i*)pDst;
+		for (; src != srcEnd16; src += 4, dst += 4)
+		{
+			_mm_storeu_si128(dst    , _mm_shuffle_epi8(_mm_loadu_si128(src    ), shuf));
+			_mm_storeu_si128(dst + 1, _mm_shuffle_epi8(_mm_loadu_si128(src + 1), shuf));
+			_mm_storeu_si128(dst + 2, _mm_shuffle_epi8(_mm_loadu_si128(src + 2), shuf));
+			_mm_storeu_si128(dst + 3, _mm_shuffle_epi8(_mm_loadu_si128(src + 3), shuf));
+		}
+		RGBA8toBGRA8_Scalar(src, dst, n % 16);
+	}
+
+	UC_TARGET("avx2") static inline void StoreBGR8x16_AVX2(uint8_t* dst, __m256i a, __m256i b)
+	{
+		const __m256i shuf = _mm256_broadcastsi128_si256(_mm_setr_epi8(UC_SHUF_BGR));
+		StoreLanes12_AVX2(dst, _mm256_shuffle_epi8(a, shuf), _mm256_shuffle_epi8(b, shuf));
+	}
+
+	UC_TARGET("avx2") static inline void StoreLanes12_AVX2(uint8_t* dst, __m256i a, __m256i b)
+	{
+		//The first 12 bytes of each 128 bit lane of the two registers are compacted into one 32 and one 16 byte store
+		const __m256i perm0 = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 0, 0), perm1 = _mm256_setr_epi32(0, 0, 0, 0, 0, 0, 0, 1), perm2 = _mm256_setr_epi32(2, 4, 5, 6, 0, 0, 0, 0);
+		_mm256_storeu_si256((__m256i*)dst, _mm256_blend_epi32(_mm256_permutevar8x32_epi32(a, perm0), _mm256_permutevar8x32_epi32(b, perm1), 0xC0));
+		_mm_storeu_si128((__m128i*)(dst + 32), _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(b, perm2)));
+	}
+
+	UC_TARGET("avx2") static void RGBA8toBGR8_AVX2(const void* pSrc, void* pDst, size_t n)
+	{
+		const __m256i *src = (const __m256i*)pSrc, *srcEnd16 = src + (n / 16) * 2;
+		uint8_t* dst = (uint8_t*)pDst;
+		for (; src != srcEnd16; src += 2, dst += 48)
+			StoreBGR8x16_AVX2(dst, _mm256_loadu_si256(src), _mm256_loadu_si256(src + 1));
+		RGBA8toBGR8_Scalar(src, dst, n % 16);
+	}
+
+	UC_TARGET("avx2") static void RGBA8toBGRA8_AVX2(const void* pSrc, void* pDst, size_t n)
+	{
+		const __m256i shuf = _mm256_broadcastsi128_si256(_mm_setr_epi8(UC_SHUF_BGRA));
+		const __m256i *src = (const __m256i*)pSrc, *srcEnd16 = src + (n / 16) * 2;
+		__m256i* dst = (__m256i*)pDst;
+		for (; src != srcEnd16; src += 2, dst += 2)
+		{
+			_mm256_storeu_si256(dst    , _mm256_shuffle_epi8(_mm256_loadu_si256(src    ), shuf));
+			_mm256_storeu_si256(dst + 1, _mm256_shuffle_epi8(_mm256_loadu_si256(src + 1), shuf));
+		}
+		RGBA8toBGRA8_Scalar(src, dst, n % 16);
+	}
+
+	#if UC_SIMD_AVX512
+	UC_TARGET("avx512f,avx512bw") static inline void StoreBGR8x16_AVX512(uint8_t* dst, __m512i v)
+	{
+		//Pack each 128 bit lane to 12 bytes and compact the 4 lanes into the lower 48 bytes which get written with a masked store
+		const __m512i shuf = _mm512_broadcast_i32x4(_mm_setr_epi8(UC_SHUF_BGR));
+		const __m512i perm = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0, 0, 0, 0);
+		_mm512_mask_storeu_epi32(dst, 0x0FFF, _mm512_permutexvar_epi32(perm, _mm512_shuffle_epi8(v, shuf)));
+	}
+
+	UC_TARGET("avx512f,avx512bw") static void RGBA8toBGR8_AVX512(const void* pSrc, void* pDst, size_t n)
+	{
+		const uint8_t *src = (const uint8_t*)pSrc, *srcEnd16 = src + (n / 16) * 64;
+		uint8_t* dst = (uint8_t*)pDst;
+		for (; src != srcEnd16; src += 64, dst += 48)
+			StoreBGR8x16_AVX512(dst, _mm512_loadu_si512(src));
+		RGBA8toBGR8_Scalar(src, dst, n % 16);
+	}
+
+	UC_TARGET("avx512f,avx512bw") static void RGBA8toBGRA8_AVX512(const void* pSrc, void* pDst, size_t n)
+	{
+		const __m512i shuf = _mm512_broadcast_i32x4(_mm_setr_epi8(UC_SHUF_BGRA));
+		const uint8_t *src = (const uint8_t*)pSrc, *srcEnd16 = src + (n / 16) * 64;
+		uint8_t* dst = (uint8_t*)pDst;
+		for (; src != srcEnd16; src += 64, dst += 64)
+			_mm512_storeu_si512(dst, _mm512_shuffle_epi8(_mm512_loadu_si512(src), shuf));
+		RGBA8toBGRA8_Scalar(src, dst, n % 16);
+	}
+	#endif
+
+	//Converts 8 pixels of RGBA half floats to RGBA8 with the same mapping as the 64k lookup table built for FORMAT_FP16_GAMMA
+	UC_TARGET("avx2,f16c") static inline __m256i RGBA16toRGBA8x8_F16C(const __m128i* src)
+	{
+		__m256i a = _mm256_cvttps_epi32(RGBA16Clamp_F16C(_mm_loadu_si128(src    )));
+		__m256i b = _mm256_cvttps_epi32(RGBA16Clamp_F16C(_mm_loadu_si128(src + 1)));
+		__m256i c = _mm256_cvttps_epi32(RGBA16Clamp_F16C(_mm_loadu_si128(src + 2)));
+		__m256i d = _mm256_cvttps_epi32(RGBA16Clamp_F16C(_mm_loadu_si128(src + 3)));
+
+		//The pack instructions work per 128 bit lane which leaves the pixels in order 0,2,4,6,1,3,5,7, the permute restores the order
+		return _mm256_permutevar8x32_epi32(_mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d)), _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+	}
+
+	UC_TARGET("avx2,f16c") static inline __m256 RGBA16Clamp_F16C(__m128i h)
+	{
+		//Clamp to [0, 1] like the lookup table (all values with the sign bit set become 0, positive NaN becomes 1) and scale to [0, 256)
+		__m256 f = _mm256_cvtph_ps(h);
+		f = _mm256_min_ps(_mm256_andnot_ps(_mm256_castsi256_ps(_mm256_srai_epi32(_mm256_castps_si256(f), 31)), f), _mm256_set1_ps(1.0f));
+		return _mm256_mul_ps(f, _mm256_set1_ps(255.9999f));
+	}
+
+	UC_TARGET("avx2,f16c") static void RGBA16toBGR8_F16C(const void* pSrc, void* pDst, size_t n)
+	{
+		const __m128i *src = (const __m128i*)pSrc, *srcEnd16 = src + (n / 16) * 8;
+		uint8_t* dst = (uint8_t*)pDst;
+		for (; src != srcEnd16; src += 8, dst += 48)
+			StoreBGR8x16_AVX2(dst, RGBA16toRGBA8x8_F16C(src), RGBA16toRGBA8x8_F16C(src + 4));
+		if (n % 16) { __m128i tmp[8+3]; RGBA16Remainder(src, tmp, n % 16); RGBA16toBGR8_F16C(tmp, tmp + 8, 16); memcpy(dst, tmp + 8, (n % 16) * 3); }
+	}
+
+	UC_TARGET("avx2,f16c") static void RGBA16toBGRA8_F16C(const void* pSrc, void* pDst, size_t n)
+	{
+		const __m256i shuf = _mm256_broadcastsi128_si256(_mm_setr_epi8(UC_SHUF_BGRA));
+		const __m128i *src = (const __m128i*)pSrc, *srcEnd8 = src + (n / 8) * 4;
+		__m256i* dst = (__m256i*)pDst;
+		for (; src != srcEnd8; src += 4, dst++)
+			_mm256_storeu_si256(dst, _mm256_shuffle_epi8(RGBA16toRGBA8x8_F16C(src), shuf));
+		if (n % 8) { __m128i tmp[8+4]; RGBA16Remainder(src, tmp, n % 8); RGBA16toBGRA8_F16C(tmp, tmp + 8, 8); memcpy(dst, tmp + 8, (n % 8) * 4); }
+	}
+
+	#if UC_SIMD_AVX512
+	//Converts 4 pixels of RGBA half floats to RGBA8 with the same mapping as the 64k lookup table (sRGB encoded for FORMAT_FP16_LINEAR)
+	template <bool SRGB> UC_TARGET("avx512f,avx512bw") static inline __m128i RGBA16toRGBA8x4_AVX512(const __m256i* src)
+	{
+		//Clamp to [0, 1] like the lookup table (all values with the sign bit set become 0, positive NaN becomes 1)
+		__m512 f = _mm512_cvtph_ps(_mm256_loadu_si256(src));
+		f = _mm512_min_ps(_mm512_maskz_mov_ps((__mmask16)~_mm512_cmplt_epi32_mask(_mm512_castps_si512(f), _mm512_setzero_si512()), f), _mm512_set1_ps(1.0f));
+		if (!SRGB) return _mm512_cvtusepi32_epi8(_mm512_cvttps_epi32(_mm512_mul_ps(f, _mm512_set1_ps(255.9999f))));
+
+		//sRGB encode (1.055 * x^(1/2.4) - 0.055) * 255.9999 with x split into 2^e * t, a 10 entry table contains 1.055 * 255.9999 * 2^(e/2.4)
+		//for e in [-9, 0] and a cubic polynomial approximates t^(1/2.4) for t in [1, 2) (max relative error 1.1e-4, at most off by 1 from the table)
+		const __m512 ExpTable = _mm512_setr_ps(20.0738083f, 26.7953193f, 35.7674601f, 47.7438312f, 63.7303687f, 85.0698361f, 113.554608f, 151.577216f, 202.331309f, 270.079894f, 0, 0, 0, 0, 0, 0);
+		__m512i xi = _mm512_castps_si512(_mm512_max_ps(f, _mm512_set1_ps(0.0031308f)));
+		__m512i e = _mm512_sub_epi32(_mm512_srli_epi32(xi, 23), _mm512_set1_epi32(127 - 9));
+		__m512 t = _mm512_castsi512_ps(_mm512_ternarylogic_epi32(xi, _mm512_set1_epi32(0x7FFFFF), _mm512_set1_epi32(0x3F800000), 0xEA)); //(xi & mantissa) | one
+		__m512 p = _mm512_set1_ps(0.0237328153f);
+		p = _mm512_fmadd_ps(p, t, _mm512_set1_ps(-0.17331086f));
+		p = _mm512_fmadd_ps(p, t, _mm512_set1_ps(0.68860106f));
+		p = _mm512_fmadd_ps(p, t, _mm512_set1_ps(0.46108379f));
+		p = _mm512_fmsub_ps(_mm512_permutexvar_ps(e, ExpTable), p, _mm512_set1_ps(0.055f * 255.9999f));
+		p = _mm512_mask_mul_ps(p, _mm512_cmp_ps_mask(f, _mm512_set1_ps(0.0031308f), _CMP_LE_OQ), f, _mm512_set1_ps(12.92f * 255.9999f));
+		return _mm512_cvtusepi32_epi8(_mm512_cvttps_epi32(p));
+	}
+
+	template <bool SRGB> UC_TARGET("avx512f,avx512bw") static inline __m512i RGBA16toRGBA8x16_AVX512(const __m256i* src)
+	{
+		__m256i lo = _mm256_inserti128_si256(_mm256_castsi128_si256(RGBA16toRGBA8x4_AVX512<SRGB>(src    )), RGBA16toRGBA8x4_AVX512<SRGB>(src + 1), 1);
+		__m256i hi = _mm256_inserti128_si256(_mm256_castsi128_si256(RGBA16toRGBA8x4_AVX512<SRGB>(src + 2)), RGBA16toRGBA8x4_AVX512<SRGB>(src + 3), 1);
+		return _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+	}
+
+	template <bool SRGB> UC_TARGET("avx512f,avx512bw") static void RGBA16toBGR8_AVX512(const void* pSrc, void* pDst, size_t n)
+	{
+		const __m256i *src = (const __m256i*)pSrc, *srcEnd16 = src + (n / 16) * 4;
+		uint8_t* dst = (uint8_t*)pDst;
+		for (; src != srcEnd16; src += 4, dst += 48)
+			StoreBGR8x16_AVX512(dst, RGBA16toRGBA8x16_AVX512<SRGB>(src));
+		if (n % 16) { __m128i tmp[8+3]; RGBA16Remainder(src, tmp, n % 16); RGBA16toBGR8_AVX512<SRGB>(tmp, tmp + 8, 16); memcpy(dst, tmp + 8, (n % 16) * 3); }
+	}
+
+	template <bool SRGB> UC_TARGET("avx512f,avx512bw") static void RGBA16toBGRA8_AVX512(const void* pSrc, void* pDst, size_t n)
+	{
+		const __m512i shuf = _mm512_broadcast_i32x4(_mm_setr_epi8(UC_SHUF_BGRA));
+		const __m256i *src = (const __m256i*)pSrc, *srcEnd16 = src + (n / 16) * 4;
+		uint8_t* dst = (uint8_t*)pDst;
+		for (; src != srcEnd16; src += 4, dst += 64)
+			_mm512_storeu_si512(dst, _mm512_shuffle_epi8(RGBA16toRGBA8x16_AVX512<SRGB>(src), shuf));
+		if (n % 16) { __m128i tmp[8+4]; RGBA16Remainder(src, tmp, n % 16); RGBA16toBGRA8_AVX512<SRGB>(tmp, tmp + 8, 16); memcpy(dst, tmp + 8, (n % 16) * 4); }
+	}
+	#endif
+
+	//Copy the remaining (less than 16) pixels of a row into a zero padded block so they can go through the vector code
+	static void RGBA16Remainder(const void* src, __m128i* tmp, size_t n)
+	{
+		memset(tmp, 0, 16 * 8);
+		memcpy(tmp, src, n * 8);
+	}
+
+	//The resize filters blend two taps per madd instruction, 'taps' is always even for them
+	static inline int32_t FilterWeightPair(const int16_t* w) { return (int32_t)(uint16_t)w[0] | ((int32_t)w[1] << 16); }
+
+	UC_TARGET("sse2") static void FilterV_SSE2(const uint8_t* const* rows, const int16_t* weights, size_t taps, int16_t* dst, size_t count)
+	{
+		const __m128i zero = _mm_setzero_si128(), round = _mm_set1_epi32(64);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+			for (size_t t = 0; t != taps; t += 2)
+			{
+				//Interleave the channels of both rows so one madd applies both weights
+				const __m128i a = _mm_loadu_si128((const __m128i*)(rows[t] + i)), b = _mm_loadu_si128((const __m128i*)(rows[t+1] + i));
+				const __m128i w = _mm_set1_epi32(FilterWeightPair(weights + t)), lo = _mm_unpacklo_epi8(a, b), hi = _mm_unpackhi_epi8(a, b);
+				acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w));
+				acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w));
+				acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w));
+				acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w));
+			}
+			_mm_storeu_si128((__m128i*)(dst + i    ), _mm_packs_epi32(_mm_srai_epi32(acc0, 7), _mm_srai_epi32(acc1, 7)));
+			_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_packs_epi32(_mm_srai_epi32(acc2, 7), _mm_srai_epi32(acc3, 7)));
+		}
+		FilterVRemainder(rows, weights, taps, dst, i, count);
+	}
+
+	UC_TARGET("avx2") static void FilterV_AVX2(const uint8_t* const* rows, const int16_t* weights, size_t taps, int16_t* dst, size_t count)
+	{
+		const __m256i zero = _mm256_setzero_si256(), round = _mm256_set1_epi32(64);
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			__m256i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+			for (size_t t = 0; t != taps; t += 2)
+			{
+				const __m256i a = _mm256_loadu_si256((const __m256i*)(rows[t] + i)), b = _mm256_loadu_si256((const __m256i*)(rows[t+1] + i));
+				const __m256i w = _mm256_set1_epi32(FilterWeightPair(weights + t)), lo = _mm256_unpacklo_epi8(a, b), hi = _mm256_unpackhi_epi8(a, b);
+				acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), w));
+				acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), w));
+				acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), w));
+				acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), w));
+			}
+			//Unpacking and packing work within 128-bit lanes, the lane halves get put back in order when storing
+			const __m256i r0 = _mm256_packs_epi32(_mm256_srai_epi32(acc0, 7), _mm256_srai_epi32(acc1, 7));
+			const __m256i r1 = _mm256_packs_epi32(_mm256_srai_epi32(acc2, 7), _mm256_srai_epi32(acc3, 7));
+			_mm256_storeu_si256((__m256i*)(dst + i     ), _mm256_permute2x128_si256(r0, r1, 0x20));
+			_mm256_storeu_si256((__m256i*)(dst + i + 16), _mm256_permute2x128_si256(r0, r1, 0x31));
+		}
+		FilterVRemainder(rows, weights, taps, dst, i, count);
+	}
+
+	UC_TARGET("sse2") static void FilterH_SSE2(const int16_t* src, const uint32_t* index, const int16_t* weights, size_t taps, uint8_t* dst, size_t count, size_t dstBPP)
+	{
+		for (; count; count--, index++, weights += taps, dst += dstBPP)
+		{
+			__m128i acc = _mm_set1_epi32(1 << 20);
+			for (size_t t = 0; t != taps; t += 2)
+			{
+				//Load two neighboring pixels and interleave their channels to apply both weights with one madd
+				const __m128i v = _mm_loadu_si128((const __m128i*)(src + (*index + t) * 4));
+				acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(v, _mm_srli_si128(v, 8)), _mm_set1_epi32(FilterWeightPair(weights + t))));
+			}
+			acc = _mm_packs_epi32(_mm_srai_epi32(acc, 21), acc);
+			const uint32_t Pixel = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(acc, acc));
+			if (dstBPP == 4 || count > 1) memcpy(dst, &Pixel, 4); //for BGR the 4th byte gets overwritten by the next pixel
+			else memcpy(dst, &Pixel, 3);
+		}
+	}
+
+	UC_TARGET("avx2") static void FilterH_AVX2(const int16_t* src, const uint32_t* index, const int16_t* weights, size_t taps, uint8_t* dst, size_t count, size_t dstBPP)
+	{
+		//Two output pixels at once, one in each 128-bit lane
+		for (; count >= 2; count -= 2, index += 2, weights += taps * 2, dst += dstBPP * 2)
+		{
+			__m256i acc = _mm256_set1_epi32(1 << 20);
+			for (size_t t = 0; t != taps; t += 2)
+			{
+				const __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src + (index[0] + t) * 4))), _mm_loadu_si128((const __m128i*)(src + (index[1] + t) * 4)), 1);
+				const __m256i w = _mm256_inserti128_si256(_mm256_set1_epi32(FilterWeightPair(weights + t)), _mm_set1_epi32(FilterWeightPair(weights + taps + t)), 1);
+				acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_unpacklo_epi16(v, _mm256_srli_si256(v, 8)), w));
+			}
+			acc = _mm256_packs_epi32(_mm256_srai_epi32(acc, 21), acc);
+			acc = _mm256_packus_epi16(acc, acc);
+			const uint32_t Pixels[2] = { (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(acc)), (uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(acc, 1)) };
+			memcpy(dst, Pixels, 4);
+			if (dstBPP == 4 || count > 2) memcpy(dst + dstBPP, Pixels + 1, 4); //for BGR the 4th byte gets overwritten by the next pixel
+			else memcpy(dst + dstBPP, Pixels + 1, 3);
+		}
+		if (count) FilterH_SSE2(src, index, weights, taps, dst, count, dstBPP);
+	}
+
+	UC_TARGET("avx2") static void FilterVFloat_AVX2(const float* const* rows, const int16_t* weights, size_t taps, float* dst, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+			for (size_t t = 0; t != taps; t++)
+			{
+				const __m256 w = _mm256_set1_ps(FilterWeight(weights[t]));
+				acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(rows[t] + i), w));
+				acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(rows[t] + i + 8), w));
+			}
+			_mm256_storeu_ps(dst + i, acc0), _mm256_storeu_ps(dst + i + 8, acc1);
+		}
+		FilterVFloatRemainder(rows, weights, taps, dst, i, count);
+	}
+
+	UC_TARGET("sse2") static void FilterHFloat_SSE2(const float* src, const uint32_t* index, const int16_t* weights, size_t taps, float scale, uint16_t* dst, size_t count)
+	{
+		const __m128 Scale = _mm_set1_ps(scale), Max = _mm_set1_ps(65535.0f);
+		for (; count; count--, index++, weights += taps, dst += 4)
+		{
+			//One RGBA pixel per register, the clamped values get moved into the signed range for the pack and back (SSE2 has no packus_epi32)
+			__m128 acc = _mm_setzero_ps();
+			for (size_t t = 0; t != taps; t++) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(src + (*index + t) * 4), _mm_set1_ps(FilterWeight(weights[t]))));
+			const __m128i v = _mm_sub_epi32(_mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(acc, Scale), _mm_setzero_ps()), Max)), _mm_set1_epi32(0x8000));
+			_mm_storel_epi64((__m128i*)dst, _mm_xor_si128(_mm_packs_epi32(v, v), _mm_set1_epi16(-0x8000)));
+		}
+	}
+
+	//Clamps 8 half floats to [0, 1] like the lookup table (all values with the sign bit set become 0, positive NaN becomes 1)
+	//With TABLE the half float bits clamped to infinity index the table of ProcessToneMap instead
+	template <bool TABLE> UC_TARGET("avx2,f16c") static inline __m256 HalfChannel_F16C(__m128i h, const float* Table)
+	{
+		if (TABLE) return _mm256_i32gather_ps(Table, _mm256_cvtepu16_epi32(_mm_min_epu16(_mm_andnot_si128(_mm_srai_epi16(h, 15), h), _mm_set1_epi16(0x7C00))), 4);
+		const __m256 f = _mm256_cvtph_ps(h);
+		return _mm256_min_ps(_mm256_andnot_ps(_mm256_castsi256_ps(_mm256_srai_epi32(_mm256_castps_si256(f), 31)), f), _mm256_set1_ps(1.0f));
+	}
+
+	//Loads 8 pixels as separate R, G, B (and A if requested) vectors, INPUT 0 is RGBA8 and 4 is BGRA8, 1 and 2 are half floats (2 through
+	//HalfTable) and 3 is 16 bit RGBA (see LoadRGBA_Scalar)
+	template <int INPUT> UC_TARGET("avx2,f16c") static inline void LoadRGBx8_AVX2(const uint8_t* src, const float* HalfTable, __m256& r, __m256& g, __m256& b, __m256* a = NULL)
+	{
+		if (INPUT == 0 || INPUT == 4)
+		{
+			const __m256i v = _mm256_loadu_si256((const __m256i*)src), mask = _mm256_set1_epi32(0xFF);
+			r = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, INPUT == 4 ? 16 : 0), mask));
+			g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 8), mask));
+			b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, INPUT == 4 ? 0 : 16), mask));
+			if (a) *a = _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 24));
+			return;
+		}
+		//Group the channels of each pixel pair, then the pairs of all 4 lanes so every channel ends up in its own 128 bits
+		const __m256i shuf = _mm256_broadcastsi128_si256(_mm_setr_epi8(0,1,8,9, 2,3,10,11, 4,5,12,13, 6,7,14,15)), perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+		const __m256i lo = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)src), shuf), perm);
+		const __m256i hi = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + 32)), shuf), perm);
+		const __m256i rb = _mm256_unpacklo_epi64(lo, hi), ga = _mm256_unpackhi_epi64(lo, hi);
+		if (INPUT == 3)
+		{
+			r = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(rb))), g = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(ga)));
+			b = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(rb, 1)));
+			if (a) *a = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(ga, 1)));
+			return;
+		}
+		r = HalfChannel_F16C<INPUT == 2>(_mm256_castsi256_si128(rb), HalfTable);
+		g = HalfChannel_F16C<INPUT == 2>(_mm256_castsi256_si128(ga), HalfTable);
+		b = HalfChannel_F16C<INPUT == 2>(_mm256_extracti128_si256(rb, 1), HalfTable);
+		if (a) *a = HalfChannel_F16C<false>(_mm256_extracti128_si256(ga, 1), NULL);
+	}
+
+	UC_TARGET("avx2") static inline __m256i YUVDot_AVX2(const __m256* m, __m256 r, __m256 g, __m256 b)
+	{
+		return _mm256_cvtps_epi32(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, m[0]), _mm256_mul_ps(g, m[1])), _mm256_mul_ps(b, m[2])), m[3]));
+	}
+
+	UC_TARGET("avx2") static inline __m128i PackYx16_AVX2(__m256i a, __m256i b)
+	{
+		const __m256i ab = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+		return _mm_packus_epi16(_mm256_castsi256_si128(ab), _mm256_extracti128_si256(ab, 1));
+	}
+
+	//Packs 8 U and 8 V values left by hadd in the order 0,1,4,5,2,3,6,7 to bytes, interleaved (u0,v0,u1,v1,..) or planar (u0..u7,v0..v7)
+	template <bool INTERLEAVED> UC_TARGET("avx2") static inline __m128i PackUVx8_AVX2(__m256i u, __m256i v)
+	{
+		const __m256i uv = _mm256_packs_epi32(u, v);
+		const __m128i b = _mm_packus_epi16(_mm256_castsi256_si128(uv), _mm256_extracti128_si256(uv, 1)); //u0,u1,u4,u5,v0,v1,v4,v5,u2,u3,u6,u7,v2,v3,v6,v7
+		return _mm_shuffle_epi8(b, (INTERLEAVED ? _mm_setr_epi8(0,4,1,5, 8,12,9,13, 2,6,3,7, 10,14,11,15) : _mm_setr_epi8(0,1,8,9, 2,3,10,11, 4,5,12,13, 6,7,14,15)));
+	}
+
+	//Converts 16 pixels of two rows, m holds the Y, U and V rows of the matrix (12 vectors) with the chroma averaging folded in
+	template <int INPUT, int LAYOUT> UC_TARGET("avx2,f16c") static inline void ToYUVx16_AVX2(const uint8_t* src0, const uint8_t* src1, const __m256* m, const float* HalfTable, uint8_t* dst0, uint8_t* dst1, uint8_t* u, uint8_t* v)
+	{
+		enum { BPP = (INPUT ? 8 : 4) };
+		__m256 r0a, g0a, b0a, r0b, g0b, b0b, r1a, g1a, b1a, r1b, g1b, b1b;
+		LoadRGBx8_AVX2<INPUT>(src0, HalfTable, r0a, g0a, b0a), LoadRGBx8_AVX2<INPUT>(src0 + 8 * BPP, HalfTable, r0b, g0b, b0b);
+		LoadRGBx8_AVX2<INPUT>(src1, HalfTable, r1a, g1a, b1a), LoadRGBx8_AVX2<INPUT>(src1 + 8 * BPP, HalfTable, r1b, g1b, b1b);
+		if (LAYOUT == YUV_P010)
+		{
+			//Y and the interleaved chroma as 16 bit words, the pack instructions leave the 64 bit quarters in the order 0,2,1,3
+			_mm256_storeu_si256((__m256i*)dst0, PackP010_AVX2(_mm256_packus_epi32(YUVDot_AVX2(m, r0a, g0a, b0a), YUVDot_AVX2(m, r0b, g0b, b0b))));
+			_mm256_storeu_si256((__m256i*)dst1, PackP010_AVX2(_mm256_packus_epi32(YUVDot_AVX2(m, r1a, g1a, b1a), YUVDot_AVX2(m, r1b, g1b, b1b))));
+			const __m256 r = _mm256_hadd_ps(_mm256_add_ps(r0a, r1a), _mm256_add_ps(r0b, r1b));
+			const __m256 g = _mm256_hadd_ps(_mm256_add_ps(g0a, g1a), _mm256_add_ps(g0b, g1b));
+			const __m256 b = _mm256_hadd_ps(_mm256_add_ps(b0a, b1a), _mm256_add_ps(b0b, b1b));
+			const __m256i cu = YUVDot_AVX2(m + 4, r, g, b), cv = YUVDot_AVX2(m + 8, r, g, b); //in the order 0,1,4,5,2,3,6,7 left by hadd
+			_mm256_storeu_si256((__m256i*)u, PackP010_AVX2(_mm256_packus_epi32(_mm256_unpacklo_epi32(cu, cv), _mm256_unpackhi_epi32(cu, cv))));
+			return;
+		}
+		const __m128i y0 = PackYx16_AVX2(YUVDot_AVX2(m, r0a, g0a, b0a), YUVDot_AVX2(m, r0b, g0b, b0b));
+		const __m128i y1 = PackYx16_AVX2(YUVDot_AVX2(m, r1a, g1a, b1a), YUVDot_AVX2(m, r1b, g1b, b1b));
+		if (LAYOUT == YUV_YUY2)
+		{
+			//Horizontal pairs of each row, packed as Y0 U Y1 V
+			__m256 r = _mm256_hadd_ps(r0a, r0b), g = _mm256_hadd_ps(g0a, g0b), b = _mm256_hadd_ps(b0a, b0b);
+			__m128i uv = PackUVx8_AVX2<true>(YUVDot_AVX2(m + 4, r, g, b), YUVDot_AVX2(m + 8, r, g, b));
+			_mm_storeu_si128((__m128i*)dst0, _mm_unpacklo_epi8(y0, uv)), _mm_storeu_si128((__m128i*)(dst0 + 16), _mm_unpackhi_epi8(y0, uv));
+			r = _mm256_hadd_ps(r1a, r1b), g = _mm256_hadd_ps(g1a, g1b), b = _mm256_hadd_ps(b1a, b1b);
+			uv = PackUVx8_AVX2<true>(YUVDot_AVX2(m + 4, r, g, b), YUVDot_AVX2(m + 8, r, g, b));
+			_mm_storeu_si128((__m128i*)dst1, _mm_unpacklo_epi8(y1, uv)), _mm_storeu_si128((__m128i*)(dst1 + 16), _mm_unpackhi_epi8(y1, uv));
+			return;
+		}
+		_mm_storeu_si128((__m128i*)dst0, y0), _mm_storeu_si128((__m128i*)dst1, y1);
+
+		//Sum the 2x2 blocks, vertically first so the order of additions matches the scalar code
+		const __m256 r = _mm256_hadd_ps(_mm256_add_ps(r0a, r1a), _mm256_add_ps(r0b, r1b));
+		const __m256 g = _mm256_hadd_ps(_mm256_add_ps(g0a, g1a), _mm256_add_ps(g0b, g1b));
+		const __m256 b = _mm256_hadd_ps(_mm256_add_ps(b0a, b1a), _mm256_add_ps(b0b, b1b));
+		const __m128i uv = PackUVx8_AVX2<LAYOUT == YUV_NV12>(YUVDot_AVX2(m + 4, r, g, b), YUVDot_AVX2(m + 8, r, g, b));
+		if (LAYOUT == YUV_NV12) _mm_storeu_si128((__m128i*)u, uv);
+		else _mm_storel_epi64((__m128i*)u, uv), _mm_storel_epi64((__m128i*)v, _mm_srli_si128(uv, 8));
+	}
+
+	UC_TARGET("avx2") static inline __m256i PackP010_AVX2(__m256i w)
+	{
+		return _mm256_slli_epi16(_mm256_min_epu16(_mm256_permute4x64_epi64(w, 0xD8), _mm256_set1_epi16(1023)), 6);
+	}
+
+	template <int INPUT, int LAYOUT> UC_TARGET("avx2,f16c") static void ToYUV_AVX2(const void* pSrc0, const void* pSrc1, size_t n, const ProcessYUVMatrix* Matrix, const float* HalfTable, uint8_t* dst0, uint8_t* dst1, uint8_t* u, uint8_t* v)
+	{
+		enum { BPP = (INPUT ? 8 : 4), YBPP = (LAYOUT == YUV_YUY2 || LAYOUT == YUV_P010 ? 2 : 1) };
+		const float cs = (LAYOUT == YUV_YUY2 ? 0.5f : 0.25f);
+		__m256 m[12];
+		for (int i = 0; i != 4; i++)
+		{
+			m[i]     = _mm256_set1_ps(Matrix->Y[i]);
+			m[i + 4] = _mm256_set1_ps(i == 3 ? Matrix->U[i] : Matrix->U[i] * cs);
+			m[i + 8] = _mm256_set1_ps(i == 3 ? Matrix->V[i] : Matrix->V[i] * cs);
+		}
+		const uint8_t *src0 = (const uint8_t*)pSrc0, *src1 = (const uint8_t*)pSrc1;
+		size_t i = 0;
+		for (; i + 16 <= n; i += 16)
+			ToYUVx16_AVX2<INPUT, LAYOUT>(src0 + i * BPP, src1 + i * BPP, m, HalfTable, dst0 + i * YBPP, dst1 + i * YBPP,
+				(LAYOUT == YUV_I420 ? u + i / 2 : (LAYOUT == YUV_YUY2 ? u : u + i * YBPP)), (LAYOUT == YUV_I420 ? v + i / 2 : v));
+		if (i == n) return;
+
+		//Remaining pixels go through a zero padded block
+		const size_t r = n - i;
+		uint8_t In[2][16 * BPP], Out[2][16 * YBPP], UV[2][16 * YBPP];
+		memset(In, 0, sizeof(In));
+		memcpy(In[0], src0 + i * BPP, r * BPP), memcpy(In[1], src1 + i * BPP, r * BPP);
+		ToYUVx16_AVX2<INPUT, LAYOUT>(In[0], In[1], m, HalfTable, Out[0], Out[1], UV[0], UV[1]);
+		memcpy(dst0 + i * YBPP, Out[0], r * YBPP), memcpy(dst1 + i * YBPP, Out[1], r * YBPP);
+		if (LAYOUT == YUV_NV12 || LAYOUT == YUV_P010) memcpy(u + i * YBPP, UV[0], r * YBPP);
+		if (LAYOUT == YUV_I420) memcpy(u + i / 2, UV[0], r / 2), memcpy(v + i / 2, UV[1], r / 2);
+	}
+
+	//Converts 8 pixels to 16 bit channels (8-bit ones get multiplied by 257 so 255 becomes 65535) stored big endian as RGB or ARGB
+	template <int INPUT, bool ALPHA> UC_TARGET("avx2,f16c") static inline void ToRGB16x8_AVX2(const uint8_t* src, uint8_t* dst, const float* HalfTable)
+	{
+		const __m256 Scale = _mm256_set1_ps(INPUT == 0 || INPUT == 4 ? 257.0f : (INPUT == 3 ? 1.0f : 65535.0f));
+		__m256 r, g, b, a = _mm256_setzero_ps();
+		LoadRGBx8_AVX2<INPUT>(src, HalfTable, r, g, b, (ALPHA ? &a : NULL));
+		const __m256i rg = _mm256_packus_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(r, Scale)), _mm256_cvtps_epi32(_mm256_mul_ps(g, Scale)));
+		const __m256i ba = _mm256_packus_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(b, Scale)), _mm256_cvtps_epi32(_mm256_mul_ps(a, Scale)));
+
+		//Interleave to RGBA words which leaves the pixels 0,1,4,5 and 2,3,6,7 in the two registers, then swap the bytes into place
+		const __m256i lo = _mm256_unpacklo_epi16(rg, ba), hi = _mm256_unpackhi_epi16(rg, ba);
+		const __m256i p0 = _mm256_unpacklo_epi16(lo, hi), p1 = _mm256_unpackhi_epi16(lo, hi);
+		const __m256i shuf = _mm256_broadcastsi128_si256(ALPHA ? _mm_setr_epi8(7,6,1,0,3,2,5,4, 15,14,9,8,11,10,13,12) : _mm_setr_epi8(1,0,3,2,5,4, 9,8,11,10,13,12, -1,-1,-1,-1));
+		const __m256i a0 = _mm256_shuffle_epi8(_mm256_permute2x128_si256(p0, p1, 0x20), shuf), a1 = _mm256_shuffle_epi8(_mm256_permute2x128_si256(p0, p1, 0x31), shuf);
+		if (!ALPHA) { StoreLanes12_AVX2(dst, a0, a1); return; }
+		_mm256_storeu_si256((__m256i*)dst, a0), _mm256_storeu_si256((__m256i*)(dst + 32), a1);
+	}
+
+	template <int INPUT, bool ALPHA> UC_TARGET("avx2,f16c") static void ToRGB16_AVX2(const void* pSrc, void* pDst, size_t n, const float* HalfTable)
+	{
+		enum { BPP = (INPUT == 0 || INPUT == 4 ? 4 : 8), OUTBPP = (ALPHA ? 8 : 6) };
+		const uint8_t* src = (const uint8_t*)pSrc;
+		uint8_t* dst = (uint8_t*)pDst;
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) ToRGB16x8_AVX2<INPUT, ALPHA>(src + i * BPP, dst + i * OUTBPP, HalfTable);
+		if (i == n) return;
+		uint8_t In[8 * BPP], Out[8 * 8];
+		memset(In, 0, sizeof(In));
+		memcpy(In, src + i * BPP, (n - i) * BPP);
+		ToRGB16x8_AVX2<INPUT, ALPHA>(In, Out, HalfTable);
+		memcpy(dst + i * OUTBPP, Out, (n - i) * OUTBPP);
+	}
+
+	#undef UC_SHUF_BGRA
+	#undef UC_SHUF_BGR
+	#endif
+};
+
+//The best set of kernels for the running CPU is selected once when the module gets loaded
+static const ProcessKernels g_ProcessKernels;
+
+//Source pixels and blend weights for every output column and row of a resize
+//It gets rebuilt only when the source or output size, the filter or the mirroring changes
+struct ProcessResizeMap
+{
+	enum EFilter { FILTER_NEAREST, FILTER_BILINEAR, FILTER_AREA };
+	enum { MAXAREATAPS = 64 }; //FILTER_AREA shrinking by more than 63x would need more taps and uses FILTER_BILINEAR instead
+	struct Axis
+	{
+		size_t Start, End; //output range covered by the source image, everything outside is the black letterbox
+		size_t SpanStart, SpanEnd; //range of source pixels read by the output range
+		size_t Taps; //source pixels blended per output pixel (1 for FILTER_NEAREST, otherwise always even)
+		uint32_t* Index; //first source pixel (relative to SpanStart) for every output pixel
+		int16_t* Weights; //Taps weights in 2.14 fixed point for every output pixel, NULL for FILTER_NEAREST
+	} Cols, Rows;
+	size_t FromWidth, FromHeight, ToWidth, ToHeight;
+	EFilter Filter;
+	bool Mirror;
+
+	ProcessResizeMap() : FromWidth(0), FromHeight(0), ToWidth(0), ToHeight(0), Filter(FILTER_NEAREST), Mirror(false), Mem(NULL) {}
+	~ProcessResizeMap() { if (Mem) free(Mem); }
+
+	void Update(size_t InWidth, size_t InHeight, size_t OutWidth, size_t OutHeight, EFilter InFilter, bool InMirror)
+	{
+		if (Mem && FromWidth == InWidth && FromHeight == InHeight && ToWidth == OutWidth && ToHeight == OutHeight && Filter == InFilter && Mirror == InMirror) return;
+		FromWidth = InWidth, FromHeight = InHeight, ToWidth = OutWidth, ToHeight = OutHeight, Filter = InFilter, Mirror = InMirror;
+
+		//Scale to fit the whole source image and center it (letterbox)
+		const double aw = (double)OutWidth, ah = (double)OutHeight;
+		const double scale = (InWidth / aw > InHeight / ah ? InWidth / aw : InHeight / ah);
+
+		//Area averaging covers up to ceil(scale)+1 source pixels, the vector code blends taps in pairs so the count is kept even
+		EFilter AxisFilter = Filter;
+		size_t Taps = (Filter == FILTER_NEAREST ? 1 : 2);
+		if (Filter == FILTER_AREA) { Taps = (size_t)ceil(scale) + 1; Taps += (Taps & 1); }
+		if (Taps > MAXAREATAPS) AxisFilter = FILTER_BILINEAR, Taps = 2;
+		Cols.Taps = Rows.Taps = Taps;
+
+		if (Mem) free(Mem);
+		Mem = malloc((OutWidth + OutHeight) * (sizeof(uint32_t) + Taps * sizeof(int16_t)));
+		Cols.Index = (uint32_t*)Mem, Rows.Index = Cols.Index + OutWidth;
+		Cols.Weights = (Filter == FILTER_NEAREST ? NULL : (int16_t*)(Rows.Index + OutHeight));
+		Rows.Weights = (Filter == FILTER_NEAREST ? NULL : Cols.Weights + OutWidth * Taps);
+		BuildAxis(Cols, OutWidth,  InWidth,  scale, (aw - (InWidth  / scale)) / 2.0, AxisFilter);
+		BuildAxis(Rows, OutHeight, InHeight, scale, (ah - (InHeight / scale)) / 2.0, AxisFilter);
+
+		if (Mirror)
+		{
+			for (uint32_t tmp, *a = Cols.Index, *b = Cols.Index + OutWidth - 1; a < b; a++, b--) tmp = *a, *a = *b, *b = tmp;
+			if (Cols.Weights)
+				for (int16_t tmp[MAXAREATAPS], *a = Cols.Weights, *b = Cols.Weights + (OutWidth - 1) * Taps; a < b; a += Taps, b -= Taps)
+					memcpy(tmp, a, Taps * 2), memcpy(a, b, Taps * 2), memcpy(b, tmp, Taps * 2);
+			const size_t MirrorStart = OutWidth - Cols.End;
+			Cols.End = OutWidth - Cols.Start, Cols.Start = MirrorStart;
+		}
+	}
+
+private:
+	void* Mem;
+
+	static void BuildAxis(Axis& A, size_t To, size_t From, double scale, double a, EFilter Filter)
+	{
+		//Step through the source coordinates in 32.32 fixed point, truncating towards zero like (size_t)((i-a)*scale) did
+		//The start gets biased by the maximum accumulated rounding error so exact integer coordinates don't fall to the pixel before
+		const int64_t step = (int64_t)(scale * 4294967296.0 + 0.5);
+		int64_t pos = (int64_t)(-a * scale * 4294967296.0 + (-a * scale < 0 ? -0.5 : 0.5)) + (int64_t)To;
+		A.Start = A.End = 0;
+		for (size_t i = 0; i != To; i++, pos += step)
+		{
+			const int64_t idx = (pos < 0 ? -((-pos) >> 32) : (pos >> 32));
+			if (idx < 0 || idx >= (int64_t)From) { A.Index[i] = 0; continue; }
+			A.Index[i] = (uint32_t)idx;
+			if (A.End == 0) A.Start = i;
+			A.End = i + 1;
+		}
+		if (A.Weights) memset(A.Weights, 0, To * A.Taps * sizeof(int16_t));
+
+		for (size_t i = A.Start; i != A.End && Filter != FILTER_NEAREST; i++)
+		{
+			double w[MAXAREATAPS], Total = 0;
+			const size_t Taps = A.Taps;
+			if (Filter == FILTER_BILINEAR)
+			{
+				//Sample at the output pixel center and blend the two nearest source pixels
+				double s = (i + 0.5 - a) * scale - 0.5;
+				s = (s < 0 ? 0 : (s > From - 1 ? (double)(From - 1) : s));
+				A.Index[i] = (uint32_t)s;
+				w[1] = s - A.Index[i], w[0] = 1.0 - w[1];
+			}
+			else
+			{
+				//Weight every source pixel by how much of it is covered by the output pixel
+				double lo = (i - a) * scale, hi = (i + 1 - a) * scale;
+				lo = (lo < 0 ? 0 : lo), hi = (hi > From ? (double)From : hi);
+				A.Index[i] = (uint32_t)lo;
+				if (A.Index[i] >= From) A.Index[i] = (uint32_t)(From - 1);
+				for (size_t t = 0; t != Taps; t++)
+				{
+					const double j = (double)(A.Index[i] + t), Overlap = (hi < j + 1 ? hi : j + 1) - (lo > j ? lo : j);
+					w[t] = (Overlap > 0 ? Overlap : 0);
+				}
+			}
+			for (size_t t = 0; t != Taps; t++) Total += w[t];
+			if (Total <= 0) w[0] = Total = 1;
+
+			//Quantize so the weights add up to exactly 1.0 to keep flat colors unchanged
+			int16_t* q = A.Weights + i * A.Taps;
+			int Sum = 0; size_t Largest = 0;
+			for (size_t t = 0; t != Taps; t++)
+			{
+				q[t] = (int16_t)(w[t] / Total * 16384.0 + 0.5);
+				Sum += q[t];
+				if (q[t] > q[Largest]) Largest = t;
+			}
+			q[Largest] = (int16_t)(q[Largest] + (16384 - Sum));
+		}
+
+		//Make the source indices relative to the range of source pixels that actually gets read
+		A.SpanStart = A.SpanEnd = 0;
+		if (A.Start == A.End) return;
+		A.SpanStart = A.Index[A.Start];
+		A.SpanEnd = A.Index[A.End - 1] + A.Taps;
+		if (A.SpanEnd > From) A.SpanEnd = From;
+		for (size_t i = A.Start; i != A.End; i++) A.Index[i] -= (uint32_t)A.SpanStart;
+	}
+};
+
+//Pixel formats the job kernels are generated from, input formats convert a pixel to BGRA8 (as little endian uint32_t)
+struct ProcessFormatRGBA8
+{
+	enum { BPP = 4 };
+	typedef uint32_t Pixel;
+	template <bool ALPHA> static inline uint32_t ToBGRA8(const Pixel* p, const uint8_t*) { return (ALPHA ? ((*p & 0xFF00FF00) | ((*p >> 16) & 0xFF) | ((*p & 0xFF) << 16)) : _byteswap_ulong(*p) >> 8); }
+};
+
+struct ProcessFormatRGBA16
+{
+	enum { BPP = 8 };
+	typedef uint64_t Pixel;
+	//16 bit half floats get mapped through the 64k lookup table (alpha through the 64k after it, see ProcessToneMap::BuildRGBA16Table)
+	//The alpha lookup is skipped if the output has no alpha channel
+	template <bool ALPHA> static inline uint32_t ToBGRA8(const Pixel* p, const uint8_t* Table)
+	{
+		const uint16_t* c = (const uint16_t*)p;
+		return ((ALPHA ? (uint32_t)Table[0x10000 + c[3]] << 24 : 0) | ((uint32_t)Table[c[0]] << 16) | ((uint32_t)Table[c[1]] << 8) | Table[c[2]]);
+	}
+};
+
+struct ProcessFormatBGR8
+{
+	enum { BPP = 3, ALPHA = 0 };
+	static inline void Store(uint8_t* dst, uint32_t bgra) { memcpy(dst, &bgra, 4); } //the 4th byte gets overwritten by the next pixel
+	static inline void StoreLast(uint8_t* dst, uint32_t bgra) { memcpy(dst, &bgra, 3); }
+};
+
+struct ProcessFormatBGRA8
+{
+	enum { BPP = 4, ALPHA = 1 };
+	typedef uint32_t Pixel;
+	template <bool ALPHA> static inline uint32_t ToBGRA8(const Pixel* p, const uint8_t*) { return *p; }
+	static inline void Store(uint8_t* dst, uint32_t bgra) { memcpy(dst, &bgra, 4); }
+	static inline void StoreLast(uint8_t* dst, uint32_t bgra) { memcpy(dst, &bgra, 4); }
+};
+
+struct ProcessJob;
+typedef void (*ProcessJobFunc)(const ProcessJob& Job);
+
+//Conversion of rows of an RGBA source image into the BGR, BGRA, YUV or 16 bit RGB output (optionally mirrored or resized)
+//Setup picks a kernel generated for the exact combination of formats, mirroring and resizing of a frame so executing
+//the job (or any row range of it) has no more decisions to make besides the vectorized or scalar pixel conversion
+struct ProcessJob
+{
+	enum EInput { INPUT_RGBA8, INPUT_RGBA16_GAMMA, INPUT_RGBA16_LINEAR, INPUT_BGRA8 }; //16 bit half floats, linear ones get sRGB encoded
+	enum EOutput { OUTPUT_BGR8, OUTPUT_BGRA8, OUTPUT_NV12, OUTPUT_YUY2, OUTPUT_I420, OUTPUT_P010, OUTPUT_RGB48, OUTPUT_ARGB64 };
+	enum EResize { RESIZE_NONE, RESIZE_NEAREST, RESIZE_FILTER }; //resizing also does the mirroring as set in the resize map
+	enum EColorSpace { COLORSPACE_BT601_LIMITED, COLORSPACE_BT601_FULL, COLORSPACE_BT709_LIMITED, COLORSPACE_BT709_FULL };
+
+	//Memory needed by one thread executing the filter resize with the map (a ring of converted source rows, the blended row and the ring indices)
+	//Outputs with more than 8 bits per channel keep both rows as floats (see ResizeFilterFloat)
+	static size_t FilterMemSize(const ProcessResizeMap& Map, EOutput Out)
+	{
+		const size_t RowPixels = Map.Cols.SpanEnd - Map.Cols.SpanStart + Map.Cols.Taps;
+		const size_t RingPixel = (IsHighBitDepth(Out) ? 4 * sizeof(float) : 4), BlendPixel = (IsHighBitDepth(Out) ? 4 * sizeof(float) : 4 * sizeof(int16_t));
+		return ((Map.Rows.Taps * RowPixels * RingPixel) + (RowPixels * BlendPixel) + (Map.Rows.Taps * (sizeof(size_t) + sizeof(void*))) + 63) & ~(size_t)63;
+	}
+
+	//Outputs from NV12 on are top-down, the YUV ones up to P010 need an even width and height, RGB48 and ARGB64 are big endian (b48r and b64a)
+	static bool IsTopDown(EOutput Out) { return (Out >= OUTPUT_NV12); }
+	static bool IsYUV(EOutput Out) { return (Out >= OUTPUT_NV12 && Out <= OUTPUT_P010); }
+	static bool IsHighBitDepth(EOutput Out) { return (Out >= OUTPUT_P010); }
+	static size_t OutputSize(EOutput Out, size_t Width, size_t Height) { static const uint8_t Bits[] = { 24, 32, 12, 16, 12, 24, 48, 64 }; return Width * Height * Bits[Out] / 8; } //packed rows
+
+	ProcessJobFunc Kernel;
+	ProcessRowFunc RowKernel; //vectorized pixel conversion used by the kernel, NULL to use scalar code (needs RGBA16Table for 16 bit input)
+	const void *BufIn; void *BufOut;
+	size_t Width, RowStart, RowEnd, RGBAInStride; //Width and rows of the output, RGBAInStride is the source row pitch in pixels
+	const ProcessResizeMap* ResizeMap;
+	const uint8_t* RGBA16Table; //ProcessToneMap::RGBA16TABLESIZE bytes
+	const float* HalfTable; //ProcessToneMap::HALFTABLESIZE floats
+	bool NeedsRGBA16Table, NeedsHalfTable; //set by Setup if the kernels read the source through RGBA16Table or HalfTable (built for the same ProcessToneMap)
+	const uint8_t* DirtyRows; //one bit per job row (lowest bit first), if set only the marked rows get converted and the others are left as they are
+	uint8_t* FilterMem; //FilterMemSize bytes for every thread executing the filter resize, the executing thread uses the block at index Worker
+	size_t Worker; //set by ProcessPool for every chunk it executes, 0 for the thread that started the job
+
+	//Top-down outputs are written by YUVKernel (every job row is a pair of output rows) or RGB16Kernel, Height is the output height in
+	//pixels (locating the chroma planes), they read the source directly unless it needs the filter resize, then BandKernel first converts
+	//bands of rows into BGRA8 in Scratch (a buffer for the whole output frame, Width * Height * 4 bytes), or into 16 bit RGBA for the
+	//outputs with more than 8 bits per channel (Width * Height * 8 bytes)
+	ProcessJobFunc BandKernel;
+	ProcessYUVFunc YUVKernel;
+	ProcessHalfRowFunc RGB16Kernel;
+	ProcessYUVMatrix YUV;
+	size_t Height;
+	void* Scratch;
+
+	enum { SAMPLECHUNK = 256, BANDROWS = 32 };
+
+	//ToneMap is set if the tables were built for a ProcessToneMap that isn't off, only half float input reads them
+	void Setup(EInput In, EOutput Out, bool Mirror, EResize Resize, EColorSpace ColorSpace = COLORSPACE_BT601_LIMITED, bool ToneMap = false)
+	{
+		//The filter resize blends source rows converted to BGRA8 and writes the output format itself
+		const bool RowBGRA = (Out != OUTPUT_BGR8 || Resize == RESIZE_FILTER), SRGB = (In == INPUT_RGBA16_LINEAR);
+		const bool Half = (In == INPUT_RGBA16_GAMMA || In == INPUT_RGBA16_LINEAR);
+		if (In == INPUT_RGBA8) RowKernel = (RowBGRA ? g_ProcessKernels.RGBA8toBGRA8 : g_ProcessKernels.RGBA8toBGR8);
+		else if (In == INPUT_BGRA8 || ToneMap) RowKernel = NULL; //tone mapping to 8 bits is baked into the lookup table (no F16C path, see ProcessToneMap)
+		else RowKernel = (RowBGRA ? g_ProcessKernels.RGBA16toBGRA8[SRGB] : g_ProcessKernels.RGBA16toBGR8[SRGB]);
+		NeedsRGBA16Table = (Half && !RowKernel), NeedsHalfTable = false;
+		BandKernel = NULL, YUVKernel = NULL, RGB16Kernel = NULL, DirtyRows = NULL, FilterMem = NULL, Worker = 0;
+
+		if (Out < OUTPUT_NV12)
+		{
+			if (In == INPUT_RGBA8)      Kernel = (Out == OUTPUT_BGRA8 ? SelectKernel<ProcessFormatRGBA8,  ProcessFormatBGRA8>(Mirror, Resize) : SelectKernel<ProcessFormatRGBA8,  ProcessFormatBGR8>(Mirror, Resize));
+			else if (In == INPUT_BGRA8) Kernel = (Out == OUTPUT_BGRA8 ? SelectKernel<ProcessFormatBGRA8,  ProcessFormatBGRA8>(Mirror, Resize) : SelectKernel<ProcessFormatBGRA8,  ProcessFormatBGR8>(Mirror, Resize));
+			else                        Kernel = (Out == OUTPUT_BGRA8 ? SelectKernel<ProcessFormatRGBA16, ProcessFormatBGRA8>(Mirror, Resize) : SelectKernel<ProcessFormatRGBA16, ProcessFormatBGR8>(Mirror, Resize));
+			return;
+		}
+
+		//Mirroring and nearest resizing only pick the source pixels read by the direct kernels so half floats keep their precision
+		const int Layout = (int)(Out - OUTPUT_NV12), Bits = (Out == OUTPUT_P010 ? 10 : 8);
+		if (Resize != RESIZE_FILTER)
+		{
+			//Half floats are read as [0, 1] by the kernels (only gamma ones without tone mapping are just clamped), 8-bit channels as [0, 255]
+			const int Input = (!Half ? 0 : (In == INPUT_RGBA16_GAMMA && !ToneMap ? 1 : 2));
+			if (IsYUV(Out)) YUVKernel = g_ProcessKernels.ToYUV[Input][Layout], SetYUVMatrix(ColorSpace, (Half ? 1.0f : 255.0f), In == INPUT_BGRA8, Bits);
+			else RGB16Kernel = g_ProcessKernels.ToRGB16[In == INPUT_BGRA8 ? 4 : Input][Out == OUTPUT_ARGB64];
+			Kernel = (Half ? SelectDirectKernel<ProcessFormatRGBA16>(Out, Mirror, Resize) : SelectDirectKernel<ProcessFormatRGBA8>(Out, Mirror, Resize));
+			NeedsRGBA16Table = false, NeedsHalfTable = (Input == 2);
+			return;
+		}
+		if (IsHighBitDepth(Out))
+		{
+			//Blended in float from HalfTable (or the 8-bit channels) into 16 bit RGBA rows so the filter doesn't quantize to 8 bits
+			if (IsYUV(Out)) YUVKernel = g_ProcessKernels.ToYUV[3][Layout], SetYUVMatrix(ColorSpace, 65535.0f, false, Bits);
+			else RGB16Kernel = g_ProcessKernels.ToRGB16[3][Out == OUTPUT_ARGB64];
+			if (In == INPUT_RGBA8)      BandKernel = &ResizeFilterFloat<ProcessFormatRGBA8,  0>;
+			else if (In == INPUT_BGRA8) BandKernel = &ResizeFilterFloat<ProcessFormatBGRA8,  4>;
+			else                        BandKernel = &ResizeFilterFloat<ProcessFormatRGBA16, 2>;
+			RowKernel = NULL, NeedsRGBA16Table = false, NeedsHalfTable = Half;
+		}
+		else
+		{
+			if (IsYUV(Out)) YUVKernel = g_ProcessKernels.ToYUV[0][Layout], SetYUVMatrix(ColorSpace, 255.0f, true, Bits);
+			else RGB16Kernel = g_ProcessKernels.ToRGB16[4][Out == OUTPUT_ARGB64];
+			if (In == INPUT_RGBA8)      BandKernel = SelectKernel<ProcessFormatRGBA8,  ProcessFormatBGRA8>(Mirror, Resize);
+			else if (In == INPUT_BGRA8) BandKernel = SelectKernel<ProcessFormatBGRA8,  ProcessFormatBGRA8>(Mirror, Resize);
+			else                        BandKernel = SelectKernel<ProcessFormatRGBA16, ProcessFormatBGRA8>(Mirror, Resize);
+		}
+		switch (Out)
+		{
+			case OUTPUT_NV12:  Kernel = &ConvertBand<OUTPUT_NV12>;  break;
+			case OUTPUT_YUY2:  Kernel = &ConvertBand<OUTPUT_YUY2>;  break;
+			case OUTPUT_I420:  Kernel = &ConvertBand<OUTPUT_I420>;  break;
+			case OUTPUT_P010:  Kernel = &ConvertBand<OUTPUT_P010>;  break;
+			case OUTPUT_RGB48: Kernel = &ConvertBand<OUTPUT_RGB48>; break;
+			default:           Kernel = &ConvertBand<OUTPUT_ARGB64>;
+		}
+	}
+
+	inline void Execute() const
+	{
+		UCASSERT(RowEnd >= RowStart);
+		if (!DirtyRows) { if (RowStart != RowEnd) Kernel(*this); return; }
+
+		//Runs of marked rows get passed to the kernel as jobs of their own
+		ProcessJob Run = *this;
+		Run.DirtyRows = NULL;
+		for (size_t r = RowStart; r != RowEnd;)
+		{
+			if (!(DirtyRows[r >> 3] & (1 << (r & 7)))) { r++; continue; }
+			for (Run.RowStart = r; r != RowEnd && (DirtyRows[r >> 3] & (1 << (r & 7))); r++) {}
+			Run.RowEnd = r;
+			Kernel(Run);
+		}
+	}
+
+private:
+	template <class In, class Out> static ProcessJobFunc SelectKernel(bool Mirror, EResize Resize)
+	{
+		if (Resize == RESIZE_NEAREST) return &ResizeNearest<In, Out>;
+		if (Resize == RESIZE_FILTER)  return &ResizeFilter<In, Out>;
+		return (Mirror ? &Convert<In, Out, true> : &Convert<In, Out, false>);
+	}
+
+	enum ESample { SAMPLE_SOURCE, SAMPLE_MIRROR, SAMPLE_NEAREST };
+
+	template <class In> static ProcessJobFunc SelectDirectKernel(EOutput Out, bool Mirror, EResize Resize)
+	{
+		const ESample Sample = (Resize == RESIZE_NEAREST ? SAMPLE_NEAREST : (Mirror ? SAMPLE_MIRROR : SAMPLE_SOURCE));
+		switch (Out)
+		{
+			case OUTPUT_NV12:  return SelectDirectKernel<In, OUTPUT_NV12>(Sample);
+			case OUTPUT_YUY2:  return SelectDirectKernel<In, OUTPUT_YUY2>(Sample);
+			case OUTPUT_I420:  return SelectDirectKernel<In, OUTPUT_I420>(Sample);
+			case OUTPUT_P010:  return SelectDirectKernel<In, OUTPUT_P010>(Sample);
+			case OUTPUT_RGB48: return SelectDirectKernel<In, OUTPUT_RGB48>(Sample);
+			default:           return SelectDirectKernel<In, OUTPUT_ARGB64>(Sample);
+		}
+	}
+
+	template <class In, int OUT> static ProcessJobFunc SelectDirectKernel(ESample Sample)
+	{
+		if (Sample == SAMPLE_NEAREST) return &ConvertDirect<In, OUT, SAMPLE_NEAREST>;
+		if (Sample == SAMPLE_MIRROR)  return &ConvertDirect<In, OUT, SAMPLE_MIRROR>;
+		return &ConvertDirect<In, OUT, SAMPLE_SOURCE>;
+	}
+
+	//BT.601 or BT.709 luma weights, limited range scales Y to [16, 235] and chroma to [16, 240] (times 4 with 10 bits), InScale is the input value for white
+	void SetYUVMatrix(EColorSpace ColorSpace, float InScale, bool SwapRB, int Bits)
+	{
+		const bool BT709 = (ColorSpace == COLORSPACE_BT709_LIMITED || ColorSpace == COLORSPACE_BT709_FULL);
+		const bool Full = (ColorSpace == COLORSPACE_BT601_FULL || ColorSpace == COLORSPACE_BT709_FULL);
+		const double Kr = (BT709 ? 0.2126 : 0.299), Kb = (BT709 ? 0.0722 : 0.114), Kg = 1.0 - Kr - Kb, Limited = (double)(1 << (Bits - 8));
+		const double Ys = (Full ? (1 << Bits) - 1.0 : 219.0 * Limited) / InScale, Cs = (Full ? (1 << Bits) - 1.0 : 224.0 * Limited) / InScale;
+		const double Y[4] = { Kr * Ys, Kg * Ys, Kb * Ys, (Full ? 0.0 : 16.0 * Limited) };
+		const double U[4] = { -Kr / (2.0 - 2.0 * Kb) * Cs, -Kg / (2.0 - 2.0 * Kb) * Cs, 0.5 * Cs, (double)(1 << (Bits - 1)) };
+		const double V[4] = { 0.5 * Cs, -Kg / (2.0 - 2.0 * Kr) * Cs, -Kb / (2.0 - 2.0 * Kr) * Cs, (double)(1 << (Bits - 1)) };
+		for (int i = 0, j; i != 4; i++)
+		{
+			j = (SwapRB && i != 3 ? 2 - i : i);
+			YUV.Y[j] = (float)Y[i], YUV.U[j] = (float)U[i], YUV.V[j] = (float)V[i];
+		}
+	}
+
+	template <class In, class Out> static inline void ConvertSpan(const ProcessJob& j, const void* pSrc, void* pDst, size_t n)
+	{
+		if (j.RowKernel) { j.RowKernel(pSrc, pDst, n); return; }
+
+		//Scalar path used when there is no vectorized kernel for the CPU (BGR8 is without alpha, its value is undefined then)
+		const typename In::Pixel* src = (const typename In::Pixel*)pSrc;
+		const uint8_t* Table = j.RGBA16Table;
+		uint8_t* dst = (uint8_t*)pDst;
+		for (; n > 4; n -= 4, src += 4, dst += 4 * Out::BPP)
+		{
+			Out::Store(dst              , In::template ToBGRA8<Out::ALPHA != 0>(src    , Table));
+			Out::Store(dst + Out::BPP    , In::template ToBGRA8<Out::ALPHA != 0>(src + 1, Table));
+			Out::Store(dst + Out::BPP * 2, In::template ToBGRA8<Out::ALPHA != 0>(src + 2, Table));
+			Out::Store(dst + Out::BPP * 3, In::template ToBGRA8<Out::ALPHA != 0>(src + 3, Table));
+		}
+		for (; n > 1; n--, src++, dst += Out::BPP) Out::Store(dst, In::template ToBGRA8<Out::ALPHA != 0>(src, Table));
+		if (n) Out::StoreLast(dst, In::template ToBGRA8<Out::ALPHA != 0>(src, Table));
+	}
+
+	template <class In, class Out, bool MIRROR> static void Convert(const ProcessJob& j)
+	{
+		const size_t w = j.Width;
+		const uint8_t *src = (const uint8_t*)j.BufIn + (j.RowStart * j.RGBAInStride * In::BPP);
+		uint8_t *dst = (uint8_t*)j.BufOut + (j.RowStart * w * Out::BPP);
+		if (!MIRROR && j.RGBAInStride == w) { ConvertSpan<In, Out>(j, src, dst, (j.RowEnd - j.RowStart) * w); return; } //without row gaps all rows can be converted in one go
+
+		typename In::Pixel Samples[MIRROR ? SAMPLECHUNK : 1];
+		for (size_t y = j.RowStart; y != j.RowEnd; y++, src += j.RGBAInStride * In::BPP)
+		{
+			if (!MIRROR) { ConvertSpan<In, Out>(j, src, dst, w); dst += w * Out::BPP; continue; }
+
+			//Reads the source row back to front into a small buffer and converts that, so the row gets written already flipped
+			const typename In::Pixel* srcLast = (const typename In::Pixel*)src + (w - 1);
+			for (size_t x = 0, n; x != w; x += n, dst += n * Out::BPP)
+			{
+				n = (w - x < SAMPLECHUNK ? w - x : SAMPLECHUNK);
+				for (size_t i = 0; i != n; i++) Samples[i] = *(srcLast - x - i);
+				ConvertSpan<In, Out>(j, Samples, dst, n);
+			}
+		}
+	}
+
+	template <class In, class Out> static void ResizeNearest(const ProcessJob& j)
+	{
+		//Gathers the source pixels picked by the resize map straight from the RGBA source and converts only those
+		const ProcessResizeMap& Map = *j.ResizeMap;
+		const size_t w = j.Width;
+		UCASSERT(Map.ToWidth == w);
+
+		typename In::Pixel Samples[SAMPLECHUNK];
+		uint8_t *dst = (uint8_t*)j.BufOut + (j.RowStart * w * Out::BPP);
+		for (size_t y = j.RowStart; y != j.RowEnd; y++)
+		{
+			if (y < Map.Rows.Start || y >= Map.Rows.End) { memset(dst, 0, w * Out::BPP); dst += w * Out::BPP; continue; }
+			const typename In::Pixel *srcRow = (const typename In::Pixel*)j.BufIn + ((Map.Rows.SpanStart + Map.Rows.Index[y]) * j.RGBAInStride + Map.Cols.SpanStart);
+			memset(dst, 0, Map.Cols.Start * Out::BPP);
+			dst += Map.Cols.Start * Out::BPP;
+			for (size_t x = Map.Cols.Start, n; x != Map.Cols.End; x += n, dst += n * Out::BPP)
+			{
+				n = (Map.Cols.End - x < SAMPLECHUNK ? Map.Cols.End - x : SAMPLECHUNK);
+				const uint32_t *Cols = Map.Cols.Index + x;
+				for (size_t i = 0; i != n; i++) Samples[i] = srcRow[Cols[i]];
+				ConvertSpan<In, Out>(j, Samples, dst, n);
+			}
+			memset(dst, 0, (w - Map.Cols.End) * Out::BPP);
+			dst += (w - Map.Cols.End) * Out::BPP;
+		}
+		UCASSERT(dst == (uint8_t*)j.BufOut + (j.RowEnd * w * Out::BPP));
+	}
+
+	//Writes n pixels starting at column x of job row r from source rows src0 and src1 (only used by the YUV outputs which get pairs of rows)
+	template <int OUT> static inline void WriteDirect(const ProcessJob& j, size_t r, const void* src0, const void* src1, size_t x, size_t n)
+	{
+		const size_t w = j.Width, h = j.Height;
+		uint8_t *Out = (uint8_t*)j.BufOut, *Chroma = Out + w * h * (OUT == OUTPUT_P010 ? 2 : 1);
+		if (OUT == OUTPUT_NV12)   j.YUVKernel(src0, src1, n, &j.YUV, j.HalfTable, Out + r * 2 * w + x, Out + (r * 2 + 1) * w + x, Chroma + r * w + x, NULL);
+		if (OUT == OUTPUT_YUY2)   j.YUVKernel(src0, src1, n, &j.YUV, j.HalfTable, Out + (r * 2 * w + x) * 2, Out + ((r * 2 + 1) * w + x) * 2, NULL, NULL);
+		if (OUT == OUTPUT_I420)   j.YUVKernel(src0, src1, n, &j.YUV, j.HalfTable, Out + r * 2 * w + x, Out + (r * 2 + 1) * w + x, Chroma + r * (w / 2) + x / 2, Chroma + (w / 2) * (h / 2) + r * (w / 2) + x / 2);
+		if (OUT == OUTPUT_P010)   j.YUVKernel(src0, src1, n, &j.YUV, j.HalfTable, Out + (r * 2 * w + x) * 2, Out + ((r * 2 + 1) * w + x) * 2, Chroma + (r * w + x) * 2, NULL);
+		if (OUT == OUTPUT_RGB48)  j.RGB16Kernel(src0, Out + (r * w + x) * 6, n, j.HalfTable);
+		if (OUT == OUTPUT_ARGB64) j.RGB16Kernel(src0, Out + (r * w + x) * 8, n, j.HalfTable);
+	}
+
+	//Gathers n source pixels for column x onwards of the mirrored or nearest resized (bottom-up) row y, outside of the resized image
+	//they are zero which is black in all input formats
+	template <class In, int SAMPLE> static inline void SampleRow(const ProcessJob& j, size_t y, size_t x, size_t n, typename In::Pixel* Samples)
+	{
+		if (SAMPLE == SAMPLE_MIRROR)
+		{
+			const typename In::Pixel* srcLast = (const typename In::Pixel*)j.BufIn + (y * j.RGBAInStride + j.Width - 1 - x);
+			for (size_t i = 0; i != n; i++) Samples[i] = *(srcLast - i);
+			return;
+		}
+		const ProcessResizeMap& Map = *j.ResizeMap;
+		if (y < Map.Rows.Start || y >= Map.Rows.End) { memset(Samples, 0, n * sizeof(Samples[0])); return; }
+		const typename In::Pixel *srcRow = (const typename In::Pixel*)j.BufIn + ((Map.Rows.SpanStart + Map.Rows.Index[y]) * j.RGBAInStride + Map.Cols.SpanStart);
+		for (size_t i = 0, c = x; i != n; i++, c++) Samples[i] = (c >= Map.Cols.Start && c < Map.Cols.End ? srcRow[Map.Cols.Index[c]] : 0);
+	}
+
+	template <class In, int OUT, int SAMPLE> static void ConvertDirect(const ProcessJob& j)
+	{
+		//The source is bottom-up like the RGB outputs while these outputs are top-down, so output row y reads source row Height - 1 - y
+		enum { ROWS = (OUT <= OUTPUT_P010 ? 2 : 1), CHUNK = (SAMPLE == SAMPLE_SOURCE ? 1 : SAMPLECHUNK) };
+		const size_t w = j.Width, h = j.Height, Pitch = j.RGBAInStride * In::BPP;
+		typename In::Pixel Samples[ROWS][CHUNK];
+		for (size_t r = j.RowStart; r != j.RowEnd; r++)
+		{
+			const size_t y0 = h - 1 - r * ROWS, y1 = y0 - (ROWS - 1);
+			if (SAMPLE == SAMPLE_SOURCE) { WriteDirect<OUT>(j, r, (const uint8_t*)j.BufIn + y0 * Pitch, (const uint8_t*)j.BufIn + y1 * Pitch, 0, w); continue; }
+			for (size_t x = 0, n; x != w; x += n)
+			{
+				n = (w - x < CHUNK ? w - x : CHUNK);
+				SampleRow<In, SAMPLE>(j, y0, x, n, Samples[0]);
+				if (ROWS == 2) SampleRow<In, SAMPLE>(j, y1, x, n, Samples[ROWS - 1]);
+				WriteDirect<OUT>(j, r, Samples[0], Samples[ROWS - 1], x, n);
+			}
+		}
+	}
+
+	template <int OUT> static void ConvertBand(const ProcessJob& j)
+	{
+		//The bottom-up source rows of a band of job rows get converted to BGRA8 (or 16 bit RGBA) rows at the same place in Scratch first
+		//which keeps the ring of ResizeFilter useful over the band while the rows are still in the cache for the second pass
+		enum { ROWS = (OUT <= OUTPUT_P010 ? 2 : 1), BPP = (OUT >= OUTPUT_P010 ? 8 : 4) };
+		const size_t w = j.Width, h = j.Height;
+		for (size_t r = j.RowStart, BandEnd; r != j.RowEnd; r = BandEnd)
+		{
+			BandEnd = (j.RowEnd - r < BANDROWS / ROWS ? j.RowEnd : r + BANDROWS / ROWS);
+			ProcessJob Band = j;
+			Band.Kernel = j.BandKernel, Band.BufOut = j.Scratch, Band.RowStart = h - BandEnd * ROWS, Band.RowEnd = h - r * ROWS;
+			Band.Execute();
+			for (size_t p = r; p != BandEnd; p++)
+			{
+				const uint8_t* src0 = (const uint8_t*)j.Scratch + (h - 1 - p * ROWS) * w * BPP;
+				WriteDirect<OUT>(j, p, src0, src0 - (ROWS - 1) * w * BPP, 0, w);
+			}
+		}
+	}
+
+	template <class In, class Out> static void ResizeFilter(const ProcessJob& j)
+	{
+		//Separable filter: The source rows picked by the vertical taps get converted to BGRA8 (kept in a small ring because
+		//neighboring output rows share them), blended vertically into a 9.7 fixed point row and then blended horizontally
+		//The ring lives in the memory of the executing thread (see FilterMem) and starts out empty with every chunk of rows
+		const ProcessResizeMap& Map = *j.ResizeMap;
+		const size_t w = j.Width, Taps = Map.Rows.Taps;
+		const size_t SpanWidth = Map.Cols.SpanEnd - Map.Cols.SpanStart, RowPixels = SpanWidth + Map.Cols.Taps; //padded for horizontal taps reading past the span
+		UCASSERT(Map.ToWidth == w && Map.Cols.Weights && (Taps & 1) == 0 && j.FilterMem);
+
+		uint8_t *Ring = j.FilterMem + j.Worker * FilterMemSize(Map, OUTPUT_BGRA8);
+		int16_t *BlendRow = (int16_t*)(Ring + Taps * RowPixels * 4);
+		size_t *RingRows = (size_t*)(BlendRow + RowPixels * 4);
+		const uint8_t **TapRows = (const uint8_t**)(RingRows + Taps);
+		memset(BlendRow + SpanWidth * 4, 0, Map.Cols.Taps * 4 * sizeof(int16_t)); //padding only read by taps with zero weight
+		for (size_t t = 0; t != Taps; t++) RingRows[t] = (size_t)-1;
+
+		uint8_t *dst = (uint8_t*)j.BufOut + (j.RowStart * w * Out::BPP);
+		for (size_t y = j.RowStart; y != j.RowEnd; y++, dst += w * Out::BPP)
+		{
+			if (y < Map.Rows.Start || y >= Map.Rows.End) { memset(dst, 0, w * Out::BPP); continue; }
+			for (size_t t = 0, sy = Map.Rows.SpanStart + Map.Rows.Index[y]; t != Taps; t++, sy++)
+			{
+				const size_t Row = (sy < Map.FromHeight ? sy : Map.FromHeight - 1); //only taps with zero weight reach past the bottom
+				uint8_t *Slot = Ring + (Row % Taps) * RowPixels * 4;
+				if (RingRows[Row % Taps] != Row)
+				{
+					ConvertSpan<In, ProcessFormatBGRA8>(j, (const uint8_t*)j.BufIn + ((Row * j.RGBAInStride + Map.Cols.SpanStart) * In::BPP), Slot, SpanWidth);
+					RingRows[Row % Taps] = Row;
+				}
+				TapRows[t] = Slot;
+			}
+			g_ProcessKernels.FilterV(TapRows, Map.Rows.Weights + y * Taps, Taps, BlendRow, SpanWidth * 4);
+
+			memset(dst, 0, Map.Cols.Start * Out::BPP);
+			g_ProcessKernels.FilterH(BlendRow, Map.Cols.Index + Map.Cols.Start, Map.Cols.Weights + Map.Cols.Start * Map.Cols.Taps, Map.Cols.Taps, dst + Map.Cols.Start * Out::BPP, Map.Cols.End - Map.Cols.Start, Out::BPP);
+			memset(dst + Map.Cols.End * Out::BPP, 0, (w - Map.Cols.End) * Out::BPP);
+		}
+	}
+
+	template <class In, int INPUT> static void ResizeFilterFloat(const ProcessJob& j)
+	{
+		//ResizeFilter for the outputs with more than 8 bits per channel, the source rows get read as floats (see ProcessKernels::LoadRGBA_Scalar)
+		//and the blended rows get written as 16 bit RGBA, 8-bit channels scaled by 257 like the unresized conversion
+		const ProcessResizeMap& Map = *j.ResizeMap;
+		const size_t w = j.Width, Taps = Map.Rows.Taps;
+		const size_t SpanWidth = Map.Cols.SpanEnd - Map.Cols.SpanStart, RowPixels = SpanWidth + Map.Cols.Taps;
+		const float Scale = (INPUT == 0 || INPUT == 4 ? 257.0f : 65535.0f);
+		UCASSERT(Map.ToWidth == w && Map.Cols.Weights && (Taps & 1) == 0 && j.FilterMem);
+
+		float *Ring = (float*)(j.FilterMem + j.Worker * FilterMemSize(Map, OUTPUT_ARGB64));
+		float *BlendRow = Ring + Taps * RowPixels * 4;
+		size_t *RingRows = (size_t*)(BlendRow + RowPixels * 4);
+		const float **TapRows = (const float**)(RingRows + Taps);
+		memset(BlendRow + SpanWidth * 4, 0, Map.Cols.Taps * 4 * sizeof(float));
+		for (size_t t = 0; t != Taps; t++) RingRows[t] = (size_t)-1;
+
+		uint16_t *dst = (uint16_t*)j.BufOut + (j.RowStart * w * 4);
+		for (size_t y = j.RowStart; y != j.RowEnd; y++, dst += w * 4)
+		{
+			if (y < Map.Rows.Start || y >= Map.Rows.End) { memset(dst, 0, w * 8); continue; }
+			for (size_t t = 0, sy = Map.Rows.SpanStart + Map.Rows.Index[y]; t != Taps; t++, sy++)
+			{
+				const size_t Row = (sy < Map.FromHeight ? sy : Map.FromHeight - 1);
+				float *Slot = Ring + (Row % Taps) * RowPixels * 4;
+				if (RingRows[Row % Taps] != Row)
+				{
+					ProcessKernels::ToFloatRow_Scalar<INPUT>((const uint8_t*)j.BufIn + ((Row * j.RGBAInStride + Map.Cols.SpanStart) * In::BPP), Slot, SpanWidth, j.HalfTable);
+					RingRows[Row % Taps] = Row;
+				}
+				TapRows[t] = Slot;
+			}
+			g_ProcessKernels.FilterVFloat(TapRows, Map.Rows.Weights + y * Taps, Taps, BlendRow, SpanWidth * 4);
+
+			memset(dst, 0, Map.Cols.Start * 8);
+			g_ProcessKernels.FilterHFloat(BlendRow, Map.Cols.Index + Map.Cols.Start, Map.Cols.Weights + Map.Cols.Start * Map.Cols.Taps, Map.Cols.Taps, Scale, dst + Map.Cols.Start * 4, Map.Cols.End - Map.Cols.Start);
+			memset(dst + Map.Cols.End * 4, 0, (w - Map.Cols.End) * 8);
+		}
+	}
+};
+
+//Lookup tables, resize map and scratch memory for the conversion of whole frames which are kept and only rebuilt on changes
+//Used by the capture filter and by the Unity plugin (when a receiver requests converted frames) so both set up the same jobs
+struct ProcessFrame
+{
+	ProcessFrame() : RGBA16Table(NULL), HalfTable(NULL), Scratch(NULL), ScratchSize(0), FilterMem(NULL), FilterMemSize(0), RowMask(NULL), RowMaskSize(0), JobInHeight(0), JobOutHeight(0), JobTopDownRows(0), JobResized(false) {}
+	~ProcessFrame() { free(RGBA16Table); free(HalfTable); free(Scratch); free(FilterMem); free(RowMask); }
+
+	//Sets up a job converting a whole source frame (rows InStride pixels apart) into the output, resized if the sizes differ
+	//Threads is the number of threads that can execute the job (see ProcessWorkers::GetThreadCount)
+	//Returns false if there is not enough memory for the tables, the scratch frame or the memory of the filter resize
+	bool SetupJob(ProcessJob& Job, ProcessJob::EInput In, const void* BufIn, int InWidth, int InHeight, int InStride, ProcessJob::EOutput Out, void* BufOut, int OutWidth, int OutHeight,
+		bool Mirror, ProcessResizeMap::EFilter Filter, ProcessJob::EColorSpace ColorSpace, ProcessToneMap ToneMap, size_t Threads = 1)
+	{
+		const bool NeedResize = (InWidth != OutWidth || InHeight != OutHeight);
+		if (In != ProcessJob::INPUT_RGBA16_GAMMA && In != ProcessJob::INPUT_RGBA16_LINEAR) ToneMap = ProcessToneMap();
+		Job.Setup(In, Out, Mirror, (!NeedResize ? ProcessJob::RESIZE_NONE : (Filter == ProcessResizeMap::FILTER_NEAREST ? ProcessJob::RESIZE_NEAREST : ProcessJob::RESIZE_FILTER)), ColorSpace, !ToneMap.IsOff());
+
+		//Build the tables that map 16 bit float values (either linear SRGB or gamma RGB) to 8 bit or float color values with the tone mapping
+		const bool Linear = (In == ProcessJob::INPUT_RGBA16_LINEAR);
+		if (Job.NeedsRGBA16Table && (!RGBA16Table || RGBA16TableInput != In || RGBA16TableToneMap != ToneMap))
+		{
+			if (!RGBA16Table && !(RGBA16Table = (uint8_t*)malloc(ProcessToneMap::RGBA16TABLESIZE))) return false;
+			ToneMap.BuildRGBA16Table(RGBA16Table, Linear);
+			RGBA16TableInput = In, RGBA16TableToneMap = ToneMap;
+		}
+		if (Job.NeedsHalfTable && (!HalfTable || HalfTableInput != In || HalfTableToneMap != ToneMap))
+		{
+			if (!HalfTable && !(HalfTable = (float*)malloc(ProcessToneMap::HALFTABLESIZE * sizeof(float)))) return false;
+			ToneMap.BuildHalfTable(HalfTable, Linear);
+			HalfTableInput = In, HalfTableToneMap = ToneMap;
+		}
+
+		//Conversion of the RGBA source to the output format while also eliminating possible row gaps (when stride != width)
+		Job.BufIn = BufIn, Job.BufOut = BufOut;
+		Job.Width = InWidth, Job.RowStart = 0, Job.RowEnd = InHeight, Job.RGBAInStride = InStride;
+		Job.RGBA16Table = RGBA16Table, Job.HalfTable = HalfTable;
+		if (NeedResize)
+		{
+			//Image scaling which converts only the needed source pixels
+			ResizeMap.Update(InWidth, InHeight, OutWidth, OutHeight, Filter, Mirror);
+			Job.Width = OutWidth, Job.RowEnd = OutHeight, Job.ResizeMap = &ResizeMap;
+			if (Filter != ProcessResizeMap::FILTER_NEAREST && !(Job.FilterMem = GetFilterMem((Threads ? Threads : 1) * ProcessJob::FilterMemSize(ResizeMap, Out)))) return false;
+		}
+		if (ProcessJob::IsTopDown(Out))
+		{
+			//YUV jobs work on pairs of rows, the filter resize goes through BGRA8 or 16 bit RGBA rows in the scratch frame
+			Job.Height = OutHeight, Job.RowEnd = OutHeight / (ProcessJob::IsYUV(Out) ? 2 : 1);
+			Job.Scratch = (Job.BandKernel ? GetScratch((size_t)OutWidth * OutHeight * (ProcessJob::IsHighBitDepth(Out) ? 8 : 4)) : NULL);
+			if (Job.BandKernel && !Job.Scratch) return false;
+		}
+		JobInHeight = InHeight, JobOutHeight = OutHeight, JobResized = NeedResize;
+		JobTopDownRows = (!ProcessJob::IsTopDown(Out) ? 0 : (ProcessJob::IsYUV(Out) ? 2 : 1));
+		return true;
+	}
+
+	//Limits the job last set up by SetupJob to the job rows that read changed source rows, for updating an output that holds the
+	//previous frame. Changed is a bit mask with TilesPerBand bits for every band of BandRows source rows (in the order of the source
+	//rows in memory), a band counts as changed if any of its bits is set. Returns false if there is not enough memory for the row mask.
+	bool SetChangedRows(ProcessJob& Job, const uint8_t* Changed, size_t TilesPerBand, size_t BandRows)
+	{
+		const size_t Bands = (JobInHeight + BandRows - 1) / BandRows, Rows = Job.RowEnd, RowsPerJobRow = (JobTopDownRows ? JobTopDownRows : 1);
+		if (RowMaskSize < Bands + (Rows + 7) / 8)
+		{
+			free(RowMask);
+			RowMaskSize = ((RowMask = (uint8_t*)malloc(Bands + (Rows + 7) / 8)) ? Bands + (Rows + 7) / 8 : 0);
+			if (!RowMask) return false;
+		}
+		uint8_t *BandChanged = RowMask, *JobRows = RowMask + Bands;
+		for (size_t b = 0, t = 0; b != Bands; b++)
+		{
+			BandChanged[b] = 0;
+			for (size_t tEnd = t + TilesPerBand; t != tEnd; t++) BandChanged[b] |= (uint8_t)(Changed[t >> 3] & (1 << (t & 7)));
+		}
+
+		//Top-down jobs count rows from the top, resized rows blend Taps source rows from their index on (the letterbox never changes)
+		memset(JobRows, 0, (Rows + 7) / 8);
+		for (size_t r = 0; r != Rows; r++)
+			for (size_t k = 0; k != RowsPerJobRow; k++)
+			{
+				const size_t y = (JobTopDownRows ? JobOutHeight - 1 - r * JobTopDownRows - k : r);
+				size_t s0 = y, s1 = y;
+				if (JobResized)
+				{
+					if (y < ResizeMap.Rows.Start || y >= ResizeMap.Rows.End) continue;
+					s0 = ResizeMap.Rows.SpanStart + ResizeMap.Rows.Index[y], s1 = s0 + ResizeMap.Rows.Taps - 1;
+					if (s1 >= JobInHeight) s1 = JobInHeight - 1;
+				}
+				size_t b = s0 / BandRows;
+				while (b <= s1 / BandRows && !BandChanged[b]) b++;
+				if (b <= s1 / BandRows) { JobRows[r >> 3] |= (uint8_t)(1 << (r & 7)); break; }
+			}
+		Job.DirtyRows = JobRows;
+		return true;
+	}
+
+	//Frame sized buffer for the filter resize into top-down outputs (also used by the capture filter to draw its error patterns)
+	uint8_t* GetScratch(size_t Size)
+	{
+		if (ScratchSize < Size) { free(Scratch); Scratch = (uint8_t*)malloc(Size); ScratchSize = (Scratch ? Size : 0); }
+		return Scratch;
+	}
+
+private:
+	//Memory of the filter resize for all threads, grows with the largest resize set up so far
+	uint8_t* GetFilterMem(size_t Size)
+	{
+		if (FilterMemSize < Size) { free(FilterMem); FilterMem = (uint8_t*)malloc(Size); FilterMemSize = (FilterMem ? Size : 0); }
+		return FilterMem;
+	}
+
+	ProcessResizeMap ResizeMap;
+	uint8_t* RGBA16Table;
+	float* HalfTable;
+	ProcessJob::EInput RGBA16TableInput, HalfTableInput;
+	ProcessToneMap RGBA16TableToneMap, HalfTableToneMap;
+	uint8_t* Scratch;
+	size_t ScratchSize;
+	uint8_t* FilterMem;
+	size_t FilterMemSize;
+	uint8_t* RowMask; //changed bands and job rows for SetChangedRows
+	size_t RowMaskSize;
+	size_t JobInHeight, JobOutHeight, JobTopDownRows; //rows of the job last set up, JobTopDownRows is 0 for bottom-up outputs and 1 or 2 output rows per job row otherwise
+	bool JobResized;
+
+	ProcessFrame(const ProcessFrame&);
+	ProcessFrame& operator=(const ProcessFrame&);
+};
@@ -0,0 +1,93 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Queue of GPU to CPU copies of rendered frames, each frame gets copied into a staging texture of its own and is read once the GPU
+//finished the copy, so the render thread only waits for the GPU when 'Depth' copies are in flight. A depth of 1 reads every frame
+//right after copying it (no added latency), a depth of N delays frames by up to N-1 frames to never wait if the GPU keeps up.
+//The graphics API is behind the Device class which is used like this:
+//  typedef ... Texture, Source, Desc;                      staging texture, texture to copy from and its description (plain struct)
+//  Texture* Create(const Desc& SourceDesc);                staging texture for copies of a source with that description, NULL on failure
+//  void Release(Texture* t);
+//  void Copy(Texture* t, Source Src);                      queues the copy on the GPU
+//  EReadbackMap Map(Texture* t, bool Wait, const void*& Data, int& RowPitch);  returns READBACKMAP_BUSY without Wait while the copy runs
+//  void Unmap(Texture* t);
+
+#include <string.h>
+
+enum EReadbackMap { READBACKMAP_OK, READBACKMAP_BUSY, READBACKMAP_FAILED };
+
+template <class Device, class Info> struct ReadbackQueue
+{
+	enum { MAXDEPTH = 4 };
+	Device Dev;
+
+	ReadbackQueue() : m_First(0), m_Count(0), m_FreeCount(0), m_HasDesc(false) {}
+	~ReadbackQueue() { Reset(); }
+
+	//Queues a copy of the source, with Frame passed along to Deliver(const Info& Frame, const void* Data, int RowPitch) once it can be
+	//read. Finished frames get delivered oldest first, a change of the source description drops the frames still in flight.
+	//Returns READBACKMAP_FAILED if a staging texture couldn't be created or mapped (that frame is dropped), READBACKMAP_OK otherwise.
+	template <class DeliverFunc> EReadbackMap Push(typename Device::Source Src, const typename Device::Desc& SrcDesc, int Depth, const Info& Frame, DeliverFunc& Deliver)
+	{
+		if (Depth < 1) Depth = 1;
+		if (Depth > MAXDEPTH) Depth = MAXDEPTH;
+		if (!m_HasDesc || memcmp(&m_Desc, &SrcDesc, sizeof(SrcDesc))) { Reset(); m_Desc = SrcDesc, m_HasDesc = true; }
+
+		//Deliver what the GPU has finished without waiting, then wait only if there is no room for another copy
+		EReadbackMap Res = READBACKMAP_OK, Finished;
+		while (m_Count && (Finished = FinishOldest(false, Deliver)) != READBACKMAP_BUSY) if (Finished == READBACKMAP_FAILED) Res = Finished;
+		while (m_Count >= Depth) if (FinishOldest(true, Deliver) == READBACKMAP_FAILED) Res = READBACKMAP_FAILED;
+		while (m_FreeCount && m_Count + m_FreeCount > Depth) Dev.Release(m_Free[--m_FreeCount]); //after lowering the depth
+
+		typename Device::Texture* t = (m_FreeCount ? m_Free[--m_FreeCount] : Dev.Create(m_Desc));
+		if (!t) return READBACKMAP_FAILED;
+		Dev.Copy(t, Src);
+		Entry& e = m_Pending[(m_First + m_Count++) % MAXDEPTH];
+		e.Tex = t, e.Frame = Frame;
+
+		//Keep at most Depth-1 copies in flight, with a depth of 1 the new frame is read right away
+		while (m_Count > Depth - 1) if (FinishOldest(true, Deliver) == READBACKMAP_FAILED) Res = READBACKMAP_FAILED;
+		return Res;
+	}
+
+	//Number of copies in flight
+	int GetQueued() const { return m_Count; }
+
+	//Drops the frames in flight and releases all staging textures
+	void Reset()
+	{
+		for (; m_Count; m_Count--, m_First = (m_First + 1) % MAXDEPTH) Dev.Release(m_Pending[m_First].Tex);
+		while (m_FreeCount) Dev.Release(m_Free[--m_FreeCount]);
+		m_First = 0, m_HasDesc = false;
+	}
+
+private:
+	struct Entry { typename Device::Texture* Tex; Info Frame; };
+	Entry m_Pending[MAXDEPTH]; //ring of the copies in flight, oldest at m_First
+	typename Device::Texture* m_Free[MAXDEPTH]; //staging textures not in use
+	int m_First, m_Count, m_FreeCount;
+	typename Device::Desc m_Desc;
+	bool m_HasDesc;
+
+	template <class DeliverFunc> EReadbackMap FinishOldest(bool Wait, DeliverFunc& Deliver)
+	{
+		Entry& e = m_Pending[m_First];
+		const void* Data;
+		int RowPitch;
+		const EReadbackMap Res = Dev.Map(e.Tex, Wait, Data, RowPitch);
+		if (Res == READBACKMAP_BUSY) return Res;
+		if (Res == READBACKMAP_OK) { Deliver(e.Frame, Data, RowPitch); Dev.Unmap(e.Tex); }
+		m_Free[m_FreeCount++] = e.Tex;
+		m_First = (m_First + 1) % MAXDEPTH, m_Count--;
+		return Res;
+	}
+
+	ReadbackQueue(const ReadbackQueue&);
+	ReadbackQueue& operator=(const ReadbackQueue&);
+};
@@ -7,13 +7,17 @@
   Copyright (c) 2016 MHD Yamen Saraiji
 */
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SHARED_IMAGE_SIZE (8192 * 8192 * 4 * sizeof(short)) //largest frame, 8K and 16K wide panoramas (RGBA max 16bit per pixel)
+
+#if defined(_WIN32)
 #define _HAS_EXCEPTIONS 0
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <initguid.h>
-#include <stdint.h>
-
-#define MAX_SHARED_IMAGE_SIZE (3840 * 2160 * 4 * sizeof(short)) //4K (RGBA max 16bit per pixel)
 
 #if _DEBUG
 #define UCASSERT(cond) ((cond) ? ((void)0) : *(volatile int*)0 = 0xbad|(OutputDebugStringA("[FAILED ASSERT] " #cond "\n"),1))
@@ -21,76 +25,483 @@
 #define UCASSERT(cond) ((void)0)
 #endif
 
+//Win32 backend of the shared memory transport (named mutex, named auto-reset events and named file mappings)
+struct SharedImageMemoryBackend
+{
+	enum { EVENT_COUNT = 8 }; //one wake up event per registered reader
+	enum { MAPPING_COUNT = 2 }; //header and frame data
+
+	SharedImageMemoryBackend() : m_hMutex(NULL)
+	{
+		for (int e = 0; e != EVENT_COUNT; e++) m_hEvents[e] = NULL;
+		for (int m = 0; m != MAPPING_COUNT; m++) m_hSharedFiles[m] = NULL, m_pViews[m] = NULL;
+	}
+
+	~SharedImageMemoryBackend()
+	{
+		for (int m = 0; m != MAPPING_COUNT; m++) CloseMapping(m);
+		if (m_hMutex) CloseHandle(m_hMutex);
+		for (int e = 0; e != EVENT_COUNT; e++) if (m_hEvents[e]) CloseHandle(m_hEvents[e]);
+	}
+
+	bool OpenLock(const char* Name, bool Create)
+	{
+		if (!m_hMutex) m_hMutex = (Create ? CreateMutexA(NULL, FALSE, Name) : OpenMutexA(SYNCHRONIZE, FALSE, Name));
+		return (m_hMutex != NULL);
+	}
+
+	void Lock() { WaitForSingleObject(m_hMutex, INFINITE); }
+	void Unlock() { ReleaseMutex(m_hMutex); }
+
+	bool OpenEvent(int e, const char* Name, bool Create)
+	{
+		if (!m_hEvents[e]) m_hEvents[e] = (Create ? CreateEventA(NULL, FALSE, FALSE, Name) : OpenEventA(EVENT_MODIFY_STATE, FALSE, Name));
+		return (m_hEvents[e] != NULL);
+	}
+
+	void SetEvent(int e) { ::SetEvent(m_hEvents[e]); }
+	bool WaitEvent(int e, uint32_t Milliseconds) { return (WaitForSingleObject(m_hEvents[e], Milliseconds) == WAIT_OBJECT_0); }
+
+	//Mapping a view of Size bytes fails if an existing object is smaller
+	void* OpenMapping(int m, const char* Name, size_t Size, bool Create)
+	{
+		if (!m_hSharedFiles[m])
+		{
+			if (Create) m_hSharedFiles[m] = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)Size >> 32), (DWORD)Size, Name);
+			else        m_hSharedFiles[m] = OpenFileMappingA(FILE_MAP_WRITE, FALSE, Name);
+			if (!m_hSharedFiles[m]) return NULL;
+		}
+		if (!m_pViews[m]) m_pViews[m] = MapViewOfFile(m_hSharedFiles[m], FILE_MAP_WRITE, 0, 0, Size);
+		return m_pViews[m];
+	}
+
+	void CloseMapping(int m)
+	{
+		if (m_pViews[m]) UnmapViewOfFile(m_pViews[m]);
+		if (m_hSharedFiles[m]) CloseHandle(m_hSharedFiles[m]);
+		m_hSharedFiles[m] = NULL, m_pViews[m] = NULL;
+	}
+
+	static void RemoveMapping(const char*) {} //named objects are gone once the last process closes them
+
+	static bool CompareExchange64(volatile int64_t* p, int64_t Expected, int64_t Desired) { return InterlockedCompareExchange64((volatile LONG64*)p, Desired, Expected) == Expected; }
+	static uint32_t GetTicks() { return GetTickCount(); }
+	static uint32_t GetProcessId() { return (uint32_t)GetCurrentProcessId(); }
+
+	static bool IsProcessAlive(uint32_t ProcessId)
+	{
+		HANDLE h = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)ProcessId);
+		if (!h) return (GetLastError() == ERROR_ACCESS_DENIED); //exists but belongs to another user
+		bool Alive = (WaitForSingleObject(h, 0) == WAIT_TIMEOUT);
+		CloseHandle(h);
+		return Alive;
+	}
+
+	static int64_t GetTimestamp()
+	{
+		//Monotonic clock in 100 nanosecond units (REFERENCE_TIME) which is the same in all processes
+		static LARGE_INTEGER Frequency;
+		LARGE_INTEGER Counter;
+		if (!Frequency.QuadPart) QueryPerformanceFrequency(&Frequency);
+		QueryPerformanceCounter(&Counter);
+		return (Counter.QuadPart / Frequency.QuadPart) * 10000000 + (Counter.QuadPart % Frequency.QuadPart) * 10000000 / Frequency.QuadPart;
+	}
+
+private:
+	HANDLE m_hMutex;
+	HANDLE m_hEvents[EVENT_COUNT];
+	HANDLE m_hSharedFiles[MAPPING_COUNT];
+	void* m_pViews[MAPPING_COUNT];
+};
+
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#if _DEBUG
+#include <assert.h>
+#define UCASSERT(cond) assert(cond)
+#else
+#define UCASSERT(cond) ((void)0)
+#endif
+
+//POSIX backend of the shared memory transport (shm_open + mmap) for Linux
+//The lock is a flock on a small shared memory object which also holds one futex word per auto-reset event
+//Unlike the Win32 objects these stay around after the last process closes them, a restarted receiver picks them up again
+struct SharedImageMemoryBackend
+{
+	enum { EVENT_COUNT = 8 }; //one wake up event per registered reader
+	enum { MAPPING_COUNT = 2 }; //header and frame data
+
+	SharedImageMemoryBackend() : m_LockFile(-1), m_pEvents(NULL) { for (int m = 0; m != MAPPING_COUNT; m++) m_pViews[m] = NULL, m_ViewSizes[m] = 0; }
+
+	~SharedImageMemoryBackend()
+	{
+		for (int m = 0; m != MAPPING_COUNT; m++) CloseMapping(m);
+		if (m_pEvents) munmap((void*)m_pEvents, sizeof(int32_t) * EVENT_COUNT);
+		if (m_LockFile >= 0) close(m_LockFile);
+	}
+
+	bool OpenLock(const char* Name, bool Create)
+	{
+		if (m_pEvents) return true;
+		int fd = OpenShared(Name, sizeof(int32_t) * EVENT_COUNT, Create, NULL);
+		if (fd < 0) return false;
+		void* p = mmap(NULL, sizeof(int32_t) * EVENT_COUNT, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) { close(fd); return false; }
+		m_LockFile = fd, m_pEvents = (volatile int32_t*)p;
+		return true;
+	}
+
+	void Lock() { while (flock(m_LockFile, LOCK_EX) && errno == EINTR) {} } //released by the OS if the holder dies like an abandoned Win32 mutex
+	void Unlock() { flock(m_LockFile, LOCK_UN); }
+
+	bool OpenEvent(int, const char*, bool) { return (m_pEvents != NULL); } //the event words live in the lock object
+
+	void SetEvent(int e)
+	{
+		if (__atomic_exchange_n(&m_pEvents[e], 1, __ATOMIC_SEQ_CST) == 0) syscall(SYS_futex, &m_pEvents[e], FUTEX_WAKE, 1, NULL, NULL, 0);
+	}
+
+	bool WaitEvent(int e, uint32_t Milliseconds)
+	{
+		for (uint32_t Start = GetTicks(), Waited;;)
+		{
+			if (__atomic_exchange_n(&m_pEvents[e], 0, __ATOMIC_SEQ_CST) == 1) return true;
+			if ((Waited = GetTicks() - Start) >= Milliseconds) return false;
+			struct timespec ts = { (time_t)((Milliseconds - Waited) / 1000), (long)((Milliseconds - Waited) % 1000) * 1000000 };
+			syscall(SYS_futex, &m_pEvents[e], FUTEX_WAIT, 0, &ts, NULL, 0);
+		}
+	}
+
+	void* OpenMapping(int m, const char* Name, size_t Size, bool Create)
+	{
+		if (m_pViews[m]) return m_pViews[m];
+		int fd = OpenShared(Name, Size, Create, &Size);
+		if (fd < 0) return NULL;
+		void* p = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED) return NULL;
+		m_ViewSizes[m] = Size;
+		return (m_pViews[m] = p);
+	}
+
+	void CloseMapping(int m)
+	{
+		if (m_pViews[m]) munmap(m_pViews[m], m_ViewSizes[m]);
+		m_pViews[m] = NULL, m_ViewSizes[m] = 0;
+	}
+
+	//Removes the name so the object is gone once the last process unmaps it
+	static void RemoveMapping(const char* Name)
+	{
+		char Path[64] = "/";
+		strncat(Path, Name, sizeof(Path) - 2);
+		shm_unlink(Path);
+	}
+
+	static bool CompareExchange64(volatile int64_t* p, int64_t Expected, int64_t Desired) { return __sync_bool_compare_and_swap(p, Expected, Desired); }
+	static uint32_t GetProcessId() { return (uint32_t)getpid(); }
+	static bool IsProcessAlive(uint32_t ProcessId) { return (kill((pid_t)ProcessId, 0) == 0 || errno == EPERM); }
+	static uint32_t GetTicks() { struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts); return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000); }
+	static int64_t GetTimestamp() { struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts); return (int64_t)ts.tv_sec * 10000000 + ts.tv_nsec / 100; }
+
+private:
+	int m_LockFile;
+	volatile int32_t* m_pEvents;
+	void* m_pViews[MAPPING_COUNT];
+	size_t m_ViewSizes[MAPPING_COUNT];
+
+	//Opens (or creates and grows to MinSize) a shared memory object, returns its actual size in OutSize if requested
+	static int OpenShared(const char* Name, size_t MinSize, bool Create, size_t* OutSize)
+	{
+		char Path[64] = "/";
+		strncat(Path, Name, sizeof(Path) - 2);
+		int fd = shm_open(Path, (Create ? O_RDWR | O_CREAT : O_RDWR), 0600);
+		if (fd < 0) return -1;
+		struct stat st;
+		if (fstat(fd, &st) || (Create && (size_t)st.st_size < MinSize && ftruncate(fd, (off_t)MinSize)) || (!Create && (size_t)st.st_size < MinSize)) { close(fd); return -1; }
+		if (OutSize) *OutSize = ((size_t)st.st_size > MinSize ? (size_t)st.st_size : MinSize);
+		return fd;
+	}
+};
+#endif
+
 struct SharedImageMemory
 {
-	SharedImageMemory(int32_t CapNum)
+	SharedImageMemory(int32_t CapNum) : m_CapNum(CapNum), m_pSharedBuf(NULL), m_pFrames(NULL), m_FramesGeneration(0), m_SlotSize(0), m_Reader(-1), m_pReadTiles(NULL),
+		m_RequestSerial(0), m_DirtyTracking(false), m_DirtyGap(false), m_pPending(NULL)
 	{
-		memset(this, 0, sizeof(*this));
-		m_CapNum = CapNum;
+		m_Request.output = OUTPUT_NONE;
+		memset(&m_ReadFrame, 0, sizeof(m_ReadFrame));
+		memset(m_TileLayout, 0, sizeof(m_TileLayout));
 	}
 
 	~SharedImageMemory()
 	{
-		if (m_hMutex) CloseHandle(m_hMutex);
-		if (m_hWantFrameEvent) CloseHandle(m_hWantFrameEvent);
-		if (m_hSentFrameEvent) CloseHandle(m_hSentFrameEvent);
-		if (m_hSharedFile) CloseHandle(m_hSharedFile);
+		free(m_pPending);
+		if (m_Reader < 0) return;
+		m_Backend.Lock();
+		SharedReaderInfo& r = m_pSharedBuf->readers[m_Reader];
+		if (r.held >= 0) ReleaseSlot(r.held);
+		r.held = -1, r.state = READER_FREE;
+		m_Backend.Unlock();
 	}
 
 	int32_t GetCapNum() { return m_CapNum; }
 	enum { MAX_CAPNUM = ('z' - '0') }; //see Open() for why this number
-	enum { RECEIVE_MAX_WAIT = 200 }; //How many milliseconds to wait for new frame
-	enum EFormat { FORMAT_UINT8, FORMAT_FP16_GAMMA, FORMAT_FP16_LINEAR };
-	enum EResizeMode { RESIZEMODE_DISABLED = 0, RESIZEMODE_LINEAR = 1 };
+	enum { RECEIVE_MAX_WAIT = 200 }; //Default for how many milliseconds Receive waits for a new frame
+	enum EFormat { FORMAT_UINT8, FORMAT_FP16_GAMMA, FORMAT_FP16_LINEAR, FORMAT_CONVERTED }; //converted frames are in the output requested by the receiver
+	enum EResizeMode { RESIZEMODE_DISABLED = 0, RESIZEMODE_LINEAR = 1, RESIZEMODE_BILINEAR = 2, RESIZEMODE_AREA = 3 };
 	enum EMirrorMode { MIRRORMODE_DISABLED = 0, MIRRORMODE_HORIZONTALLY = 1 };
 	enum EReceiveResult { RECEIVERES_CAPTUREINACTIVE, RECEIVERES_NEWFRAME, RECEIVERES_OLDFRAME };
 
+	//Output a receiver can ask the sender to convert frames into so it only needs to copy them, the values are the ones of ProcessJob
+	//and ProcessToneMap (process.inl), the frame is stored like the receiver output: packed rows, BI_RGB formats bottom-up
+	enum { OUTPUT_NONE = -1 };
+	struct OutputRequest { int output, width, height, colorspace, tonemap, exposure; };
+
 	typedef void (*ReceiveCallbackFunc)(int width, int height, int stride, EFormat format, EResizeMode resizemode, EMirrorMode mirrormode, int timeout, uint8_t* buffer, void* callback_data);
 
-	EReceiveResult Receive(ReceiveCallbackFunc callback, void* callback_data)
+	//Up to MAXREADERS receivers (in the same or in different processes) can receive the frames of one sender
+	//Each one registers in the shared memory with its own cursor and wake up event so none of them misses a frame sent to another
+	//Waits until a new frame arrives but no longer than MaxWait milliseconds, after which the last frame is passed again (if any)
+	EReceiveResult Receive(ReceiveCallbackFunc callback, void* callback_data, uint32_t MaxWait = RECEIVE_MAX_WAIT)
 	{
-		if (!Open(true) || !m_pSharedBuf->width) return RECEIVERES_CAPTUREINACTIVE;
+		if (!Open(true) || !Register()) return RECEIVERES_CAPTUREINACTIVE;
+		SharedMemHeader* h = m_pSharedBuf;
+		SharedReaderInfo& r = h->readers[m_Reader];
+		r.heartbeat = SharedImageMemoryBackend::GetTicks();
 
-		SetEvent(m_hWantFrameEvent);
-		bool IsNewFrame = (WaitForSingleObject(m_hSentFrameEvent, RECEIVE_MAX_WAIT) == WAIT_OBJECT_0);
+		//Wait until the latest frame is a different one than the last frame passed to this receiver (or the first one ever sent)
+		//The sender sets the event of this receiver with every frame so the wait ends as soon as one arrives
+		//The deadline is kept with GetTimestamp as the tick count only advances every 15.6 ms on Windows
+		int Slot;
+		for (const int64_t Deadline = GetTimestamp() + (int64_t)MaxWait * 10000;;)
+		{
+			if ((Slot = AcquireLatestSlot()) >= 0 && h->frames[Slot].sequence != r.cursor) break;
+			const int64_t Left = Deadline - GetTimestamp();
+			if (Left <= 0)
+			{
+				if (Slot < 0) return RECEIVERES_CAPTUREINACTIVE; //nothing sent yet
+				break;
+			}
+			if (Slot >= 0) r.held = -1, ReleaseSlot(Slot);
+			m_Backend.WaitEvent(m_Reader, (uint32_t)((Left + 9999) / 10000));
+		}
+		if (!MapFrames()) { r.held = -1, ReleaseSlot(Slot); return RECEIVERES_CAPTUREINACTIVE; }
 
-		WaitForSingleObject(m_hMutex, INFINITE); //lock mutex
-		callback(m_pSharedBuf->width, m_pSharedBuf->height, m_pSharedBuf->stride, (EFormat)m_pSharedBuf->format, (EResizeMode)m_pSharedBuf->resizemode, (EMirrorMode)m_pSharedBuf->mirrormode, m_pSharedBuf->timeout, m_pSharedBuf->data, callback_data);
-		ReleaseMutex(m_hMutex); //unlock mutex
+		//A held slot is never written by the sender so it can be processed without holding a lock
+		m_ReadFrame = h->frames[Slot];
+		const bool IsNewFrame = (m_ReadFrame.sequence != r.cursor);
+		r.cursor = m_ReadFrame.sequence;
+		const SharedFrameInfo& f = m_ReadFrame;
+		m_pReadTiles = (f.tiles >= 0 ? SlotTiles(Slot) : NULL);
+		callback(f.width, f.height, f.stride, (EFormat)f.format, (EResizeMode)f.resizemode, (EMirrorMode)f.mirrormode, f.timeout, SlotData(Slot), callback_data);
+		m_pReadTiles = NULL;
+		r.held = -1, ReleaseSlot(Slot);
 
 		return (IsNewFrame ? RECEIVERES_NEWFRAME : RECEIVERES_OLDFRAME);
 	}
 
+	//Sequence number and send time (see GetTimestamp) of the frame passed to the callback by the last successful Receive
+	//Sequence numbers increase by one with every sent frame so gaps between received frames are frames the receiver never got
+	uint64_t GetFrameSequence() { return m_ReadFrame.sequence; }
+	int64_t GetFrameTimestamp() { return m_ReadFrame.timestamp; }
+
+	//Byte size of that frame and for FORMAT_CONVERTED frames the serial number of the request they were converted for (see RequestOutput)
+	uint32_t GetFrameDataSize() { return m_ReadFrame.size; }
+	int32_t GetFrameRequest() { return m_ReadFrame.request; }
+
+	//Optional tracking of the parts of frames that changed, for mostly static content: Frames are split into tiles of DIRTYTILE_WIDTH
+	//by DIRTYTILE_HEIGHT pixels (counted from the first row in memory) and only the tiles that changed since the previous frame get
+	//copied into the shared memory. Receivers get a mask of these tiles so they only need to convert the parts that changed.
+	//Frames with more than MAX_DIRTYTILES tiles and FORMAT_CONVERTED frames are always sent whole.
+	enum { DIRTYTILE_WIDTH = 64, DIRTYTILE_HEIGHT = 16, MAX_DIRTYTILES = 65536 };
+	void SetDirtyTracking(bool Enable) { m_DirtyTracking = Enable; }
+
+	//Byte size of the tile mask of a frame, one bit per tile in rows of (width + DIRTYTILE_WIDTH - 1) / DIRTYTILE_WIDTH tiles with
+	//the lowest bit first, packed without padding between tile rows. Returns 0 if the frame has too many tiles to be tracked.
+	static size_t DirtyMaskSize(int width, int height)
+	{
+		const size_t Tiles = (size_t)((width + DIRTYTILE_WIDTH - 1) / DIRTYTILE_WIDTH) * ((height + DIRTYTILE_HEIGHT - 1) / DIRTYTILE_HEIGHT);
+		return (width > 0 && height > 0 && Tiles <= MAX_DIRTYTILES ? (Tiles + 7) / 8 : 0);
+	}
+
+	//For receivers, the mask of the tiles of the frame passed to the callback that changed since the frame with the sequence number
+	//before it. Only valid during the callback, NULL if the whole frame has to be considered changed.
+	const uint8_t* GetFrameDirtyTiles() { return m_pReadTiles; }
+
+	//Asks the sender to send frames converted into the given output, there is one request for all receivers and the last one made wins
+	//Returns the serial number frames converted for it carry (0 on failure), an unchanged request keeps its serial number
+	int32_t RequestOutput(const OutputRequest& r)
+	{
+		if (!Open(true)) return 0;
+		SharedMemHeader* h = m_pSharedBuf;
+		m_Backend.Lock();
+		if (!h->requestSerial || h->request.output == OUTPUT_NONE || memcmp(&h->request, &r, sizeof(r)))
+			h->request = r, h->requestSerial++;
+		const int32_t Serial = h->requestSerial;
+		m_Backend.Unlock();
+		return Serial;
+	}
+
+	//Withdraws the request with the given serial number unless it has been replaced already, the sender then goes back to unconverted frames
+	void WithdrawOutput(int32_t Serial)
+	{
+		if (!Serial || !Open(true)) return;
+		SharedMemHeader* h = m_pSharedBuf;
+		m_Backend.Lock();
+		if (h->requestSerial == Serial) h->request.output = OUTPUT_NONE, h->requestSerial++;
+		m_Backend.Unlock();
+	}
+
+	//Monotonic time in 100 nanosecond units, comparable between the sending and the receiving process
+	static int64_t GetTimestamp() { return SharedImageMemoryBackend::GetTimestamp(); }
+
 	bool SendIsReady()
 	{
 		return Open(false);
 	}
 
+	//For receivers, opens (or creates) the shared memory which Receive and the output requests otherwise do on first use
+	//A receiver used from more than one thread has to be opened with this before the threads start so they don't open it concurrently
+	bool ReceiveIsReady()
+	{
+		return Open(true);
+	}
+
+	//For the sender, the output currently requested by a receiver, returns the serial number of the request or 0 if there is none
+	//The request only gets read under the lock after its serial number changed
+	int32_t GetOutputRequest(OutputRequest& r)
+	{
+		UCASSERT(m_pSharedBuf);
+		if (m_pSharedBuf->requestSerial != m_RequestSerial)
+		{
+			m_Backend.Lock();
+			m_Request = m_pSharedBuf->request, m_RequestSerial = m_pSharedBuf->requestSerial;
+			m_Backend.Unlock();
+		}
+		r = m_Request;
+		return (m_Request.output != OUTPUT_NONE ? m_RequestSerial : 0);
+	}
+
+	//With dirty tracking enabled the changed tiles are either given by the caller in DirtyTiles (a mask as described at DirtyMaskSize
+	//of the tiles changed since the frame passed to the previous call) or found by comparing the frame against the previous one
 	enum ESendResult { SENDRES_TOOLARGE, SENDRES_WARN_FRAMESKIP, SENDRES_OK };
-	ESendResult Send(int width, int height, int stride, DWORD DataSize, EFormat format, EResizeMode resizemode, EMirrorMode mirrormode, int timeout, const uint8_t* buffer)
+	ESendResult Send(int width, int height, int stride, uint32_t DataSize, EFormat format, EResizeMode resizemode, EMirrorMode mirrormode, int timeout, const uint8_t* buffer, const uint8_t* DirtyTiles = NULL)
 	{
 		UCASSERT(buffer);
 		UCASSERT(m_pSharedBuf);
-		if (m_pSharedBuf->maxSize < DataSize) return SENDRES_TOOLARGE;
-
-		WaitForSingleObject(m_hMutex, INFINITE); //lock mutex
-		m_pSharedBuf->width = width;
-		m_pSharedBuf->height = height;
-		m_pSharedBuf->stride = stride;
-		m_pSharedBuf->format = format;
-		m_pSharedBuf->resizemode = resizemode;
-		m_pSharedBuf->mirrormode = mirrormode;
-		m_pSharedBuf->timeout = timeout;
-		memcpy(m_pSharedBuf->data, buffer, DataSize);
-		ReleaseMutex(m_hMutex); //unlock mutex
-
-		SetEvent(m_hSentFrameEvent);
-		bool DidSkipFrame = (WaitForSingleObject(m_hWantFrameEvent, 0) != WAIT_OBJECT_0);
+		ESendResult Res = PrepareWriteSlot(DataSize);
+		if (Res != SENDRES_OK) { m_DirtyGap = true; return Res; }
 
-		return (DidSkipFrame ? SENDRES_WARN_FRAMESKIP : SENDRES_OK);
+		SharedFrameInfo& f = m_pSharedBuf->frames[m_pSharedBuf->writeSlot];
+		f.width = width;
+		f.height = height;
+		f.stride = stride;
+		f.format = format;
+		f.request = 0;
+		f.size = DataSize;
+		const size_t MaskSize = (m_DirtyTracking || DirtyTiles ? TrackTiles(f) : 0);
+		if (!MaskSize) { memcpy(SlotData(m_pSharedBuf->writeSlot), buffer, DataSize); f.tiles = -1; }
+		else
+		{
+			//The slot only needs the tiles in which it differs from the previous frame and the ones changed by this frame
+			uint8_t* Pending = m_pPending + m_pSharedBuf->writeSlot * (size_t)DIRTYMASK_SIZE;
+			const uint8_t* Dirty = SlotTiles(m_pSharedBuf->writeSlot);
+			f.tiles = MarkDirtyTiles(f, buffer, DirtyTiles, MaskSize);
+			for (size_t i = 0; i != MaskSize; i++) Pending[i] |= Dirty[i];
+			CopyTiles(f, buffer, Pending);
+		}
+		return PublishWriteSlot(resizemode, mirrormode, timeout);
+	}
+
+	//Zero copy sending: Returns the memory of the slot owned by the sender so a frame can be written into the shared memory directly
+	//Rows are 'stride' pixels apart, the frame gets published with CommitWriteSlot. Returns NULL if the frame is larger than
+	//MAX_SHARED_IMAGE_SIZE or if all slots are held by receivers (the frame has to be skipped then)
+	uint8_t* AcquireWriteSlot(int width, int height, EFormat format, int& stride)
+	{
+		UCASSERT(m_pSharedBuf);
+		stride = width;
+		if (width <= 0 || height <= 0 || (uint64_t)width * height * (format == FORMAT_UINT8 ? 4 : 8) > MAX_SHARED_IMAGE_SIZE ||
+			PrepareWriteSlot((uint32_t)(width * height * (format == FORMAT_UINT8 ? 4 : 8))) != SENDRES_OK) { m_DirtyGap = true; return NULL; }
+
+		SharedFrameInfo& f = m_pSharedBuf->frames[m_pSharedBuf->writeSlot];
+		f.width = width;
+		f.height = height;
+		f.stride = stride;
+		f.format = format;
+		f.request = 0;
+		f.size = (uint32_t)(width * height * (format == FORMAT_UINT8 ? 4 : 8));
+		return SlotData(m_pSharedBuf->writeSlot);
+	}
+
+	//Like AcquireWriteSlot for a frame of DataSize bytes converted into the output of the request with the given serial number
+	uint8_t* AcquireConvertedSlot(int width, int height, int32_t request, uint32_t DataSize)
+	{
+		UCASSERT(m_pSharedBuf);
+		if (width <= 0 || height <= 0 || PrepareWriteSlot(DataSize) != SENDRES_OK) return NULL;
+
+		SharedFrameInfo& f = m_pSharedBuf->frames[m_pSharedBuf->writeSlot];
+		f.width = width;
+		f.height = height;
+		f.stride = width;
+		f.format = FORMAT_CONVERTED;
+		f.request = request;
+		f.size = DataSize;
+		return SlotData(m_pSharedBuf->writeSlot);
+	}
+
+	//Publishes a frame written into the slot returned by AcquireWriteSlot or AcquireConvertedSlot, the changed tiles of frames not
+	//converted are handled as described at Send (the slot always gets written whole so they only spare the receivers some work)
+	ESendResult CommitWriteSlot(EResizeMode resizemode, EMirrorMode mirrormode, int timeout, const uint8_t* DirtyTiles = NULL)
+	{
+		UCASSERT(m_pSharedBuf);
+		SharedFrameInfo& f = m_pSharedBuf->frames[m_pSharedBuf->writeSlot];
+		const size_t MaskSize = (m_DirtyTracking || DirtyTiles ? TrackTiles(f) : 0);
+		f.tiles = (MaskSize ? MarkDirtyTiles(f, SlotData(m_pSharedBuf->writeSlot), DirtyTiles, MaskSize) : -1);
+		return PublishWriteSlot(resizemode, mirrormode, timeout);
 	}
 
 private:
+	ESendResult PublishWriteSlot(EResizeMode resizemode, EMirrorMode mirrormode, int timeout)
+	{
+		//Publish the slot written by the sender as the latest frame, receivers still processing an earlier frame keep holding theirs
+		//This never waits for the receivers, a latest frame that wasn't picked up yet simply gets replaced by the newer one
+		SharedMemHeader* h = m_pSharedBuf;
+		SharedFrameInfo& f = h->frames[h->writeSlot];
+		UpdatePendingTiles(f);
+		f.resizemode = resizemode;
+		f.mirrormode = mirrormode;
+		f.timeout = timeout;
+		f.sequence = ++h->sequence;
+		f.timestamp = GetTimestamp();
+		for (int64_t State = h->slotState; !SharedImageMemoryBackend::CompareExchange64(&h->slotState, State, (State & ~(int64_t)SLOTSTATE_LATESTMASK) | h->writeSlot); State = h->slotState) {}
+
+		//Wake up every registered receiver, the frame before was skipped if a receiver that is actively receiving never got it
+		bool DidSkipFrame = false;
+		const uint32_t Now = SharedImageMemoryBackend::GetTicks();
+		for (int i = 0; i != MAXREADERS; i++)
+		{
+			SharedReaderInfo& r = h->readers[i];
+			if (r.state != READER_ACTIVE) continue;
+			if (r.cursor + 1 < f.sequence && Now - r.heartbeat < READER_IDLE) DidSkipFrame = true;
+			char Name[32];
+			if (m_Backend.OpenEvent(i, ReaderEventName(Name, i), false)) m_Backend.SetEvent(i);
+		}
+
+		return (DidSkipFrame ? SENDRES_WARN_FRAMESKIP : SENDRES_OK);
+	}
+
 	bool Open(bool ForReceiving)
 	{
 		if (m_pSharedBuf) return true; //already open
@@ -99,53 +510,191 @@ private:
 		if (m_CapNum > MAX_CAPNUM) m_CapNum = MAX_CAPNUM;
 		char CSCapNumChar = (m_CapNum ? '0' + m_CapNum : '\0'); //use NULL terminator for CapNum 0 to be compatible with old filter DLLs before multi cap
 		char CS_NAME_MUTEX      [] = "UnityCapture_Mutx0"; CS_NAME_MUTEX      [sizeof(CS_NAME_MUTEX      ) - 2] = CSCapNumChar;
-		char CS_NAME_EVENT_WANT [] = "UnityCapture_Want0"; CS_NAME_EVENT_WANT [sizeof(CS_NAME_EVENT_WANT ) - 2] = CSCapNumChar;
-		char CS_NAME_EVENT_SENT [] = "UnityCapture_Sent0"; CS_NAME_EVENT_SENT [sizeof(CS_NAME_EVENT_SENT ) - 2] = CSCapNumChar;
 		char CS_NAME_SHARED_DATA[] = "UnityCapture_Data0"; CS_NAME_SHARED_DATA[sizeof(CS_NAME_SHARED_DATA) - 2] = CSCapNumChar;
 
-		if (!m_hMutex)
+		if (!m_Backend.OpenLock(CS_NAME_MUTEX, ForReceiving)) return false;
+
+		m_Backend.Lock();
+		struct UnlockAtReturn { ~UnlockAtReturn() { b.Unlock(); }; SharedImageMemoryBackend& b; } cs = { m_Backend };
+
+		m_pSharedBuf = (SharedMemHeader*)m_Backend.OpenMapping(MAPPING_HEADER, CS_NAME_SHARED_DATA, sizeof(SharedMemHeader), ForReceiving);
+		if (!m_pSharedBuf) return false;
+
+		if (!ForReceiving && m_pSharedBuf->headerSize != sizeof(SharedMemHeader))
+		{
+			//Not set up yet or set up by a receiver with another header layout, the sender tries again on its next call
+			m_Backend.CloseMapping(MAPPING_HEADER);
+			m_pSharedBuf = NULL;
+			return false;
+		}
+
+		if (ForReceiving && m_pSharedBuf->headerSize != sizeof(SharedMemHeader))
 		{
-			if (ForReceiving) m_hMutex = CreateMutexA(NULL, FALSE,      CS_NAME_MUTEX);
-			else              m_hMutex = OpenMutexA(SYNCHRONIZE, FALSE, CS_NAME_MUTEX);
-			if (!m_hMutex) return false;
+			//First receiver to create the shared memory sets up the empty slots and reader registry, frame data comes with the first frame
+			m_pSharedBuf->writeSlot = 0;
+			m_pSharedBuf->slotState = SLOTSTATE_NONE;
+			m_pSharedBuf->generation = 0;
+			m_pSharedBuf->slotSize = 0;
+			memset(m_pSharedBuf->readers, 0, sizeof(m_pSharedBuf->readers));
+			m_pSharedBuf->requestSerial = 0;
+			m_pSharedBuf->request.output = OUTPUT_NONE;
+			m_pSharedBuf->headerSize = sizeof(SharedMemHeader);
 		}
 
-		WaitForSingleObject(m_hMutex, INFINITE); //lock mutex
-		struct UnlockAtReturn { ~UnlockAtReturn() { ReleaseMutex(m); }; HANDLE m; } cs = { m_hMutex };
+		return true;
+	}
 
-		if (!m_hWantFrameEvent)
+	//Adds this receiver to the reader registry (once), entries left behind by receivers in processes that have ended get reused
+	bool Register()
+	{
+		if (m_Reader >= 0) return true;
+		m_Backend.Lock();
+		ReclaimDeadReaders();
+		for (int i = 0; i != MAXREADERS && m_Reader < 0; i++)
 		{
-			if (ForReceiving) m_hWantFrameEvent = OpenEventA(EVENT_MODIFY_STATE, FALSE, CS_NAME_EVENT_WANT);
-			else              m_hWantFrameEvent = CreateEventA(NULL, FALSE, FALSE,      CS_NAME_EVENT_WANT);
-			if (!m_hWantFrameEvent) return false;
+			SharedReaderInfo& r = m_pSharedBuf->readers[i];
+			if (r.state != READER_FREE) continue;
+			char Name[32];
+			if (!m_Backend.OpenEvent(i, ReaderEventName(Name, i), true)) break;
+			r.process = SharedImageMemoryBackend::GetProcessId();
+			r.held = -1;
+			r.heartbeat = SharedImageMemoryBackend::GetTicks();
+			r.cursor = 0;
+			r.state = READER_ACTIVE;
+			m_Reader = i;
 		}
+		m_Backend.Unlock();
+		return (m_Reader >= 0);
+	}
 
-		if (!m_hSentFrameEvent)
+	//Needs to be called while holding the lock
+	void ReclaimDeadReaders()
+	{
+		for (int i = 0; i != MAXREADERS; i++)
 		{
-			if (ForReceiving) m_hSentFrameEvent = CreateEventA(NULL, FALSE, FALSE,      CS_NAME_EVENT_SENT);
-			else              m_hSentFrameEvent = OpenEventA(EVENT_MODIFY_STATE, FALSE, CS_NAME_EVENT_SENT);
-			if (!m_hSentFrameEvent) return false;
+			SharedReaderInfo& r = m_pSharedBuf->readers[i];
+			if (r.state != READER_ACTIVE || SharedImageMemoryBackend::IsProcessAlive(r.process)) continue;
+			if (r.held >= 0) ReleaseSlot(r.held); //crashed while processing a frame
+			r.held = -1, r.state = READER_FREE;
 		}
+	}
+
+	char* ReaderEventName(char* Name, int Reader)
+	{
+		strcpy(Name, "UnityCapture_Read00");
+		Name[17] = (char)('0' + m_CapNum), Name[18] = (char)('0' + Reader);
+		return Name;
+	}
+
+	//Frames are stored in SLOTCOUNT slots: One holds the latest published frame, the sender writes into another one which is neither
+	//the latest nor held by a receiver and receivers hold the slot of the frame they are processing. All of this is kept in slotState,
+	//the index of the latest slot and a count of the receivers holding each slot, which is only ever changed with compare exchange.
+	//Receivers only take a hold on the latest slot, so once the sender picked a slot that isn't held it can't be taken while written.
+	enum { SLOTCOUNT = 4, MAXREADERS = SharedImageMemoryBackend::EVENT_COUNT, SLOTSTATE_LATESTMASK = 0xFF, SLOTSTATE_NONE = 0xFF };
+	enum { READER_FREE = 0, READER_ACTIVE = 1, READER_IDLE = 1000 }; //receivers that haven't received for READER_IDLE ms don't cause frame skip warnings
+	static int64_t HolderUnit(int Slot) { return (int64_t)1 << (8 + 8 * Slot); }
+	static int Holders(int64_t State, int Slot) { return (int)((State >> (8 + 8 * Slot)) & 0xFF); }
 
-		if (!m_hSharedFile)
+	int AcquireLatestSlot()
+	{
+		volatile int64_t* p = &m_pSharedBuf->slotState;
+		for (int64_t State;;)
 		{
-			if (ForReceiving) m_hSharedFile = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, NULL, sizeof(SharedMemHeader) + MAX_SHARED_IMAGE_SIZE, CS_NAME_SHARED_DATA);
-			else              m_hSharedFile = OpenFileMappingA(FILE_MAP_WRITE, FALSE, CS_NAME_SHARED_DATA);
-			if (!m_hSharedFile) return false;
+			//A torn read on 32-bit only makes the compare exchange fail
+			const int Latest = (int)((State = *p) & SLOTSTATE_LATESTMASK);
+			if (Latest == SLOTSTATE_NONE) return -1;
+			if (!SharedImageMemoryBackend::CompareExchange64(p, State, State + HolderUnit(Latest))) continue;
+			m_pSharedBuf->readers[m_Reader].held = Latest;
+			return Latest;
 		}
+	}
 
-		m_pSharedBuf = (SharedMemHeader*)MapViewOfFile(m_hSharedFile, FILE_MAP_WRITE, 0, 0, 0);
-		if (!m_pSharedBuf) return false;
+	void ReleaseSlot(int Slot)
+	{
+		volatile int64_t* p = &m_pSharedBuf->slotState;
+		for (int64_t State = *p; !SharedImageMemoryBackend::CompareExchange64(p, State, State - HolderUnit(Slot)); State = *p) {}
+	}
 
-		if (ForReceiving && m_pSharedBuf->maxSize != MAX_SHARED_IMAGE_SIZE)
-			m_pSharedBuf->maxSize = MAX_SHARED_IMAGE_SIZE;
+	//Frame data lives in a segment of its own with slots sized for the frames actually sent. When a frame doesn't fit (or would need
+	//less than a quarter of a slot) the sender creates a segment with the next generation number, receivers map it once they see the
+	//generation change. The switch only happens while no slot is held and unpublishes the latest frame first so none can be taken
+	//meanwhile, a receiver that holds a slot can therefore rely on the generation and slot size staying the same until it releases it.
+	//The tile masks of the slots (see SetDirtyTracking) follow the frame data of all slots.
+	enum { MAPPING_HEADER, MAPPING_FRAMES, DIRTYMASK_SIZE = MAX_DIRTYTILES / 8 };
 
-		return true;
+	ESendResult PrepareWriteSlot(uint32_t DataSize)
+	{
+		if (DataSize > MAX_SHARED_IMAGE_SIZE) return SENDRES_TOOLARGE;
+		SharedMemHeader* h = m_pSharedBuf;
+		const uint32_t SlotSize = (DataSize ? (DataSize + 0xFFFF) & ~0xFFFFu : 0x10000); //whole allocation granules
+		if (m_pFrames && m_FramesGeneration == h->generation && DataSize <= m_SlotSize && SlotSize > m_SlotSize / 4)
+			return (PickWriteSlot() ? SENDRES_OK : SENDRES_WARN_FRAMESKIP);
+
+		int64_t State = h->slotState;
+		if (State >> 8)
+		{
+			m_Backend.Lock();
+			ReclaimDeadReaders();
+			m_Backend.Unlock();
+			if ((State = h->slotState) >> 8) return SENDRES_WARN_FRAMESKIP; //try again with the next frame
+		}
+		if (!SharedImageMemoryBackend::CompareExchange64(&h->slotState, State, SLOTSTATE_NONE)) return SENDRES_WARN_FRAMESKIP;
+
+		char Name[32];
+		if (h->slotSize) SharedImageMemoryBackend::RemoveMapping(FramesName(Name, h->generation)); //stays until the last receiver unmaps it
+		m_Backend.CloseMapping(MAPPING_FRAMES);
+		m_FramesGeneration = h->generation + 1;
+		m_SlotSize = SlotSize;
+		m_pFrames = (uint8_t*)m_Backend.OpenMapping(MAPPING_FRAMES, FramesName(Name, m_FramesGeneration), SLOTCOUNT * ((size_t)m_SlotSize + DIRTYMASK_SIZE), true);
+		if (!m_pFrames) m_SlotSize = 0;
+		h->slotSize = m_SlotSize;
+		h->generation = m_FramesGeneration; //published before the next frame is
+		h->writeSlot = 0;
+		return (m_pFrames ? SENDRES_OK : SENDRES_TOOLARGE);
 	}
 
-	struct SharedMemHeader
+	//Needs to be called while holding a slot
+	bool MapFrames()
+	{
+		SharedMemHeader* h = m_pSharedBuf;
+		if (m_pFrames && m_FramesGeneration == h->generation) return true;
+		m_Backend.CloseMapping(MAPPING_FRAMES);
+		char Name[32];
+		m_FramesGeneration = h->generation, m_SlotSize = h->slotSize;
+		m_pFrames = (uint8_t*)m_Backend.OpenMapping(MAPPING_FRAMES, FramesName(Name, m_FramesGeneration), SLOTCOUNT * ((size_t)m_SlotSize + DIRTYMASK_SIZE), false);
+		return (m_pFrames != NULL);
+	}
+
+	char* FramesName(char* Name, uint32_t Generation)
+	{
+		strcpy(Name, "UnityCapture_Frms0_");
+		Name[17] = (char)('0' + m_CapNum);
+		char *p = Name + 19, *q = p;
+		do { *q++ = (char)('0' + Generation % 10); } while (Generation /= 10);
+		for (*q-- = '\0'; p < q; p++, q--) { char c = *p; *p = *q; *q = c; }
+		return Name;
+	}
+
+	//Picks the slot the sender writes the next frame into, fails if all other slots are held by receivers
+	bool PickWriteSlot()
 	{
-		DWORD maxSize;
+		for (int Attempt = 0; Attempt != 2; Attempt++)
+		{
+			const int64_t State = m_pSharedBuf->slotState;
+			for (int i = 0; i != SLOTCOUNT; i++)
+				if (i != (int)(State & SLOTSTATE_LATESTMASK) && !Holders(State, i)) { m_pSharedBuf->writeSlot = i; return true; }
+			if (Attempt) break;
+			m_Backend.Lock();
+			ReclaimDeadReaders();
+			m_Backend.Unlock();
+		}
+		return false;
+	}
+
+	struct SharedFrameInfo
+	{
+		uint64_t sequence;
+		int64_t timestamp;
 		int width;
 		int height;
 		int stride;
@@ -153,13 +702,135 @@ private:
 		int resizemode;
 		int mirrormode;
 		int timeout;
-		uint8_t data[1];
+		int request; //serial number of the output request a FORMAT_CONVERTED frame was converted for
+		uint32_t size; //byte size of the frame data
+		int tiles; //number of tiles changed since the frame before (see SetDirtyTracking), -1 if the whole frame counts as changed
+	};
+
+	struct SharedReaderInfo
+	{
+		volatile int32_t state; //READER_FREE or READER_ACTIVE, only changed while holding the lock
+		uint32_t process; //id of the process of the receiver so entries of crashed receivers can be reused
+		volatile int32_t held; //slot the receiver holds while processing a frame, -1 if none
+		volatile uint32_t heartbeat; //GetTicks of the last Receive
+		volatile uint64_t cursor; //sequence number of the last frame received
 	};
 
+	struct SharedMemHeader
+	{
+		uint32_t headerSize; //sizeof(SharedMemHeader), the first receiver sets up the header if it doesn't match
+		int writeSlot; //only accessed by the sender
+		volatile int64_t slotState; //index of the latest slot (SLOTSTATE_NONE before the first frame) and the holder count of every slot
+		uint64_t sequence; //sequence number of the last frame sent, only accessed by the sender
+		volatile uint32_t generation; //number of the current frame data segment (see PrepareWriteSlot)
+		uint32_t slotSize; //size of each slot in that segment
+		volatile int32_t requestSerial; //changes with every change of the request, both are only modified while holding the lock
+		OutputRequest request; //output the sender is asked to convert frames into (see RequestOutput)
+		int reserved; //keeps the following arrays aligned to 8 bytes
+		SharedReaderInfo readers[MAXREADERS];
+		SharedFrameInfo frames[SLOTCOUNT];
+	};
+
+	uint8_t* SlotData(int slot) { return m_pFrames + slot * (size_t)m_SlotSize; }
+	uint8_t* SlotTiles(int slot) { return m_pFrames + SLOTCOUNT * (size_t)m_SlotSize + slot * (size_t)DIRTYMASK_SIZE; }
+
+	//The sender keeps a mask for every slot of the tiles in which that slot may differ from the last frame sent. Writing a frame into
+	//a slot only needs these tiles and the ones changed by the frame, afterwards the changed tiles get added to the masks of the other
+	//slots. A frame with a different layout or a new segment starts over with all tiles pending, frames sent whole forget the layout.
+	//Returns the size of the tile mask of the frame or 0 if its tiles can't be tracked.
+	size_t TrackTiles(const SharedFrameInfo& f)
+	{
+		const size_t MaskSize = DirtyMaskSize(f.width, f.height);
+		if (!MaskSize || f.format == FORMAT_CONVERTED || (!m_pPending && !(m_pPending = (uint8_t*)malloc(SLOTCOUNT * DIRTYMASK_SIZE)))) return 0;
+		const int Layout[] = { (int)m_FramesGeneration, f.width, f.height, f.stride, f.format };
+		if (memcmp(m_TileLayout, Layout, sizeof(Layout)))
+		{
+			memcpy(m_TileLayout, Layout, sizeof(Layout));
+			memset(m_pPending, 0xFF, SLOTCOUNT * DIRTYMASK_SIZE);
+		}
+		return MaskSize;
+	}
+
+	void UpdatePendingTiles(const SharedFrameInfo& f)
+	{
+		m_DirtyGap = false;
+		if (f.tiles < 0) { m_TileLayout[1] = 0; return; }
+		const size_t MaskSize = DirtyMaskSize(f.width, f.height);
+		const uint8_t* Dirty = SlotTiles(m_pSharedBuf->writeSlot);
+		for (int s = 0; s != SLOTCOUNT; s++)
+		{
+			uint8_t* Pending = m_pPending + s * (size_t)DIRTYMASK_SIZE;
+			if (s == m_pSharedBuf->writeSlot) memset(Pending, 0, MaskSize);
+			else for (size_t i = 0; i != MaskSize; i++) Pending[i] |= Dirty[i];
+		}
+	}
+
+	//Writes the mask of the tiles in which the frame at Data differs from the latest frame into the tile mask of the write slot and
+	//returns how many there are. The mask of the caller is used if it covers all frames since the latest one, otherwise the frame gets
+	//compared against the latest one. Everything counts as changed if the latest frame has a different layout.
+	int MarkDirtyTiles(const SharedFrameInfo& f, const uint8_t* Data, const uint8_t* DirtyTiles, size_t MaskSize)
+	{
+		SharedMemHeader* h = m_pSharedBuf;
+		uint8_t* Dirty = SlotTiles(h->writeSlot);
+		const int Latest = (int)(h->slotState & SLOTSTATE_LATESTMASK);
+		const SharedFrameInfo* p = (Latest != SLOTSTATE_NONE ? &h->frames[Latest] : NULL);
+		const int TilesX = (f.width + DIRTYTILE_WIDTH - 1) / DIRTYTILE_WIDTH, TilesY = (f.height + DIRTYTILE_HEIGHT - 1) / DIRTYTILE_HEIGHT;
+		if (!p || p->width != f.width || p->height != f.height || p->stride != f.stride || p->format != f.format) memset(Dirty, 0xFF, MaskSize);
+		else if (DirtyTiles && !m_DirtyGap) memcpy(Dirty, DirtyTiles, MaskSize);
+		else
+		{
+			const size_t BPP = (f.format == FORMAT_UINT8 ? 4 : 8), Pitch = f.stride * BPP;
+			const uint8_t* Prev = SlotData(Latest);
+			memset(Dirty, 0, MaskSize);
+			for (int y = 0; y != f.height; y++)
+			{
+				//Unchanged rows are skipped with a single compare, only the others get compared tile by tile
+				const uint8_t *a = Data + y * Pitch, *b = Prev + y * Pitch;
+				if (!memcmp(a, b, f.width * BPP)) continue;
+				for (int tx = 0, t = (y / DIRTYTILE_HEIGHT) * TilesX; tx != TilesX; tx++, t++)
+				{
+					const size_t x0 = tx * DIRTYTILE_WIDTH * BPP, n = (tx == TilesX - 1 ? f.width - tx * DIRTYTILE_WIDTH : DIRTYTILE_WIDTH) * BPP;
+					if (!(Dirty[t >> 3] & (1 << (t & 7))) && memcmp(a + x0, b + x0, n)) Dirty[t >> 3] |= (uint8_t)(1 << (t & 7));
+				}
+			}
+		}
+		const int Tiles = TilesX * TilesY;
+		if (Tiles & 7) Dirty[MaskSize - 1] &= (uint8_t)((1 << (Tiles & 7)) - 1);
+		int Count = 0;
+		for (size_t i = 0; i != MaskSize; i++) for (uint8_t b = Dirty[i]; b; b &= (uint8_t)(b - 1)) Count++;
+		return Count;
+	}
+
+	//Copies the tiles of the frame at Data marked in Mask into the write slot, neighboring tiles in a row get copied together
+	void CopyTiles(const SharedFrameInfo& f, const uint8_t* Data, const uint8_t* Mask)
+	{
+		uint8_t* Slot = SlotData(m_pSharedBuf->writeSlot);
+		const size_t BPP = (f.format == FORMAT_UINT8 ? 4 : 8), Pitch = f.stride * BPP;
+		const int TilesX = (f.width + DIRTYTILE_WIDTH - 1) / DIRTYTILE_WIDTH, TilesY = (f.height + DIRTYTILE_HEIGHT - 1) / DIRTYTILE_HEIGHT;
+		for (int ty = 0; ty != TilesY; ty++)
+		{
+			const int y0 = ty * DIRTYTILE_HEIGHT, y1 = (y0 + DIRTYTILE_HEIGHT < f.height ? y0 + DIRTYTILE_HEIGHT : f.height);
+			for (int tx = 0, t = ty * TilesX, Start; tx != TilesX;)
+			{
+				if (!(Mask[t >> 3] & (1 << (t & 7)))) { tx++, t++; continue; }
+				for (Start = tx; tx != TilesX && (Mask[t >> 3] & (1 << (t & 7))); tx++, t++) {}
+				const size_t x0 = Start * DIRTYTILE_WIDTH * BPP, n = ((tx == TilesX ? f.width : tx * DIRTYTILE_WIDTH) - Start * DIRTYTILE_WIDTH) * BPP;
+				for (int y = y0; y != y1; y++) memcpy(Slot + y * Pitch + x0, Data + y * Pitch + x0, n);
+			}
+		}
+	}
+
 	int32_t m_CapNum;
-	HANDLE m_hMutex;
-	HANDLE m_hWantFrameEvent;
-	HANDLE m_hSentFrameEvent;
-	HANDLE m_hSharedFile;
+	SharedImageMemoryBackend m_Backend;
 	SharedMemHeader* m_pSharedBuf;
+	uint8_t* m_pFrames; //mapped frame data segment
+	uint32_t m_FramesGeneration, m_SlotSize;
+	int m_Reader; //index in the reader registry once registered by Receive
+	SharedFrameInfo m_ReadFrame; //copy of the info of the frame last passed to the callback
+	const uint8_t* m_pReadTiles; //tile mask of that frame while the callback runs
+	OutputRequest m_Request; //copy of the request read by the sender
+	int32_t m_RequestSerial;
+	bool m_DirtyTracking, m_DirtyGap; //m_DirtyGap is set if a frame failed to be sent since the last one published
+	uint8_t* m_pPending; //mask of the pending tiles of every slot (see TrackTiles)
+	int m_TileLayout[5]; //generation, width, height, stride and format the pending tiles are tracked for
 };
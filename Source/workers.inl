@@ -0,0 +1,379 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Worker thread pool running the image processing jobs from process.inl (which needs to be included first)
+//All capture streams of a process share one reference counted pool with one thread per logical processor, every stream
+//holds a ProcessWorkers handle which submits its jobs into a slot of its own and idle threads serve the slots in turn
+//A job gets split into small row chunks, every thread starts on its own contiguous run of chunks and once
+//that is done it steals chunks from the end of the runs of the other threads until no work is left
+//Dispatch and completion are signaled with atomic counters which waiting threads spin on for a short (adaptive) time
+//before parking on them with futex (Linux) or WaitOnAddress (Windows 8 and newer, with a semaphore fallback)
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+//WaitOnAddress is only available since Windows 8, older systems park on a semaphore instead
+static const struct ProcessWaitOnAddress
+{
+	ProcessWaitOnAddress() : Wait(NULL), WakeAll(NULL)
+	{
+		HMODULE m = GetModuleHandleA("kernelbase.dll");
+		if (!m) return;
+		WakeAll = (VOID (WINAPI*)(PVOID))GetProcAddress(m, "WakeByAddressAll");
+		if (WakeAll) Wait = (BOOL (WINAPI*)(volatile VOID*, PVOID, SIZE_T, DWORD))GetProcAddress(m, "WaitOnAddress");
+	}
+	BOOL (WINAPI *Wait)(volatile VOID*, PVOID, SIZE_T, DWORD);
+	VOID (WINAPI *WakeAll)(PVOID);
+} g_ProcessWaitOnAddress;
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+//Wrapper objects for platform concurrency objects (thread, atomics, a word to park threads on until its value changes, a spin lock)
+struct ProcessSync
+{
+	#if defined(_WIN32)
+	struct sThread { typedef void (*FUNC_t)(void*); sThread() : h(0) {} void Start(FUNC_t f, void* p) { fn = f; arg = p; h = CreateThread(0,0,&Run,this,0,0); } ~sThread() { if (h) { WaitForSingleObject(h, INFINITE); CloseHandle(h); } } private:static DWORD WINAPI Run(LPVOID t) { ((sThread*)t)->fn(((sThread*)t)->arg); return 0; } HANDLE h;FUNC_t fn;void* arg;sThread(const sThread&);sThread& operator=(const sThread&);};
+	static inline bool CompareExchange64(volatile int64_t* p, int64_t Expected, int64_t Desired) { return InterlockedCompareExchange64((volatile LONG64*)p, Desired, Expected) == Expected; }
+	static inline bool CompareExchange32(volatile int32_t* p, int32_t Expected, int32_t Desired) { return InterlockedCompareExchange((volatile LONG*)p, Desired, Expected) == Expected; }
+	static inline int64_t Load64(volatile int64_t* p) { return *p; } //a torn read on 32-bit only makes the following compare exchange fail
+	static inline void Store64(volatile int64_t* p, int64_t v) { InterlockedExchange64((volatile LONG64*)p, v); }
+	static inline int32_t Load32(volatile int32_t* p) { return *p; }
+	static inline void Store32(volatile int32_t* p, int32_t v) { InterlockedExchange((volatile LONG*)p, v); }
+	static inline int32_t AtomicAdd(volatile int32_t* p, int32_t v) { return (int32_t)InterlockedExchangeAdd((volatile LONG*)p, v) + v; }
+	static inline void CpuRelax() { YieldProcessor(); }
+	static inline void YieldThread() { SwitchToThread(); }
+	static inline void SleepMs(uint32_t Milliseconds) { Sleep(Milliseconds); }
+	struct sParkWord
+	{
+		volatile int32_t Value;
+		sParkWord() : Value(0), Waiters(0), h(g_ProcessWaitOnAddress.Wait ? NULL : CreateSemaphoreA(0,0,32768,0)) {}
+		~sParkWord() { if (h) CloseHandle(h); }
+		void Wait(int32_t Expected, uint32_t TimeoutMs = INFINITE)
+		{
+			if (g_ProcessWaitOnAddress.Wait) { g_ProcessWaitOnAddress.Wait(&Value, &Expected, sizeof(Value), TimeoutMs); return; }
+			InterlockedIncrement(&Waiters); //a waiter counted after a change doesn't wait and just causes one later spurious wake up
+			if (Value == Expected) WaitForSingleObject(h, TimeoutMs);
+		}
+		void WakeAll()
+		{
+			if (g_ProcessWaitOnAddress.Wait) { g_ProcessWaitOnAddress.WakeAll((PVOID)&Value); return; }
+			LONG Count = InterlockedExchange(&Waiters, 0);
+			if (Count) ReleaseSemaphore(h, Count, NULL);
+		}
+	private:
+		volatile LONG Waiters;
+		HANDLE h;
+		sParkWord(const sParkWord&);sParkWord& operator=(const sParkWord&);
+	};
+	#else
+	struct sThread { typedef void (*FUNC_t)(void*); sThread() : started(false) {} void Start(FUNC_t f, void* p) { fn = f; arg = p; started = (pthread_create(&h, 0, &Run, this) == 0); } ~sThread() { if (started) pthread_join(h, 0); } private:static void* Run(void* t) { ((sThread*)t)->fn(((sThread*)t)->arg); return 0; } pthread_t h;bool started;FUNC_t fn;void* arg;sThread(const sThread&);sThread& operator=(const sThread&);};
+	static inline bool CompareExchange64(volatile int64_t* p, int64_t Expected, int64_t Desired) { return __sync_bool_compare_and_swap(p, Expected, Desired); }
+	static inline bool CompareExchange32(volatile int32_t* p, int32_t Expected, int32_t Desired) { return __sync_bool_compare_and_swap(p, Expected, Desired); }
+	static inline int64_t Load64(volatile int64_t* p) { return __atomic_load_n(p, __ATOMIC_RELAXED); }
+	static inline void Store64(volatile int64_t* p, int64_t v) { __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+	static inline int32_t Load32(volatile int32_t* p) { return __atomic_load_n(p, __ATOMIC_SEQ_CST); }
+	static inline void Store32(volatile int32_t* p, int32_t v) { __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+	static inline int32_t AtomicAdd(volatile int32_t* p, int32_t v) { return __sync_add_and_fetch(p, v); }
+	#if defined(UC_SIMD_X86)
+	static inline void CpuRelax() { _mm_pause(); }
+	#else
+	static inline void CpuRelax() { }
+	#endif
+	static inline void YieldThread() { sched_yield(); }
+	static inline void SleepMs(uint32_t Milliseconds) { usleep(Milliseconds * 1000); }
+	struct sParkWord
+	{
+		volatile int32_t Value;
+		sParkWord() : Value(0) {}
+		void Wait(int32_t Expected, uint32_t TimeoutMs = 0xFFFFFFFF)
+		{
+			struct timespec ts = { (time_t)(TimeoutMs / 1000), (long)(TimeoutMs % 1000) * 1000000 };
+			syscall(SYS_futex, &Value, FUTEX_WAIT_PRIVATE, Expected, (TimeoutMs == 0xFFFFFFFF ? NULL : &ts), NULL, 0);
+		}
+		void WakeAll() { syscall(SYS_futex, &Value, FUTEX_WAKE_PRIVATE, 0x7fffffff, NULL, NULL, 0); }
+	};
+	#endif
+
+	//Lock for short sections, zero initialized it is unlocked
+	struct sSpinLock
+	{
+		volatile int32_t Locked;
+		void Lock() { while (!CompareExchange32(&Locked, 0, 1)) YieldThread(); }
+		void Unlock() { Store32(&Locked, 0); }
+	};
+};
+
+struct ProcessPool : ProcessSync
+{
+	enum { MAXTHREADS = 64, MAXSLOTS = 64, NOSLOT = -1 };
+
+	//Passing 0 uses one thread per logical processor (or the count set in the environment variable UNITYCAPTURE_THREADS)
+	ProcessPool(size_t RequestedThreadCount = 0) : ThreadCount(RequestedThreadCount ? RequestedThreadCount : DefaultThreadCount()), Sleepers(0), SlotCount(0), WorkersRunning(1)
+	{
+		if (ThreadCount > MAXTHREADS) ThreadCount = MAXTHREADS;
+		MaxSpin = (ThreadCount <= ProcessorCount() ? MAXSPIN : 0); //spinning only helps when every thread has a processor of its own
+		Runs = new ChunkRun[MAXSLOTS * ThreadCount];
+		for (size_t i = 0; i != MAXSLOTS; i++)
+		{
+			Slots[i].Runs = Runs + i * ThreadCount, Slots[i].RunCount = 0, Slots[i].Spin = MaxSpin, Slots[i].Sleeping = 0, Slots[i].InUse = false;
+			for (size_t j = 0; j != ThreadCount; j++) Slots[i].Runs[j].Queue = 0;
+		}
+		Workers = new Worker[ThreadCount]; //run 0 of each slot is started on by the thread submitting the job
+		for (size_t i = 1; i < ThreadCount; i++)
+		{
+			Workers[i].Pool = this, Workers[i].Index = i, Workers[i].Spin = MaxSpin;
+			Workers[i].Thread.Start(&ProcessThread, &Workers[i]);
+		}
+	}
+
+	~ProcessPool()
+	{
+		Store32(&WorkersRunning, 0);
+		AtomicAdd(&Generation.Value, 1);
+		Generation.WakeAll(); //wake up all threads
+		delete[] Workers; //waits for the threads to exit
+		delete[] Runs;
+	}
+
+	//Number of threads working on a job including the submitting thread
+	size_t GetThreadCount() const { return ThreadCount; }
+
+	static size_t DefaultThreadCount()
+	{
+		long Count = 0;
+		#if defined(_WIN32)
+		char Env[16];
+		DWORD EnvLen = GetEnvironmentVariableA("UNITYCAPTURE_THREADS", Env, sizeof(Env));
+		if (EnvLen && EnvLen < sizeof(Env)) Count = atol(Env);
+		#else
+		const char* Env = getenv("UNITYCAPTURE_THREADS");
+		if (Env) Count = atol(Env);
+		#endif
+		return (Count > 0 ? (size_t)Count : ProcessorCount());
+	}
+
+	static size_t ProcessorCount()
+	{
+		#if defined(_WIN32)
+		SYSTEM_INFO si; GetSystemInfo(&si); long Count = (long)si.dwNumberOfProcessors;
+		#else
+		long Count = sysconf(_SC_NPROCESSORS_ONLN);
+		#endif
+		return (Count < 1 ? 1 : (size_t)Count);
+	}
+
+	//Reserves a job slot for one submitter (not thread safe, ProcessWorkers serializes these), returns NOSLOT if all are taken
+	int AddClient()
+	{
+		for (int i = 0; i != MAXSLOTS; i++)
+		{
+			if (Slots[i].InUse) continue;
+			Slots[i].InUse = true;
+			if (i >= SlotCount) Store32(&SlotCount, i + 1);
+			return i;
+		}
+		return NOSLOT;
+	}
+
+	void RemoveClient(int SlotIndex)
+	{
+		if (SlotIndex == NOSLOT) return;
+		Slots[SlotIndex].InUse = false;
+		int32_t Count = SlotCount;
+		while (Count && !Slots[Count - 1].InUse) Count--;
+		Store32(&SlotCount, Count);
+	}
+
+	//Runs a job on the pool and the calling thread, only one job per slot can be running at a time
+	void Run(int SlotIndex, ProcessJob NewJob)
+	{
+		//Chunks are sized for a few per thread to balance uneven progress but big enough to keep the per chunk overhead small
+		const size_t Rows = NewJob.RowEnd, Target = ThreadCount * CHUNKSPERTHREAD;
+		size_t ChunkRows = (Rows + Target - 1) / Target, MinRows = (NewJob.Width ? (MINCHUNKPIXELS + NewJob.Width - 1) / NewJob.Width : 1);
+		if (ChunkRows < MinRows) ChunkRows = MinRows;
+		if (ChunkRows < 1) ChunkRows = 1;
+		const size_t Chunks = (Rows + ChunkRows - 1) / ChunkRows, Threads = (Chunks < ThreadCount ? Chunks : ThreadCount);
+		if (Threads <= 1 || SlotIndex == NOSLOT) { NewJob.RowStart = 0, NewJob.Worker = 0; NewJob.Execute(); return; }
+
+		//Publish the chunk runs (after the job they belong to) and notify threads of new work to do
+		Slot& s = Slots[SlotIndex];
+		s.Job = NewJob, s.ChunkRows = ChunkRows, s.ChunksLeft.Value = (int32_t)Chunks;
+		Store32(&s.RunCount, (int32_t)Threads);
+		for (size_t i = 0; i != Threads; i++) Store64(&s.Runs[i].Queue, PackQueue(Chunks * i / Threads, Chunks * (i+1) / Threads));
+		AtomicAdd(&Generation.Value, 1);
+		if (Load32(&Sleepers)) Generation.WakeAll();
+
+		//Do work in the calling thread as well (only on its own job so its latency doesn't depend on other devices)
+		for (size_t ChunkIndex; PopChunk(s, 0, ChunkIndex);) ExecuteChunk(s, 0, ChunkIndex);
+
+		//Wait for threads to finish working
+		for (int32_t Left; (Left = Load32(&s.ChunksLeft.Value)) != 0;)
+			WaitForChange(s.ChunksLeft, Left, s.Spin, s.Sleeping);
+	}
+
+private:
+	enum { CHUNKSPERTHREAD = 8, MINCHUNKPIXELS = 16384, MAXSPIN = 1 << 12, MINSPIN = 1 << 6 };
+
+	struct ChunkRun
+	{
+		volatile int64_t Queue; //remaining chunk run packed as (begin << 32 | end)
+		char Padding[64 - sizeof(int64_t)]; //keeps the runs of different threads on separate cache lines
+	};
+
+	struct Slot
+	{
+		ProcessJob Job;
+		size_t ChunkRows, Spin;
+		ChunkRun* Runs;
+		volatile int32_t RunCount, Sleeping;
+		sParkWord ChunksLeft; //reaches 0 once every chunk has been executed
+		bool InUse;
+	};
+
+	struct Worker
+	{
+		ProcessPool* Pool;
+		size_t Index, Spin;
+		sThread Thread;
+	};
+
+	size_t ThreadCount, MaxSpin;
+	ChunkRun* Runs;
+	Worker* Workers;
+	Slot Slots[MAXSLOTS];
+	sParkWord Generation; //counts submitted jobs
+	volatile int32_t Sleepers, SlotCount, WorkersRunning; //Sleepers is set while threads are (about to be) parked so submitting can skip the wake up call
+
+	//Waits until Word no longer holds Value by spinning first and then parking, the spin limit adapts to how long waits usually take
+	void WaitForChange(sParkWord& Word, int32_t Value, size_t& Spin, volatile int32_t& SleepCount)
+	{
+		for (size_t i = 0; i != Spin; i++)
+		{
+			if (Load32(&Word.Value) != Value) { Spin = (Spin * 2 < MaxSpin ? Spin * 2 : MaxSpin); return; }
+			CpuRelax();
+		}
+		Spin = (Spin / 2 > MINSPIN || !MaxSpin ? Spin / 2 : MINSPIN);
+		AtomicAdd(&SleepCount, 1);
+		if (Load32(&Word.Value) == Value) Word.Wait(Value);
+		AtomicAdd(&SleepCount, -1);
+	}
+
+	static inline int64_t PackQueue(size_t Begin, size_t End) { return (int64_t)(((uint64_t)Begin << 32) | (uint64_t)End); }
+
+	//The owner takes chunks from the front of its run, other threads steal from the back
+	static bool PopRun(volatile int64_t& Queue, bool FromBack, size_t& Chunk)
+	{
+		for (;;)
+		{
+			const int64_t q = Load64(&Queue);
+			const size_t Begin = (size_t)((uint64_t)q >> 32), End = (size_t)(uint32_t)q;
+			if (Begin >= End) return false;
+			if (!CompareExchange64(&Queue, q, (FromBack ? PackQueue(Begin, End - 1) : PackQueue(Begin + 1, End)))) continue;
+			Chunk = (FromBack ? End - 1 : Begin);
+			return true;
+		}
+	}
+
+	//Runs only get refilled once all their chunks have been executed, so a stale run count of another slot just means a miss
+	static bool PopChunk(Slot& s, size_t Me, size_t& ChunkIndex)
+	{
+		const size_t RunCount = (size_t)Load32(&s.RunCount);
+		if (Me < RunCount && PopRun(s.Runs[Me].Queue, false, ChunkIndex)) return true;
+		for (size_t i = 1; i < RunCount; i++)
+			if (PopRun(s.Runs[(Me + i) % RunCount].Queue, true, ChunkIndex)) return true;
+		return false;
+	}
+
+	//Me is the index of the executing thread (0 for the one that submitted the job) which picks its memory for the filter resize
+	static void ExecuteChunk(Slot& s, size_t Me, size_t ChunkIndex)
+	{
+		//The job is read after taking the chunk, the slot can't get a new job before this chunk is counted as done
+		ProcessJob Chunk = s.Job;
+		Chunk.Worker = Me;
+		Chunk.RowStart = ChunkIndex * s.ChunkRows;
+		Chunk.RowEnd = (Chunk.RowStart + s.ChunkRows < s.Job.RowEnd ? Chunk.RowStart + s.ChunkRows : s.Job.RowEnd);
+		Chunk.Execute();
+		if (AtomicAdd(&s.ChunksLeft.Value, -1) == 0 && Load32(&s.Sleeping)) s.ChunksLeft.WakeAll();
+	}
+
+	//Executes one chunk of the next slot with work left (after the one served last) so every device gets a fair share
+	bool RunAnyChunk(size_t Me, size_t& NextSlot)
+	{
+		for (size_t n = 0, Count = (size_t)Load32(&SlotCount); n != Count; n++)
+		{
+			const size_t i = (NextSlot + n) % Count;
+			size_t ChunkIndex;
+			if (!PopChunk(Slots[i], Me, ChunkIndex)) continue;
+			ExecuteChunk(Slots[i], Me, ChunkIndex);
+			NextSlot = i + 1;
+			return true;
+		}
+		return false;
+	}
+
+	static void ProcessThread(void* p)
+	{
+		Worker* w = (Worker*)p;
+		ProcessPool* pp = w->Pool;
+		for (size_t NextSlot = 0;;)
+		{
+			//Reading the generation before looking for work makes sure a job submitted meanwhile ends the wait right away
+			const int32_t Gen = Load32(&pp->Generation.Value);
+			if (!Load32(&pp->WorkersRunning)) return;
+			if (pp->RunAnyChunk(w->Index, NextSlot)) continue;
+			pp->WaitForChange(pp->Generation, Gen, w->Spin, pp->Sleepers);
+		}
+	}
+};
+
+static ProcessPool* g_pProcessPool;
+static size_t g_ProcessPoolRefs;
+static ProcessSync::sSpinLock g_ProcessPoolLock;
+
+//Handle of a capture stream to the shared pool which gets created with the first and destroyed with the last handle
+struct ProcessWorkers
+{
+	ProcessWorkers()
+	{
+		g_ProcessPoolLock.Lock();
+		if (!g_pProcessPool) g_pProcessPool = new ProcessPool();
+		g_ProcessPoolRefs++;
+		Pool = g_pProcessPool;
+		Slot = Pool->AddClient();
+		g_ProcessPoolLock.Unlock();
+	}
+
+	~ProcessWorkers()
+	{
+		g_ProcessPoolLock.Lock();
+		Pool->RemoveClient(Slot);
+		if (--g_ProcessPoolRefs == 0) { delete g_pProcessPool; g_pProcessPool = NULL; }
+		g_ProcessPoolLock.Unlock();
+	}
+
+	void StartNewJob(const ProcessJob& NewJob) { Pool->Run(Slot, NewJob); }
+
+	size_t GetThreadCount() const { return Pool->GetThreadCount(); }
+
+private:
+	ProcessPool* Pool;
+	int Slot;
+
+	ProcessWorkers(const ProcessWorkers&);
+	ProcessWorkers& operator=(const ProcessWorkers&);
+};
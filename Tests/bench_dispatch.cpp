@@ -0,0 +1,54 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Overhead of dispatching a job to the worker pool and waiting for it: The job kernel only counts the rows it gets so the time per
+//call is what waking up the threads, handing out the chunks and signaling their completion costs
+
+#include "testing.h"
+#include "process.inl"
+#include "workers.inl"
+#include <vector>
+
+enum { MAXROWS = 8 * 16 };
+static volatile int32_t g_RowRuns[MAXROWS];
+
+static void CountRows(const ProcessJob& Job)
+{
+	for (size_t r = Job.RowStart; r != Job.RowEnd; r++) __sync_fetch_and_add(&g_RowRuns[r], 1);
+}
+
+int main()
+{
+	//Rows as wide as the smallest chunk the pool makes so every row becomes a chunk of its own
+	ProcessJob Job;
+	Job.Setup(ProcessJob::INPUT_RGBA8, ProcessJob::OUTPUT_BGRA8, false, ProcessJob::RESIZE_NONE);
+	Job.Kernel = CountRows, Job.Width = 16384, Job.RowStart = 0;
+
+	printf("microseconds per dispatch on %d processors (1 thread runs the job directly)\n%-12s  %19s  %19s\n", (int)ProcessPool::ProcessorCount(), "", "1 chunk per thread", "8 chunks per thread");
+	for (size_t Threads = 1; Threads <= 16; Threads *= 2)
+	{
+		ProcessPool Pool(Threads);
+		const int Slot = Pool.AddClient();
+		printf("%2d threads  ", (int)Threads);
+		for (size_t ChunksPerThread = 1; ChunksPerThread <= 8; ChunksPerThread *= 8)
+		{
+			Job.RowEnd = Threads * ChunksPerThread;
+			memset((void*)g_RowRuns, 0, sizeof(g_RowRuns));
+			size_t Calls = 0;
+			printf("  %19.2f", BenchMs([&] { Pool.Run(Slot, Job); Calls++; }, 0.3) * 1000.0);
+
+			//Every row has to have run exactly once per dispatch
+			for (size_t r = 0; r != MAXROWS; r++)
+				if (g_RowRuns[r] != (int32_t)(r < Job.RowEnd ? Calls : 0)) { printf(" (row %d ran %d of %d times)", (int)r, (int)g_RowRuns[r], (int)Calls); break; }
+		}
+		printf("\n");
+		Pool.RemoveClient(Slot);
+	}
+	return 0;
+}
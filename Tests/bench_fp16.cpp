@@ -0,0 +1,57 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Single threaded conversion of half float frames to BGR8 and BGRA8 through the 64k lookup table and through the F16C (AVX2)
+//and AVX-512 kernels, at 1080p and 4K
+
+#include "testing.h"
+#include "process.inl"
+#include <vector>
+
+int main()
+{
+	static const int Sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	const ProcessKernels F16C(ProcessKernels::LEVEL_AVX2), AVX512(ProcessKernels::LEVEL_AVX512);
+	printf("milliseconds per frame     table      F16C   AVX-512\n");
+	for (int s = 0; s != 2; s++)
+		for (int Linear = 0; Linear != 2; Linear++)
+			for (int Out = ProcessJob::OUTPUT_BGR8; Out <= ProcessJob::OUTPUT_BGRA8; Out++)
+			{
+				const int w = Sizes[s][0], h = Sizes[s][1];
+				std::vector<uint16_t> In((size_t)w * h * 4);
+				std::vector<uint8_t> Res(ProcessJob::OutputSize((ProcessJob::EOutput)Out, w, h)), Ref(Res.size());
+				for (size_t i = 0; i != In.size(); i++) In[i] = (uint16_t)((i * 2654435761u >> 7) % 0x3C01); //half floats in [0, 1]
+				std::vector<uint8_t> Table(ProcessToneMap::RGBA16TABLESIZE);
+				ProcessToneMap().BuildRGBA16Table(Table.data(), Linear != 0);
+
+				ProcessFrame Frame;
+				ProcessJob Job;
+				Frame.SetupJob(Job, (Linear ? ProcessJob::INPUT_RGBA16_LINEAR : ProcessJob::INPUT_RGBA16_GAMMA), In.data(), w, h, w, (ProcessJob::EOutput)Out, Ref.data(), w, h,
+					false, ProcessResizeMap::FILTER_NEAREST, ProcessJob::COLORSPACE_BT601_LIMITED, ProcessToneMap());
+				Job.RowKernel = NULL, Job.RGBA16Table = Table.data();
+				const double TableMs = BenchMs([&] { Job.Execute(); });
+
+				//The vector kernels of both levels, if the CPU has them (the F16C one only exists for gamma input)
+				double Ms[2] = { 0, 0 };
+				const ProcessKernels* Kernels[2] = { &F16C, &AVX512 };
+				const ProcessKernels::ELevel Levels[2] = { ProcessKernels::LEVEL_AVX2, ProcessKernels::LEVEL_AVX512 };
+				for (int k = 0; k != 2; k++)
+				{
+					ProcessRowFunc f = (Out == ProcessJob::OUTPUT_BGR8 ? Kernels[k]->RGBA16toBGR8[Linear] : Kernels[k]->RGBA16toBGRA8[Linear]);
+					if (!f || Kernels[k]->Level != Levels[k] || (k == 0 && !Kernels[k]->F16C)) continue;
+					Job.RowKernel = f, Job.BufOut = Res.data();
+					Ms[k] = BenchMs([&] { Job.Execute(); });
+					if (!Linear && memcmp(Res.data(), Ref.data(), Res.size())) printf("  (gamma output differs from the table)\n");
+				}
+				printf("%4dx%-4d %-6s %-4s  %8.2f", w, h, (Linear ? "linear" : "gamma"), (Out == ProcessJob::OUTPUT_BGR8 ? "BGR" : "BGRA"), TableMs);
+				for (int k = 0; k != 2; k++) { if (Ms[k]) printf("  %8.2f", Ms[k]); else printf("  %8s", "-"); }
+				printf("\n");
+			}
+	return 0;
+}
@@ -0,0 +1,48 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//ReadbackQueue (readback.inl) on the software device of readback_mock.h: Time a 60 fps render thread waits for the GPU and the
+//latency of the delivered frames by GPU latency and queue depth (on the simulated clock), and the CPU time of Push itself
+
+#include "testing.h"
+#include "readback_mock.h"
+
+typedef ReadbackQueue<MockDevice, MockFrame> Queue;
+
+int main()
+{
+	static const double Latencies[] = { 2, 10, 20, 45 };
+	const MockDevice::Desc d = { 64, 32 };
+	enum { FRAMES = 1000 };
+	printf("milliseconds per frame at 60 fps (copy takes 2 ms)   stalled  latency  textures\n");
+	for (size_t l = 0; l != sizeof(Latencies) / sizeof(Latencies[0]); l++)
+		for (int Depth = 1; Depth <= Queue::MAXDEPTH; Depth++)
+		{
+			Queue q;
+			q.Dev.GpuLatency = Latencies[l];
+			MockSink Sink(&q.Dev);
+			for (int i = 0; i != FRAMES; i++)
+			{
+				q.Dev.Now += 16.667;
+				const MockFrame f = { i, q.Dev.Now };
+				q.Push(i, d, Depth, f, Sink);
+			}
+			printf("GPU latency %4.1f ms, depth %d%-23s  %7.2f  %7.2f  %8d\n", Latencies[l], Depth, "", q.Dev.Stalled / FRAMES, Sink.Latency / Sink.Delivered.size(), q.Dev.Created);
+		}
+
+	//Copies that are done right away so only the queue itself gets measured
+	Queue q;
+	q.Dev.GpuLatency = 0, q.Dev.CopyCost = 0;
+	MockSink Sink(&q.Dev);
+	const MockDevice::Desc Pixel = { 1, 1 };
+	int Number = 0;
+	const double Ms = BenchMs([&] { for (int i = 0; i != 1000; i++, Number++) { const MockFrame f = { Number, q.Dev.Now += 1 }; q.Push(Number, Pixel, 3, f, Sink); } Sink.Delivered.clear(); });
+	printf("Push with depth 3: %.1f nanoseconds per frame\n", Ms * 1000.0);
+	return 0;
+}
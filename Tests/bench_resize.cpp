@@ -0,0 +1,72 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Single threaded RGBA8 to BGRA8 and NV12 conversion with resizing, the nearest neighbor resize against the bilinear and area filters,
+//and the cost of mirroring with and without resizing
+
+#include "testing.h"
+#include "process.inl"
+#include <vector>
+
+struct MirrorCase { const char* Name; ProcessJob::EInput In; ProcessJob::EOutput Out; int InW, InH, OutW, OutH; ProcessResizeMap::EFilter Filter; };
+
+int main()
+{
+	static const int Sizes[][4] = { { 3840, 2160, 1280, 720 }, { 3840, 2160, 480, 270 }, { 1920, 1080, 1280, 720 }, { 1280, 720, 1920, 1080 } };
+	static const ProcessJob::EOutput Outputs[] = { ProcessJob::OUTPUT_BGRA8, ProcessJob::OUTPUT_NV12 };
+	printf("milliseconds per frame         nearest  bilinear      area\n");
+	for (size_t s = 0; s != sizeof(Sizes) / sizeof(Sizes[0]); s++)
+		for (size_t o = 0; o != sizeof(Outputs) / sizeof(Outputs[0]); o++)
+		{
+			const int InW = Sizes[s][0], InH = Sizes[s][1], OutW = Sizes[s][2], OutH = Sizes[s][3];
+			std::vector<uint32_t> In((size_t)InW * InH);
+			std::vector<uint8_t> Out(ProcessJob::OutputSize(Outputs[o], OutW, OutH));
+			TestFillRandom(In.data(), In.size() * 4, 1);
+
+			printf("%4dx%-4d to %4dx%-4d %-5s", InW, InH, OutW, OutH, (Outputs[o] == ProcessJob::OUTPUT_NV12 ? "NV12" : "BGRA"));
+			for (int f = ProcessResizeMap::FILTER_NEAREST; f <= ProcessResizeMap::FILTER_AREA; f++)
+			{
+				ProcessFrame Frame;
+				ProcessJob Job;
+				Frame.SetupJob(Job, ProcessJob::INPUT_RGBA8, In.data(), InW, InH, InW, Outputs[o], Out.data(), OutW, OutH,
+					false, (ProcessResizeMap::EFilter)f, ProcessJob::COLORSPACE_BT709_LIMITED, ProcessToneMap());
+				printf("  %8.2f", BenchMs([&] { Job.Execute(); }));
+			}
+			printf("\n");
+		}
+
+	static const MirrorCase MirrorCases[] =
+	{
+		{ "1920x1080 RGBA8 to BGR8",         ProcessJob::INPUT_RGBA8,        ProcessJob::OUTPUT_BGR8,  1920, 1080, 1920, 1080, ProcessResizeMap::FILTER_NEAREST },
+		{ "1920x1080 FP16 to BGRA8",         ProcessJob::INPUT_RGBA16_GAMMA, ProcessJob::OUTPUT_BGRA8, 1920, 1080, 1920, 1080, ProcessResizeMap::FILTER_NEAREST },
+		{ "3840x2160 to 1280x720 nearest",   ProcessJob::INPUT_RGBA8,        ProcessJob::OUTPUT_BGR8,  3840, 2160, 1280,  720, ProcessResizeMap::FILTER_NEAREST },
+		{ "3840x2160 to 1280x720 bilinear",  ProcessJob::INPUT_RGBA8,        ProcessJob::OUTPUT_BGR8,  3840, 2160, 1280,  720, ProcessResizeMap::FILTER_BILINEAR },
+	};
+	printf("\nmilliseconds per frame           mirror off  mirror on\n");
+	for (size_t c = 0; c != sizeof(MirrorCases) / sizeof(MirrorCases[0]); c++)
+	{
+		const MirrorCase& k = MirrorCases[c];
+		std::vector<uint8_t> In((size_t)k.InW * k.InH * (k.In == ProcessJob::INPUT_RGBA8 ? 4 : 8)), Out(ProcessJob::OutputSize(k.Out, k.OutW, k.OutH));
+		TestFillRandom(In.data(), In.size(), (uint32_t)c);
+		if (k.In != ProcessJob::INPUT_RGBA8)
+			for (size_t i = 0; i != In.size() / 2; i++) ((uint16_t*)In.data())[i] = (uint16_t)((i * 2654435761u >> 7) % 0x3C01); //half floats in [0, 1]
+
+		printf("%-32s", k.Name);
+		for (int Mirror = 0; Mirror != 2; Mirror++)
+		{
+			ProcessFrame Frame;
+			ProcessJob Job;
+			Frame.SetupJob(Job, k.In, In.data(), k.InW, k.InH, k.InW, k.Out, Out.data(), k.OutW, k.OutH,
+				Mirror != 0, k.Filter, ProcessJob::COLORSPACE_BT709_LIMITED, ProcessToneMap());
+			printf("  %9.2f", BenchMs([&] { Job.Execute(); }));
+		}
+		printf("\n");
+	}
+	return 0;
+}
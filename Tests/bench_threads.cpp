@@ -0,0 +1,65 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Scaling of every kind of conversion job over the worker pool with 1 to 16 threads, counts above the number of processors show
+//what oversubscribing the machine costs
+
+#include "testing.h"
+#include "process.inl"
+#include "workers.inl"
+#include <vector>
+
+struct Case { const char* Name; ProcessJob::EInput In; ProcessJob::EOutput Out; int InW, InH, OutW, OutH; ProcessResizeMap::EFilter Filter; };
+
+int main()
+{
+	static const Case Cases[] =
+	{
+		{ "RGBA8 to BGR8",         ProcessJob::INPUT_RGBA8,         ProcessJob::OUTPUT_BGR8,   1920, 1080, 1920, 1080, ProcessResizeMap::FILTER_NEAREST },
+		{ "RGBA8 to BGRA8",        ProcessJob::INPUT_RGBA8,         ProcessJob::OUTPUT_BGRA8,  1920, 1080, 1920, 1080, ProcessResizeMap::FILTER_NEAREST },
+		{ "RGBA8 to NV12",         ProcessJob::INPUT_RGBA8,         ProcessJob::OUTPUT_NV12,   1920, 1080, 1920, 1080, ProcessResizeMap::FILTER_NEAREST },
+		{ "RGBA8 to YUY2",         ProcessJob::INPUT_RGBA8,         ProcessJob::OUTPUT_YUY2,   1920, 1080, 1920, 1080, ProcessResizeMap::FILTER_NEAREST },
+		{ "RGBA8 to I420",         ProcessJob::INPUT_RGBA8,         ProcessJob::OUTPUT_I420,   1920, 1080, 1920, 1080, ProcessResizeMap::FILTER_NEAREST },
+		{ "FP16 gamma to BGRA8",   ProcessJob::INPUT_RGBA16_GAMMA,  ProcessJob::OUTPUT_BGRA8,  1920, 1080, 1920, 1080, ProcessResizeMap::FILTER_NEAREST },
+		{ "FP16 linear to P010",   ProcessJob::INPUT_RGBA16_LINEAR, ProcessJob::OUTPUT_P010,   1920, 1080, 1920, 1080, ProcessResizeMap::FILTER_NEAREST },
+		{ "FP16 linear to ARGB64", ProcessJob::INPUT_RGBA16_LINEAR, ProcessJob::OUTPUT_ARGB64, 1920, 1080, 1920, 1080, ProcessResizeMap::FILTER_NEAREST },
+		{ "4K nearest to 1080p",   ProcessJob::INPUT_RGBA8,         ProcessJob::OUTPUT_BGR8,   3840, 2160, 1920, 1080, ProcessResizeMap::FILTER_NEAREST },
+		{ "4K bilinear to 1080p",  ProcessJob::INPUT_RGBA8,         ProcessJob::OUTPUT_BGR8,   3840, 2160, 1920, 1080, ProcessResizeMap::FILTER_BILINEAR },
+		{ "4K area to 1080p",      ProcessJob::INPUT_RGBA8,         ProcessJob::OUTPUT_BGR8,   3840, 2160, 1920, 1080, ProcessResizeMap::FILTER_AREA },
+	};
+	std::vector<size_t> Threads;
+	for (size_t n = 1; n <= 16; n *= 2) Threads.push_back(n);
+
+	printf("milliseconds per frame on %d processors, by thread count\n%-22s", (int)ProcessPool::ProcessorCount(), "");
+	for (size_t t = 0; t != Threads.size(); t++) printf("  %6d", (int)Threads[t]);
+	printf("\n");
+	for (size_t c = 0; c != sizeof(Cases) / sizeof(Cases[0]); c++)
+	{
+		const Case& k = Cases[c];
+		std::vector<uint8_t> In((size_t)k.InW * k.InH * (k.In == ProcessJob::INPUT_RGBA8 ? 4 : 8)), Out(ProcessJob::OutputSize(k.Out, k.OutW, k.OutH));
+		TestFillRandom(In.data(), In.size(), (uint32_t)c);
+		if (k.In != ProcessJob::INPUT_RGBA8)
+			for (size_t i = 0; i != In.size() / 2; i++) ((uint16_t*)In.data())[i] = (uint16_t)((i * 2654435761u >> 7) % 0x3C01); //half floats in [0, 1]
+
+		printf("%-22s", k.Name);
+		for (size_t t = 0; t != Threads.size(); t++)
+		{
+			ProcessPool Pool(Threads[t]);
+			const int Slot = Pool.AddClient();
+			ProcessFrame Frame;
+			ProcessJob Job;
+			Frame.SetupJob(Job, k.In, In.data(), k.InW, k.InH, k.InW, k.Out, Out.data(), k.OutW, k.OutH, false, k.Filter, ProcessJob::COLORSPACE_BT709_LIMITED, ProcessToneMap(), Pool.GetThreadCount());
+			printf("  %6.2f", BenchMs([&] { Pool.Run(Slot, Job); }, 0.3));
+			fflush(stdout);
+			Pool.RemoveClient(Slot);
+		}
+		printf("\n");
+	}
+	return 0;
+}
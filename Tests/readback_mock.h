@@ -0,0 +1,89 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Software device for the ReadbackQueue of readback.inl on a simulated clock: The GPU runs the copies in order, each one starts
+//GpuLatency milliseconds after it was queued at the earliest and takes CopyCost milliseconds. Mapping a texture whose copy hasn't
+//finished returns READBACKMAP_BUSY, or with Wait advances the clock to the end of the copy and counts that time as stalled.
+
+#include "readback.inl"
+#include <vector>
+
+struct MockDevice
+{
+	struct Texture { double Done; std::vector<uint8_t> Mem; int RowPitch; bool Mapped; };
+	typedef int Source; //frame number, the low byte fills the copy
+	struct Desc { int Width, Height; };
+
+	double Now, GpuLatency, CopyCost, GpuFree, Stalled;
+	int Live, Created, FailCreates, FailMaps, Errors;
+
+	MockDevice() : Now(0), GpuLatency(20), CopyCost(2), GpuFree(0), Stalled(0), Live(0), Created(0), FailCreates(0), FailMaps(0), Errors(0) {}
+
+	Texture* Create(const Desc& d)
+	{
+		if (FailCreates) { FailCreates--; return NULL; }
+		Texture* t = new Texture;
+		t->Mem.resize((size_t)d.Width * d.Height * 4), t->RowPitch = d.Width * 4, t->Mapped = false, t->Done = 0;
+		Live++, Created++;
+		return t;
+	}
+
+	void Release(Texture* t)
+	{
+		if (t->Mapped) Errors++;
+		delete t;
+		Live--;
+	}
+
+	void Copy(Texture* t, Source Src)
+	{
+		const double Start = (Now + GpuLatency > GpuFree ? Now + GpuLatency : GpuFree);
+		t->Done = GpuFree = Start + CopyCost;
+		memset(&t->Mem[0], Src & 0xFF, t->Mem.size());
+	}
+
+	EReadbackMap Map(Texture* t, bool Wait, const void*& Data, int& RowPitch)
+	{
+		if (t->Mapped) Errors++;
+		if (FailMaps) { FailMaps--; return READBACKMAP_FAILED; }
+		if (Now < t->Done)
+		{
+			if (!Wait) return READBACKMAP_BUSY;
+			Stalled += t->Done - Now, Now = t->Done;
+		}
+		t->Mapped = true, Data = &t->Mem[0], RowPitch = t->RowPitch;
+		return READBACKMAP_OK;
+	}
+
+	void Unmap(Texture* t)
+	{
+		if (!t->Mapped) Errors++;
+		t->Mapped = false;
+	}
+};
+
+//Frame passed along with every copy and the receiver of the delivered frames
+struct MockFrame { int Number; double Queued; };
+
+struct MockSink
+{
+	MockDevice* Dev;
+	std::vector<int> Delivered;
+	double Latency; //sum of the time from queuing to delivery
+	int WrongData;
+
+	MockSink(MockDevice* d) : Dev(d), Latency(0), WrongData(0) {}
+
+	void operator()(const MockFrame& f, const void* Data, int RowPitch)
+	{
+		if (*(const uint8_t*)Data != (uint8_t)f.Number || RowPitch <= 0) WrongData++;
+		Delivered.push_back(f.Number);
+		Latency += Dev->Now - f.Queued;
+	}
+};
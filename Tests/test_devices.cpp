@@ -0,0 +1,138 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Multi-device throughput over the shared memory transport: A sending process serves DEVICES capture numbers in turn and the receiving
+//process runs one thread per device like a capture stream of the filter, each converting the frames it receives to BGR8 with a
+//ProcessWorkers handle of its own. Checks that all of them share one pool, that every converted frame has the values of its device
+//and that no device gets starved, and reports the frames converted per second.
+
+#include "testing.h"
+#include "shared.inl"
+#include "process.inl"
+#include "workers.inl"
+#include <sched.h>
+#include <sys/wait.h>
+#include <vector>
+
+enum { DEVICES = 8, FIRST_CAPNUM = 40, WIDTH = 1920, HEIGHT = 1080, SECONDS = 2 };
+
+struct Shared { volatile int32_t Ready, Stop; };
+
+struct Device
+{
+	int Index;
+	Shared* s;
+	ProcessWorkers* Workers;
+	ProcessFrame Frame;
+	std::vector<uint8_t> Out;
+	uint32_t Converted, Wrong;
+	size_t ThreadCount;
+};
+
+//Pixels of frames of a device are R = device index, G = frame number, B = 0x55 and A = 0xFF
+static int RunSender(Shared* s)
+{
+	std::vector<SharedImageMemory*> Senders;
+	for (int d = 0; d != DEVICES; d++) Senders.push_back(new SharedImageMemory(FIRST_CAPNUM + d));
+	for (double Timeout = TestNow() + 10; s->Ready != DEVICES; usleep(1000))
+		if (TestNow() > Timeout) return 1;
+	for (int d = 0; d != DEVICES; d++) if (!Senders[d]->SendIsReady()) return 1;
+
+	std::vector<uint32_t> Buf((size_t)WIDTH * HEIGHT);
+	for (uint32_t Frame = 0; !s->Stop; Frame++)
+	{
+		for (int d = 0; d != DEVICES; d++)
+		{
+			const uint32_t Pixel = 0xFF550000u | ((Frame & 0xFF) << 8) | (uint32_t)d;
+			for (size_t i = 0; i != Buf.size(); i++) Buf[i] = Pixel;
+			Senders[d]->Send(WIDTH, HEIGHT, WIDTH, (uint32_t)(Buf.size() * 4), SharedImageMemory::FORMAT_UINT8, SharedImageMemory::RESIZEMODE_DISABLED,
+				SharedImageMemory::MIRRORMODE_DISABLED, 100, (uint8_t*)Buf.data());
+		}
+		sched_yield();
+	}
+	for (int d = 0; d != DEVICES; d++) delete Senders[d];
+	return 0;
+}
+
+static void OnFrame(int width, int height, int stride, SharedImageMemory::EFormat format, SharedImageMemory::EResizeMode, SharedImageMemory::EMirrorMode, int, uint8_t* buffer, void* callback_data)
+{
+	Device& d = *(Device*)callback_data;
+	if (width != WIDTH || height != HEIGHT || format != SharedImageMemory::FORMAT_UINT8) { d.Wrong++; return; }
+	ProcessJob Job;
+	if (!d.Frame.SetupJob(Job, ProcessJob::INPUT_RGBA8, buffer, width, height, stride, ProcessJob::OUTPUT_BGR8, d.Out.data(), WIDTH, HEIGHT,
+		false, ProcessResizeMap::FILTER_NEAREST, ProcessJob::COLORSPACE_BT601_LIMITED, ProcessToneMap(), d.Workers->GetThreadCount())) { d.Wrong++; return; }
+	d.Workers->StartNewJob(Job);
+
+	//Every pixel has to be the first pixel of the received frame, which has to belong to this device
+	const uint8_t Expected[3] = { 0x55, buffer[1], (uint8_t)d.Index };
+	bool Same = !memcmp(d.Out.data(), Expected, 3);
+	for (size_t i = 3; Same && i != (size_t)WIDTH * 3; i += 3) Same = !memcmp(d.Out.data() + i, Expected, 3);
+	for (size_t y = 1; Same && y != HEIGHT; y++) Same = !memcmp(d.Out.data() + y * WIDTH * 3, d.Out.data(), WIDTH * 3);
+	if (Same) d.Converted++; else d.Wrong++;
+}
+
+static void RunDevice(void* p)
+{
+	Device& d = *(Device*)p;
+	SharedImageMemory Receiver(FIRST_CAPNUM + d.Index);
+	ProcessWorkers Workers;
+	d.Workers = &Workers, d.ThreadCount = Workers.GetThreadCount();
+	Receiver.Receive(OnFrame, &d, 1); //creates the capture number
+	__sync_fetch_and_add(&d.s->Ready, 1);
+	while (!d.s->Stop) Receiver.Receive(OnFrame, &d, 100);
+}
+
+int main()
+{
+	for (int d = 0; d != DEVICES; d++) TestRemoveShared(FIRST_CAPNUM + d);
+	Shared* s = (Shared*)mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	memset(s, 0, sizeof(Shared));
+	fflush(stdout);
+	const pid_t Pid = fork();
+	if (Pid == 0) { const int Res = RunSender(s); fflush(stdout); _exit(Res); }
+
+	Device Devices[DEVICES];
+	double Start = 0, Seconds = 0;
+	{
+		ProcessSync::sThread Threads[DEVICES];
+		for (int d = 0; d != DEVICES; d++)
+		{
+			Devices[d].Index = d, Devices[d].s = s, Devices[d].Converted = Devices[d].Wrong = 0;
+			Devices[d].Out.resize((size_t)WIDTH * HEIGHT * 3);
+			Threads[d].Start(RunDevice, &Devices[d]);
+		}
+		for (double Timeout = TestNow() + 10; s->Ready != DEVICES && TestNow() < Timeout;) usleep(1000);
+		TEST_CHECK(s->Ready == DEVICES);
+		TEST_CHECK(g_pProcessPool && g_ProcessPoolRefs == DEVICES); //one pool for all devices
+		Start = TestNow();
+		usleep(SECONDS * 1000000);
+		Seconds = TestNow() - Start;
+		s->Stop = 1;
+	} //waits for the threads to end
+
+	int Status = 0;
+	waitpid(Pid, &Status, 0);
+	TEST_CHECK(WIFEXITED(Status) && WEXITSTATUS(Status) == 0);
+	TEST_CHECK(g_pProcessPool == NULL);
+
+	uint32_t Total = 0, Min = 0xFFFFFFFF;
+	printf("%d devices at %dx%d on %d worker threads, frames converted per second:", DEVICES, WIDTH, HEIGHT, (int)Devices[0].ThreadCount);
+	for (int d = 0; d != DEVICES; d++)
+	{
+		printf(" %.1f", Devices[d].Converted / Seconds);
+		Total += Devices[d].Converted;
+		if (Devices[d].Converted < Min) Min = Devices[d].Converted;
+		TEST_CHECK(Devices[d].Wrong == 0);
+		TEST_CHECK(Devices[d].ThreadCount == ProcessPool::DefaultThreadCount());
+	}
+	printf(", total %.1f\n", Total / Seconds);
+	TEST_CHECK(Min > 0 && Min >= Total / DEVICES / 4); //no device starves
+	for (int d = 0; d != DEVICES; d++) TestRemoveShared(FIRST_CAPNUM + d);
+	return TestResult("test_devices");
+}
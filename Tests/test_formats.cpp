@@ -0,0 +1,316 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Compares the YUV (NV12, YUY2, I420, P010) and 16 bit RGB (RGB48, ARGB64) kernels, the half float row kernels and the resize filter
+//passes of every kernel set the CPU supports against the scalar ones, and all of them against a double precision reference computed
+//here from the formulas (color space matrices, tone mapping curves, sRGB), for every color space, tone mapping, input format and
+//mirroring with row gaps of odd length
+
+#include "testing.h"
+#include "process.inl"
+#include <vector>
+
+static const char* LevelNames[] = { "scalar", "SSSE3", "AVX2", "AVX-512" };
+
+//Source value of a half float in double precision, infinity and NaN are read as 65536 like the last entry of the float table
+static double HalfValue(uint16_t h)
+{
+	if (h & 0x8000) return 0;
+	if (h >= 0x7C00) return 65536.0;
+	return (h < 0x400 ? ldexp((double)h, -24) : ldexp((double)(0x400 | (h & 0x3FF)), (int)(h >> 10) - 25));
+}
+
+static double SRGBEncodeRef(double f) { return (f <= 0.0031308 ? f * 12.92 : pow(f, 1.0 / 2.4) * 1.055 - 0.055); }
+static double SRGBDecodeRef(double f) { return (f <= 0.04045 ? f / 12.92 : pow((f + 0.055) / 1.055, 2.4)); }
+static double HableRef(double x) { return ((x * (0.15 * x + 0.05) + 0.004) / (x * (0.15 * x + 0.5) + 0.06)) - 0.02 / 0.3; }
+
+//Output value in [0, 1] of a half float color channel, the same steps as ProcessToneMap::Map
+static double ToneMapRef(uint16_t h, bool Linear, const ProcessToneMap& t)
+{
+	double f = HalfValue(h);
+	if (t.IsOff()) { f = (f < 1 ? f : 1); return (Linear ? SRGBEncodeRef(f) : f); }
+	f = (Linear ? f : SRGBDecodeRef(f)) * ldexp(1.0, t.Exposure);
+	if (t.Operator == ProcessToneMap::TONEMAP_REINHARD) f = f / (1 + f);
+	if (t.Operator == ProcessToneMap::TONEMAP_ACES)     f = (f * (2.51 * f + 0.03)) / (f * (2.43 * f + 0.59) + 0.14);
+	if (t.Operator == ProcessToneMap::TONEMAP_HABLE)    f = HableRef(f * 2) / HableRef(11.2);
+	return SRGBEncodeRef(f < 1 ? f : 1);
+}
+
+//Channels R, G, B, A in [0, 1] of the source pixel at x, y, alpha of half floats is only clamped (or mapped like the colors into 8 bits
+//from linear input without tone mapping, see ProcessToneMap::BuildRGBA16Table)
+static void SourcePixel(ProcessJob::EInput In, const void* Buf, size_t Stride, size_t x, size_t y, const ProcessToneMap& t, bool Alpha8, double c[4])
+{
+	if (In == ProcessJob::INPUT_RGBA8 || In == ProcessJob::INPUT_BGRA8)
+	{
+		const uint8_t* p = (const uint8_t*)Buf + (y * Stride + x) * 4;
+		for (int i = 0; i != 4; i++) c[i] = p[In == ProcessJob::INPUT_BGRA8 && i != 3 ? 2 - i : i] / 255.0;
+		return;
+	}
+	const bool Linear = (In == ProcessJob::INPUT_RGBA16_LINEAR);
+	const uint16_t* p = (const uint16_t*)Buf + (y * Stride + x) * 4;
+	for (int i = 0; i != 3; i++) c[i] = ToneMapRef(p[i], Linear, t);
+	c[3] = (Alpha8 && t.IsOff() ? ToneMapRef(p[3], Linear, t) : ToneMapRef(p[3], false, ProcessToneMap()));
+}
+
+//Checks every output value against the reference, YUV and 16 bit values get rounded to nearest and the 8-bit ones truncated like the table
+static void CheckReference(ProcessJob::EInput In, const void* Buf, size_t w, size_t h, size_t Stride, ProcessJob::EOutput Out, const uint8_t* Res,
+	bool Mirror, ProcessJob::EColorSpace ColorSpace, const ProcessToneMap& t)
+{
+	const bool TopDown = ProcessJob::IsTopDown(Out), P010 = (Out == ProcessJob::OUTPUT_P010);
+	const bool BT709 = (ColorSpace == ProcessJob::COLORSPACE_BT709_LIMITED || ColorSpace == ProcessJob::COLORSPACE_BT709_FULL);
+	const bool Full = (ColorSpace == ProcessJob::COLORSPACE_BT601_FULL || ColorSpace == ProcessJob::COLORSPACE_BT709_FULL);
+	const double Kr = (BT709 ? 0.2126 : 0.299), Kb = (BT709 ? 0.0722 : 0.114), Kg = 1 - Kr - Kb, Unit = (P010 ? 4 : 1), Max = (P010 ? 1023 : 255);
+	const double Ys = (Full ? Max : 219 * Unit), Cs = (Full ? Max : 224 * Unit), Y0 = (Full ? 0 : 16 * Unit), C0 = 128 * Unit;
+	double MaxError = 0;
+	for (size_t y = 0; y != h; y++)
+		for (size_t x = 0; x != w; x++)
+		{
+			double c[4], Value[4];
+			const size_t sx = (Mirror ? w - 1 - x : x), sy = (TopDown ? h - 1 - y : y);
+			SourcePixel(In, Buf, Stride, sx, sy, t, !TopDown, c);
+			if (Out == ProcessJob::OUTPUT_BGR8 || Out == ProcessJob::OUTPUT_BGRA8)
+			{
+				const size_t BPP = (Out == ProcessJob::OUTPUT_BGR8 ? 3 : 4);
+				for (size_t i = 0; i != BPP; i++)
+				{
+					const double e = fabs(Res[(y * w + x) * BPP + i] - floor(c[i == 3 ? 3 : 2 - i] * 255.9999));
+					MaxError = (e > MaxError ? e : MaxError);
+				}
+				continue;
+			}
+			if (Out == ProcessJob::OUTPUT_RGB48 || Out == ProcessJob::OUTPUT_ARGB64)
+			{
+				const size_t BPP = (Out == ProcessJob::OUTPUT_RGB48 ? 6 : 8);
+				const uint8_t* p = Res + (y * w + x) * BPP;
+				Value[0] = c[3], Value[1] = c[0], Value[2] = c[1], Value[3] = c[2];
+				for (size_t i = (BPP == 6 ? 1 : 0), o = 0; i != 4; i++, o += 2)
+				{
+					const double e = fabs(((p[o] << 8) | p[o + 1]) - Value[i] * 65535);
+					MaxError = (e > MaxError ? e : MaxError);
+				}
+				continue;
+			}
+
+			//Luma of this pixel, chroma of the 2x2 (2x1 for YUY2) pixels starting at the even coordinates from the top left of the output
+			const double Luma = (Kr * c[0] + Kg * c[1] + Kb * c[2]) * Ys + Y0;
+			double Sum[3] = { 0, 0, 0 }, n = 0;
+			for (size_t cy = (Out == ProcessJob::OUTPUT_YUY2 ? y : y & ~1); cy <= (y | 1) && cy < h; cy += 1 + (Out == ProcessJob::OUTPUT_YUY2))
+				for (size_t cx = x & ~1; cx <= (x | 1); cx++, n++)
+				{
+					double s[4];
+					SourcePixel(In, Buf, Stride, (Mirror ? w - 1 - cx : cx), h - 1 - cy, t, false, s);
+					Sum[0] += s[0], Sum[1] += s[1], Sum[2] += s[2];
+				}
+			const double U = (-Kr / (2 - 2 * Kb) * Sum[0] - Kg / (2 - 2 * Kb) * Sum[1] + 0.5 * Sum[2]) / n * Cs + C0;
+			const double V = (0.5 * Sum[0] - Kg / (2 - 2 * Kr) * Sum[1] - Kb / (2 - 2 * Kr) * Sum[2]) / n * Cs + C0;
+			double LumaOut, UOut, VOut;
+			if (Out == ProcessJob::OUTPUT_YUY2)
+			{
+				const uint8_t* p = Res + (y * w + (x & ~1)) * 2;
+				LumaOut = p[(x & 1) * 2], UOut = p[1], VOut = p[3];
+			}
+			else if (P010)
+			{
+				const uint16_t *Y = (const uint16_t*)Res, *UV = Y + w * h + (y / 2) * w + (x & ~1);
+				LumaOut = Y[y * w + x] >> 6, UOut = UV[0] >> 6, VOut = UV[1] >> 6;
+			}
+			else
+			{
+				const uint8_t *Chroma = Res + w * h;
+				LumaOut = Res[y * w + x];
+				if (Out == ProcessJob::OUTPUT_NV12) UOut = Chroma[(y / 2) * w + (x & ~1)], VOut = Chroma[(y / 2) * w + (x | 1)];
+				else UOut = Chroma[(y / 2) * (w / 2) + x / 2], VOut = Chroma[(w / 2) * (h / 2) + (y / 2) * (w / 2) + x / 2];
+			}
+			Value[0] = Luma, Value[1] = U, Value[2] = V;
+			const double Got[3] = { LumaOut, UOut, VOut };
+			for (int i = 0; i != 3; i++)
+			{
+				const double e = fabs(Got[i] - (Value[i] < 0 ? 0 : (Value[i] > Max ? Max : Value[i])));
+				MaxError = (e > MaxError ? e : MaxError);
+			}
+		}
+	TEST_CHECK(MaxError <= (Out <= ProcessJob::OUTPUT_BGRA8 ? 1.0 : 0.51));
+}
+
+//Kernel of the set k in the same slot as the kernel g_ProcessKernels handed to the job
+template <class Func> static Func SameSlot(Func f, const Func* From, const Func* To, size_t n)
+{
+	for (size_t i = 0; i != n; i++) if (f && From[i] == f) return To[i];
+	return f;
+}
+
+static void UseKernels(ProcessJob& Job, const ProcessKernels& k)
+{
+	const ProcessKernels& g = g_ProcessKernels;
+	const ProcessRowFunc From[4] = { g.RGBA16toBGR8[0], g.RGBA16toBGR8[1], g.RGBA16toBGRA8[0], g.RGBA16toBGRA8[1] };
+	const ProcessRowFunc To[4] = { k.RGBA16toBGR8[0], k.RGBA16toBGR8[1], k.RGBA16toBGRA8[0], k.RGBA16toBGRA8[1] };
+	Job.RowKernel = SameSlot(Job.RowKernel, From, To, 4);
+	Job.YUVKernel = SameSlot(Job.YUVKernel, &g.ToYUV[0][0], &k.ToYUV[0][0], 4 * 4);
+	Job.RGB16Kernel = SameSlot(Job.RGB16Kernel, &g.ToRGB16[0][0], &k.ToRGB16[0][0], 5 * 2);
+}
+
+//Random half floats mostly in [0, 8) with some negative values, denormals, infinity and NaN
+static void FillHalf(uint16_t* p, size_t n, uint32_t Seed)
+{
+	for (size_t i = 0; i != n; i++)
+	{
+		Seed = Seed * 1664525u + 1013904223u;
+		uint16_t h = (uint16_t)((Seed >> 8) % 0x4800);
+		if ((Seed >> 28) == 0) h |= 0x8000;
+		if ((Seed >> 26) == 63) h = ((Seed >> 24) & 1 ? 0x7C00 : 0x7E00);
+		if ((Seed >> 24) == 254) h = (uint16_t)((Seed >> 8) & 0x3FF);
+		p[i] = h;
+	}
+}
+
+//The blend passes of the resize filter against the scalar ones and the weighted sums in double precision, with the weights
+//of an area filter (not negative and adding up to 1.0 in 2.14 fixed point) for all lengths around the vector blocks
+static void CheckFilters(const ProcessKernels& k)
+{
+	enum { N = 80, TAPS = 8 };
+	for (size_t Taps = 2; Taps <= TAPS; Taps += 2)
+		for (size_t n = 0; n <= N; n++)
+		{
+			uint8_t Src8[TAPS][N * 4];
+			float SrcF[TAPS][N * 4];
+			int16_t Weights[N * TAPS], Blend16[(N + TAPS) * 4], Ref16[N * 4];
+			float BlendF[(N + TAPS) * 4], RefF[N * 4];
+			uint32_t Index[N];
+			TestFillRandom(Src8, sizeof(Src8), (uint32_t)(Taps * 131 + n));
+			for (size_t t = 0; t != TAPS; t++)
+				for (size_t i = 0; i != N * 4; i++) SrcF[t][i] = Src8[t][i] * (1.0f / 256.0f) + Src8[(t + 1) % TAPS][i] * (1.0f / 65536.0f);
+			for (size_t i = 0; i != N; i++)
+			{
+				int Sum = 0;
+				for (size_t t = 0; t != Taps; t++) Sum += (Weights[i * Taps + t] = (int16_t)(Src8[t][i] * 16384 / (Taps * 255)));
+				Weights[i * Taps] = (int16_t)(Weights[i * Taps] + 16384 - Sum);
+				Index[i] = (uint32_t)((i * 7) % (N - Taps + 1));
+			}
+
+			//Vertical pass (weights of the first output row for all channels)
+			const uint8_t* Rows8[TAPS];
+			const float* RowsF[TAPS];
+			for (size_t t = 0; t != Taps; t++) Rows8[t] = Src8[t], RowsF[t] = SrcF[t];
+			memset(Blend16, 0, sizeof(Blend16)), memset(BlendF, 0, sizeof(BlendF));
+			k.FilterV(Rows8, Weights, Taps, Blend16, n * 4);
+			k.FilterVFloat(RowsF, Weights, Taps, BlendF, n * 4);
+			ProcessKernels::FilterV_Scalar(Rows8, Weights, Taps, Ref16, n * 4);
+			ProcessKernels::FilterVFloat_Scalar(RowsF, Weights, Taps, RefF, n * 4);
+			TEST_CHECK(!memcmp(Blend16, Ref16, n * 4 * sizeof(int16_t)) && !memcmp(BlendF, RefF, n * 4 * sizeof(float)));
+			for (size_t i = 0; i != n * 4; i++)
+			{
+				double Sum8 = 0, SumF = 0;
+				for (size_t t = 0; t != Taps; t++) Sum8 += Src8[t][i] * (Weights[t] / 16384.0), SumF += SrcF[t][i] * (Weights[t] / 16384.0);
+				TEST_CHECK(fabs(Blend16[i] / 128.0 - Sum8) <= 0.5 / 128 && fabs(BlendF[i] - SumF) <= 1e-6);
+			}
+
+			//Horizontal pass of the 8-bit filter into BGR8 and BGRA8 and of the float filter into 16 bit RGBA
+			for (size_t BPP = 3; BPP <= 4; BPP++)
+			{
+				uint8_t Res[N * 4 + 16], Ref[N * 4 + 16];
+				memset(Res, 0xCD, sizeof(Res)), memset(Ref, 0xCD, sizeof(Ref));
+				k.FilterH(Blend16, Index, Weights, Taps, Res, n, BPP);
+				ProcessKernels::FilterH_Scalar(Blend16, Index, Weights, Taps, Ref, n, BPP);
+				TEST_CHECK(!memcmp(Res, Ref, sizeof(Res)));
+				for (size_t i = 0; i != n * BPP; i++)
+				{
+					double Sum = 0;
+					for (size_t t = 0; t != Taps; t++) Sum += Blend16[(Index[i / BPP] + t) * 4 + i % BPP] / 128.0 * (Weights[i / BPP * Taps + t] / 16384.0);
+					TEST_CHECK(fabs(Res[i] - (Sum > 255 ? 255 : Sum)) <= 0.5 + 1e-9);
+				}
+			}
+			uint16_t Res16[N * 4 + 8], RefOut16[N * 4 + 8];
+			memset(Res16, 0xCD, sizeof(Res16)), memset(RefOut16, 0xCD, sizeof(RefOut16));
+			k.FilterHFloat(BlendF, Index, Weights, Taps, 65535.0f, Res16, n);
+			ProcessKernels::FilterHFloat_Scalar(BlendF, Index, Weights, Taps, 65535.0f, RefOut16, n);
+			TEST_CHECK(!memcmp(Res16, RefOut16, sizeof(Res16)));
+			for (size_t i = 0; i != n * 4; i++)
+			{
+				double Sum = 0;
+				for (size_t t = 0; t != Taps; t++) Sum += BlendF[(Index[i / 4] + t) * 4 + i % 4] * (Weights[i / 4 * Taps + t] / 16384.0);
+				TEST_CHECK(fabs(Res16[i] - (Sum > 1 ? 1 : Sum) * 65535) <= 0.51);
+			}
+		}
+}
+
+int main()
+{
+	const ProcessKernels::ELevel Detected = ProcessKernels::DetectLevel();
+	printf("CPU supports %s kernels%s\n", LevelNames[Detected], (ProcessKernels::DetectF16C() ? " and F16C" : ""));
+
+	//Every level the CPU supports, from AVX2 on also without F16C which has kernels of its own for the half float input
+	std::vector<ProcessKernels> Sets;
+	for (int l = ProcessKernels::LEVEL_SCALAR; l <= Detected; l++)
+	{
+		Sets.push_back(ProcessKernels((ProcessKernels::ELevel)l));
+		if (l >= ProcessKernels::LEVEL_AVX2 && Sets.back().F16C) Sets.push_back(ProcessKernels((ProcessKernels::ELevel)l, false));
+	}
+	std::vector<int> SetFailures(Sets.size(), 0);
+
+	static const ProcessJob::EInput Inputs[] = { ProcessJob::INPUT_RGBA8, ProcessJob::INPUT_BGRA8, ProcessJob::INPUT_RGBA16_GAMMA, ProcessJob::INPUT_RGBA16_LINEAR };
+	static const ProcessToneMap ToneMaps[] = { ProcessToneMap(), ProcessToneMap(ProcessToneMap::TONEMAP_CLAMP, 1), ProcessToneMap(ProcessToneMap::TONEMAP_REINHARD, 0),
+		ProcessToneMap(ProcessToneMap::TONEMAP_ACES, 2), ProcessToneMap(ProcessToneMap::TONEMAP_HABLE, -1) };
+	static const size_t Sizes[][3] = { { 2, 2, 3 }, { 34, 4, 37 }, { 70, 6, 75 }, { 130, 2, 131 } }; //width, height, stride (odd row gaps)
+	std::vector<uint8_t> RGBA16Table(ProcessToneMap::RGBA16TABLESIZE);
+	ProcessFrame Frame; //keeps the float table while the input and tone mapping stay the same
+	for (size_t i = 0; i != sizeof(Inputs) / sizeof(Inputs[0]); i++)
+	{
+		const ProcessJob::EInput In = Inputs[i];
+		const bool Half = (In == ProcessJob::INPUT_RGBA16_GAMMA || In == ProcessJob::INPUT_RGBA16_LINEAR);
+		for (size_t m = 0; m != (Half ? sizeof(ToneMaps) / sizeof(ToneMaps[0]) : 1); m++)
+		{
+			//The job only has the 8-bit table if its row kernel needs it, the scalar sets do
+			if (Half) ToneMaps[m].BuildRGBA16Table(RGBA16Table.data(), In == ProcessJob::INPUT_RGBA16_LINEAR);
+			for (int Out = (Half ? ProcessJob::OUTPUT_BGR8 : ProcessJob::OUTPUT_NV12); Out <= ProcessJob::OUTPUT_ARGB64; Out++)
+				for (int cs = 0; cs != (ProcessJob::IsYUV((ProcessJob::EOutput)Out) ? 4 : 1); cs++)
+					for (size_t s = 0; s != sizeof(Sizes) / sizeof(Sizes[0]); s++)
+						for (int Mirror = 0; Mirror != 2; Mirror++)
+						{
+							const size_t w = Sizes[s][0], h = Sizes[s][1], Stride = Sizes[s][2], Size = ProcessJob::OutputSize((ProcessJob::EOutput)Out, w, h);
+							std::vector<uint16_t> Src(Stride * h * 4);
+							if (Half) FillHalf(Src.data(), Src.size(), (uint32_t)(i * 1000 + m * 100 + s * 10 + Mirror));
+							else TestFillRandom(Src.data(), Src.size() * 2, (uint32_t)(i * 1000 + s * 10 + Mirror));
+
+							std::vector<uint8_t> Ref, Res;
+							for (size_t k = 0; k != Sets.size(); k++)
+							{
+								const int Failures = g_TestFailures;
+								Res.assign(Size + 64, 0xCD);
+								ProcessJob Job;
+								TEST_CHECK(Frame.SetupJob(Job, In, Src.data(), (int)w, (int)h, (int)Stride, (ProcessJob::EOutput)Out, Res.data(), (int)w, (int)h,
+									Mirror != 0, ProcessResizeMap::FILTER_NEAREST, (ProcessJob::EColorSpace)cs, ToneMaps[m]));
+								UseKernels(Job, Sets[k]);
+								Job.RGBA16Table = RGBA16Table.data();
+								Job.Execute();
+								TEST_CHECK(Res[Size] == 0xCD);
+								if (k == 0) { Ref = Res; CheckReference(In, Src.data(), w, h, Stride, (ProcessJob::EOutput)Out, Res.data(), Mirror != 0, (ProcessJob::EColorSpace)cs, ToneMaps[m]); }
+
+								//The sRGB encode of the AVX-512 row kernels for linear input is at most off by 1 from the table
+								const int MaxDiff = (Out <= ProcessJob::OUTPUT_BGRA8 && In == ProcessJob::INPUT_RGBA16_LINEAR ? 1 : 0);
+								for (size_t b = 0; b != Size && k; b++) if (abs(Res[b] - Ref[b]) > MaxDiff) { TEST_CHECK(abs(Res[b] - Ref[b]) <= MaxDiff); break; }
+								if (g_TestFailures != Failures)
+								{
+									printf("  %s%s input %d output %d color space %d tone map %d/%d size %dx%d mirror %d\n", LevelNames[Sets[k].Level], (Sets[k].F16C ? "" : " without F16C"),
+										(int)In, Out, cs, (int)ToneMaps[m].Operator, ToneMaps[m].Exposure, (int)w, (int)h, Mirror);
+									SetFailures[k]++;
+								}
+							}
+						}
+		}
+	}
+
+	for (size_t k = 0; k != Sets.size(); k++)
+	{
+		const int Failures = g_TestFailures;
+		CheckFilters(Sets[k]);
+		printf("%-8s kernels%s: %s\n", LevelNames[Sets[k].Level], (Sets[k].Level >= ProcessKernels::LEVEL_AVX2 && !Sets[k].F16C ? " without F16C" : ""),
+			(g_TestFailures == Failures && !SetFailures[k] ? "match the scalar and double precision reference" : "MISMATCH"));
+	}
+	return TestResult("test_formats");
+}
@@ -0,0 +1,91 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Compares the RGBA8 to BGR8/BGRA8 row kernels of every level the CPU supports against the scalar reference, for all lengths
+//around the 16 pixel (48 byte BGR) blocks and for whole jobs with row gaps (RGBAInStride != Width) and mirroring
+
+#include "testing.h"
+#include "process.inl"
+#include <vector>
+
+static const char* LevelNames[] = { "scalar", "SSSE3", "AVX2", "AVX-512" };
+
+//Converts n pixels with the kernel at src + Offset and checks the result and that nothing after the n pixels got written
+static void CheckRow(ProcessRowFunc Kernel, ProcessRowFunc Reference, size_t BPP, size_t n, size_t Offset)
+{
+	enum { GUARD = 64 };
+	std::vector<uint8_t> In(n * 4 + Offset), Out(n * BPP + Offset + GUARD, 0xCD), Ref(n * BPP + Offset + GUARD, 0xCD);
+	TestFillRandom(In.data(), In.size(), (uint32_t)(n * 31 + Offset));
+	Kernel(In.data() + Offset, Out.data() + Offset, n);
+	Reference(In.data() + Offset, Ref.data() + Offset, n);
+	TEST_CHECK(!memcmp(Out.data(), Ref.data(), Out.size()));
+}
+
+//Independent per pixel reference of a whole job without resizing, the output rows are packed and in the order of the source rows
+static void ReferenceJob(const std::vector<uint32_t>& In, size_t Width, size_t Height, size_t Stride, bool Mirror, size_t BPP, std::vector<uint8_t>& Out)
+{
+	Out.assign(Width * Height * BPP, 0);
+	for (size_t y = 0; y != Height; y++)
+		for (size_t x = 0; x != Width; x++)
+		{
+			const uint32_t p = In[y * Stride + (Mirror ? Width - 1 - x : x)];
+			uint8_t* d = &Out[(y * Width + x) * BPP];
+			d[0] = (uint8_t)(p >> 16), d[1] = (uint8_t)(p >> 8), d[2] = (uint8_t)p;
+			if (BPP == 4) d[3] = (uint8_t)(p >> 24);
+		}
+}
+
+int main()
+{
+	const ProcessKernels::ELevel Detected = ProcessKernels::DetectLevel();
+	printf("CPU supports %s kernels\n", LevelNames[Detected]);
+
+	for (int l = ProcessKernels::LEVEL_SCALAR; l <= Detected; l++)
+	{
+		const ProcessKernels k((ProcessKernels::ELevel)l);
+		TEST_CHECK(k.Level == l);
+		ProcessRowFunc ToBGR8 = (k.RGBA8toBGR8 ? k.RGBA8toBGR8 : ProcessKernels::RGBA8toBGR8_Scalar);
+		ProcessRowFunc ToBGRA8 = (k.RGBA8toBGRA8 ? k.RGBA8toBGRA8 : ProcessKernels::RGBA8toBGRA8_Scalar);
+		const int Failures = g_TestFailures;
+
+		//All lengths up to a few blocks (the remainder after the 48 byte blocks goes through the scalar code), a full HD row and unaligned buffers
+		for (size_t n = 0; n <= 80; n++)
+			for (size_t Offset = 0; Offset != 4; Offset++)
+			{
+				CheckRow(ToBGR8, ProcessKernels::RGBA8toBGR8_Scalar, 3, n, Offset * 4);
+				CheckRow(ToBGRA8, ProcessKernels::RGBA8toBGRA8_Scalar, 4, n, Offset * 4);
+			}
+		CheckRow(ToBGR8, ProcessKernels::RGBA8toBGR8_Scalar, 3, 1920, 0);
+		CheckRow(ToBGRA8, ProcessKernels::RGBA8toBGRA8_Scalar, 4, 1920, 4);
+
+		//Whole jobs through the kernel with the row kernel of this level, with and without gaps between the source rows
+		static const size_t Sizes[][3] = { { 64, 8, 64 }, { 100, 7, 128 }, { 37, 5, 40 }, { 1920, 4, 1920 }, { 1917, 3, 2048 } }; //width, height, stride
+		for (size_t s = 0; s != sizeof(Sizes) / sizeof(Sizes[0]); s++)
+			for (int Out = ProcessJob::OUTPUT_BGR8; Out <= ProcessJob::OUTPUT_BGRA8; Out++)
+				for (int Mirror = 0; Mirror != 2; Mirror++)
+				{
+					const size_t w = Sizes[s][0], h = Sizes[s][1], Stride = Sizes[s][2], BPP = (Out == ProcessJob::OUTPUT_BGR8 ? 3 : 4);
+					std::vector<uint32_t> In(Stride * h);
+					std::vector<uint8_t> Res(w * h * BPP + 64, 0xCD), Ref;
+					TestFillRandom(In.data(), In.size() * 4, (uint32_t)(s * 7 + Out * 3 + Mirror));
+					ReferenceJob(In, w, h, Stride, Mirror != 0, BPP, Ref);
+
+					ProcessFrame Frame;
+					ProcessJob Job;
+					TEST_CHECK(Frame.SetupJob(Job, ProcessJob::INPUT_RGBA8, In.data(), (int)w, (int)h, (int)Stride, (ProcessJob::EOutput)Out, Res.data(), (int)w, (int)h,
+						Mirror != 0, ProcessResizeMap::FILTER_NEAREST, ProcessJob::COLORSPACE_BT601_LIMITED, ProcessToneMap()));
+					Job.RowKernel = (Out == ProcessJob::OUTPUT_BGR8 ? k.RGBA8toBGR8 : k.RGBA8toBGRA8); //NULL is the scalar path of the job
+					Job.Execute();
+					TEST_CHECK(!memcmp(Res.data(), Ref.data(), Ref.size()));
+					TEST_CHECK(Res[Ref.size()] == 0xCD);
+				}
+		printf("%-8s kernels: %s\n", LevelNames[l], (g_TestFailures == Failures ? "match the scalar reference" : "MISMATCH"));
+	}
+	return TestResult("test_kernels");
+}
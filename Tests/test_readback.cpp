@@ -0,0 +1,144 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//ReadbackQueue (readback.inl) on the software device of readback_mock.h: Frames get delivered in order with their own data, a change
+//of the source description drops the frames in flight, lowering the depth releases the spare staging textures and failed creates
+//and maps only drop the frame they happened to
+
+#include "testing.h"
+#include "readback_mock.h"
+
+typedef ReadbackQueue<MockDevice, MockFrame> Queue;
+
+static EReadbackMap PushFrame(Queue& q, MockSink& Sink, int Number, const MockDevice::Desc& d, int Depth, double FrameTime = 16.667)
+{
+	q.Dev.Now += FrameTime;
+	const MockFrame f = { Number, q.Dev.Now };
+	return q.Push(Number, d, Depth, f, Sink);
+}
+
+static void TestInOrder()
+{
+	static const double Latencies[] = { 0, 5, 20, 45 };
+	const MockDevice::Desc d = { 64, 32 };
+	for (size_t l = 0; l != sizeof(Latencies) / sizeof(Latencies[0]); l++)
+		for (int Depth = 1; Depth <= Queue::MAXDEPTH; Depth++)
+		{
+			Queue q;
+			q.Dev.GpuLatency = Latencies[l];
+			MockSink Sink(&q.Dev);
+			enum { FRAMES = 300 };
+			for (int i = 0; i != FRAMES; i++)
+			{
+				TEST_CHECK(PushFrame(q, Sink, i, d, Depth) == READBACKMAP_OK);
+				TEST_CHECK(q.Dev.Live <= Depth && q.GetQueued() <= Depth - 1);
+			}
+
+			//All but the copies still in flight arrived, oldest first and each with its own data
+			TEST_CHECK((int)Sink.Delivered.size() == FRAMES - q.GetQueued() && Sink.WrongData == 0);
+			for (size_t k = 0; k != Sink.Delivered.size(); k++) TEST_CHECK(Sink.Delivered[k] == (int)k);
+
+			//Copies finish 2 ms after the GPU latency, with enough of them in flight a 60 fps render thread never waits
+			//Staging textures get reused, there are never more than the copies that can be in flight at once
+			const int FramesInFlight = (int)((Latencies[l] + q.Dev.CopyCost) / 16.667) + 1;
+			if (Depth > FramesInFlight) TEST_CHECK(q.Dev.Stalled == 0);
+			else TEST_CHECK(q.Dev.Stalled > 0);
+			TEST_CHECK(q.Dev.Created == (Depth < FramesInFlight ? Depth : FramesInFlight));
+			q.Reset();
+			TEST_CHECK(q.Dev.Live == 0 && q.Dev.Errors == 0);
+		}
+}
+
+static void TestDescChange()
+{
+	Queue q;
+	q.Dev.GpuLatency = 60; //copies take 4 frames
+	MockSink Sink(&q.Dev);
+	const MockDevice::Desc a = { 64, 32 }, b = { 128, 64 };
+	int Number = 0;
+	for (int i = 0; i != 10; i++) PushFrame(q, Sink, Number++, a, 4);
+	TEST_CHECK(q.GetQueued() == 3 && q.Dev.Live == 4);
+
+	//The frames in flight don't get delivered and all textures of the old size get released
+	const size_t Delivered = Sink.Delivered.size();
+	TEST_CHECK(PushFrame(q, Sink, Number++, b, 4) == READBACKMAP_OK);
+	TEST_CHECK(Sink.Delivered.size() == Delivered && q.GetQueued() == 1 && q.Dev.Live == 1);
+	for (int i = 0; i != 10; i++) PushFrame(q, Sink, Number++, b, 4);
+	TEST_CHECK(Sink.Delivered[Delivered] == 10 && Sink.Delivered.back() == Number - 4 && Sink.WrongData == 0);
+	q.Reset();
+	TEST_CHECK(q.Dev.Live == 0 && q.Dev.Errors == 0);
+}
+
+static void TestLowerDepth()
+{
+	Queue q;
+	q.Dev.GpuLatency = 60;
+	MockSink Sink(&q.Dev);
+	const MockDevice::Desc d = { 64, 32 };
+	int Number = 0;
+	for (int i = 0; i != 10; i++) PushFrame(q, Sink, Number++, d, 4);
+	TEST_CHECK(q.Dev.Live == 4);
+
+	//The frames in flight still get delivered (waiting for them), then only one texture stays
+	Sink.Delivered.clear();
+	TEST_CHECK(PushFrame(q, Sink, Number++, d, 1) == READBACKMAP_OK);
+	TEST_CHECK(Sink.Delivered.size() == 4 && Sink.Delivered[0] == 7 && Sink.Delivered[3] == 10);
+	TEST_CHECK(q.GetQueued() == 0 && q.Dev.Live == 1);
+	for (int i = 0; i != 5; i++) PushFrame(q, Sink, Number++, d, 1);
+	TEST_CHECK(Sink.Delivered.size() == 9 && q.Dev.Live == 1 && q.Dev.Created == 4);
+
+	//Raising it again creates textures only as needed
+	for (int i = 0; i != 10; i++) PushFrame(q, Sink, Number++, d, 2);
+	TEST_CHECK(q.Dev.Live == 2 && q.Dev.Created == 5 && Sink.WrongData == 0);
+	q.Reset();
+	TEST_CHECK(q.Dev.Live == 0 && q.Dev.Errors == 0);
+}
+
+static void TestFailures()
+{
+	Queue q;
+	MockSink Sink(&q.Dev);
+	const MockDevice::Desc d = { 64, 32 };
+
+	//A failed map drops that frame and keeps its texture for the next one
+	q.Dev.FailMaps = 1;
+	TEST_CHECK(PushFrame(q, Sink, 0, d, 1) == READBACKMAP_FAILED);
+	TEST_CHECK(Sink.Delivered.empty() && q.GetQueued() == 0 && q.Dev.Live == 1);
+	TEST_CHECK(PushFrame(q, Sink, 1, d, 1) == READBACKMAP_OK);
+	TEST_CHECK(Sink.Delivered.size() == 1 && Sink.Delivered[0] == 1 && q.Dev.Created == 1);
+
+	//With copies in flight the push that runs into the failed map reports it, only the frame of that copy goes missing
+	for (int i = 2; i != 6; i++) TEST_CHECK(PushFrame(q, Sink, i, d, 3) == READBACKMAP_OK);
+	TEST_CHECK(q.GetQueued() == 2); //frames 4 and 5
+	q.Dev.FailMaps = 1;
+	TEST_CHECK(PushFrame(q, Sink, 6, d, 3) == READBACKMAP_FAILED);
+	for (int i = 7; i != 10; i++) TEST_CHECK(PushFrame(q, Sink, i, d, 3) == READBACKMAP_OK);
+	static const int Expected[] = { 1, 2, 3, 5, 6, 7 };
+	TEST_CHECK(Sink.Delivered == std::vector<int>(Expected, Expected + 6));
+
+	//A texture that can't be created drops the frame, the next push tries again
+	q.Reset();
+	Sink.Delivered.clear();
+	q.Dev.FailCreates = 1;
+	TEST_CHECK(PushFrame(q, Sink, 10, d, 2) == READBACKMAP_FAILED);
+	TEST_CHECK(q.GetQueued() == 0 && q.Dev.Live == 0);
+	TEST_CHECK(PushFrame(q, Sink, 11, d, 2) == READBACKMAP_OK && PushFrame(q, Sink, 12, d, 2) == READBACKMAP_OK);
+	TEST_CHECK(Sink.Delivered.size() == 1 && Sink.Delivered[0] == 11 && Sink.WrongData == 0);
+	q.Reset();
+	TEST_CHECK(q.Dev.Live == 0 && q.Dev.Errors == 0);
+}
+
+int main()
+{
+	TestInOrder();
+	TestDescChange();
+	TestLowerDepth();
+	TestFailures();
+	return TestResult("test_readback");
+}
@@ -0,0 +1,184 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Reader registry of the shared memory transport with receivers in several processes: Every receiver gets woken up for every frame
+//(none of them steals the notification of another one), and the entries and slots of killed receivers get reclaimed
+
+#include "testing.h"
+#include "shared.inl"
+#include <signal.h>
+#include <sys/wait.h>
+
+enum { CAPNUM = 34, READERS = 4, FRAMES = 300, MAXREADERS = SharedImageMemoryBackend::EVENT_COUNT, HOLDERS = 3 };
+
+struct Shared
+{
+	volatile int32_t Ready, Turn, Holding;
+	volatile uint32_t Acked[READERS];
+	volatile int64_t MaxLatency[READERS];
+};
+
+static int Spawn(int (*Func)(Shared*, int), Shared* s, int Index)
+{
+	fflush(stdout);
+	const pid_t Pid = fork();
+	if (Pid == 0) { const int Res = Func(s, Index); fflush(stdout); _exit(Res); }
+	return Pid;
+}
+
+static bool WaitFor(volatile int32_t* p, int32_t Value)
+{
+	for (double Timeout = TestNow() + 10; *p != Value; usleep(50))
+		if (TestNow() > Timeout) return false;
+	return true;
+}
+
+static void SendValue(SharedImageMemory& Sender, uint32_t Value)
+{
+	uint32_t Pixels[16 * 16];
+	for (int i = 0; i != 16 * 16; i++) Pixels[i] = Value;
+	Sender.Send(16, 16, 16, sizeof(Pixels), SharedImageMemory::FORMAT_UINT8, SharedImageMemory::RESIZEMODE_DISABLED, SharedImageMemory::MIRRORMODE_DISABLED, 0, (uint8_t*)Pixels);
+}
+
+static void OnFrame(int, int, int, SharedImageMemory::EFormat, SharedImageMemory::EResizeMode, SharedImageMemory::EMirrorMode, int, uint8_t* buffer, void* callback_data)
+{
+	*(uint32_t*)callback_data = *(uint32_t*)buffer;
+}
+
+//Receives every frame with a long wait, a missed wake up would only end the wait after 5 seconds
+static int RunReader(Shared* s, int Index)
+{
+	SharedImageMemory Receiver(CAPNUM);
+	uint32_t Value = 0;
+	Receiver.Receive(OnFrame, &Value, 1); //registers, nothing has been sent yet
+	__sync_fetch_and_add(&s->Ready, 1);
+	for (uint32_t Frame = 1; Frame <= FRAMES; Frame++)
+	{
+		if (Receiver.Receive(OnFrame, &Value, 5000) != SharedImageMemory::RECEIVERES_NEWFRAME || Value != Frame || Receiver.GetFrameSequence() != Frame)
+		{
+			printf("FAILED: reader %d expected frame %u but got %u\n", Index, Frame, Value);
+			return 1;
+		}
+		const int64_t Latency = SharedImageMemory::GetTimestamp() - Receiver.GetFrameTimestamp();
+		if (Latency > s->MaxLatency[Index]) s->MaxLatency[Index] = Latency;
+		s->Acked[Index] = Frame;
+	}
+	return 0;
+}
+
+static void TestNotifications(Shared* s)
+{
+	pid_t Pids[READERS];
+	for (int i = 0; i != READERS; i++) Pids[i] = Spawn(RunReader, s, i);
+	TEST_CHECK(WaitFor(&s->Ready, READERS));
+
+	//Frames are sent in lockstep with the readers so every one of them has to be woken up for every frame
+	SharedImageMemory Sender(CAPNUM);
+	TEST_CHECK(Sender.SendIsReady());
+	int Sent = 0;
+	for (uint32_t Frame = 1; Frame <= FRAMES; Frame++, Sent++)
+	{
+		SendValue(Sender, Frame);
+		bool AllAcked = true;
+		for (int i = 0; i != READERS && AllAcked; i++) AllAcked = WaitFor((volatile int32_t*)&s->Acked[i], (int32_t)Frame);
+		if (!AllAcked) break;
+	}
+	TEST_CHECK(Sent == FRAMES);
+
+	int64_t MaxLatency = 0;
+	for (int i = 0; i != READERS; i++)
+	{
+		int Status = 0;
+		waitpid(Pids[i], &Status, 0);
+		TEST_CHECK(WIFEXITED(Status) && WEXITSTATUS(Status) == 0);
+		if (s->MaxLatency[i] > MaxLatency) MaxLatency = s->MaxLatency[i];
+	}
+	printf("%d readers in their own processes got all %d frames, longest latency %.2f ms\n", READERS, Sent, MaxLatency / 10000.0);
+	TEST_CHECK(MaxLatency < 1000 * 10000); //far below the wait of a missed wake up
+}
+
+//The first HOLDERS readers take their turn to receive a frame and then never return from the callback, the others only register
+static void OnFrameHold(int, int, int, SharedImageMemory::EFormat, SharedImageMemory::EResizeMode, SharedImageMemory::EMirrorMode, int, uint8_t*, void* callback_data)
+{
+	__sync_fetch_and_add(&((Shared*)callback_data)->Holding, 1);
+	for (;;) pause();
+}
+
+static int RunStuckReader(Shared* s, int Index)
+{
+	SharedImageMemory Receiver(CAPNUM);
+	uint32_t Value = 0;
+	Receiver.Receive(OnFrame, &Value, 1); //registers
+	__sync_fetch_and_add(&s->Ready, 1);
+	if (Index >= HOLDERS) for (;;) pause();
+	while (s->Turn != Index) usleep(50);
+	Receiver.Receive(OnFrameHold, s, 5000);
+	return 1;
+}
+
+static void TestReclaim(Shared* s)
+{
+	memset(s, 0, sizeof(Shared));
+	s->Turn = -1;
+	pid_t Pids[MAXREADERS];
+	for (int i = 0; i != MAXREADERS; i++) Pids[i] = Spawn(RunStuckReader, s, i);
+	TEST_CHECK(WaitFor(&s->Ready, MAXREADERS));
+
+	//Every holder gets a frame of its own so together with the latest frame all slots are taken
+	SharedImageMemory Sender(CAPNUM);
+	TEST_CHECK(Sender.SendIsReady());
+	for (int i = 0; i != HOLDERS; i++)
+	{
+		SendValue(Sender, (uint32_t)i + 1);
+		s->Turn = i;
+		TEST_CHECK(WaitFor(&s->Holding, i + 1));
+	}
+	SendValue(Sender, HOLDERS + 1);
+	int Stride;
+	TEST_CHECK(Sender.AcquireWriteSlot(16, 16, SharedImageMemory::FORMAT_UINT8, Stride) == NULL);
+
+	//No room in the registry for another reader while all the processes are alive
+	SharedImageMemory Extra(CAPNUM);
+	uint32_t Value = 0;
+	TEST_CHECK(Extra.Receive(OnFrame, &Value, 10) == SharedImageMemory::RECEIVERES_CAPTUREINACTIVE);
+
+	for (int i = 0; i != MAXREADERS; i++) { kill(Pids[i], SIGKILL); waitpid(Pids[i], NULL, 0); }
+
+	//The sender gets the slots of the killed readers back and new readers get their entries
+	uint32_t* Slot = (uint32_t*)Sender.AcquireWriteSlot(16, 16, SharedImageMemory::FORMAT_UINT8, Stride);
+	TEST_CHECK(Slot != NULL);
+	if (Slot)
+	{
+		for (int i = 0; i != 16 * 16; i++) Slot[i] = HOLDERS + 2;
+		Sender.CommitWriteSlot(SharedImageMemory::RESIZEMODE_DISABLED, SharedImageMemory::MIRRORMODE_DISABLED, 0);
+	}
+	TEST_CHECK(Extra.Receive(OnFrame, &Value, 10) == SharedImageMemory::RECEIVERES_NEWFRAME && Value == HOLDERS + 2);
+	SharedImageMemory* Others[MAXREADERS];
+	int Registered = 1;
+	for (int i = 0; i != MAXREADERS; i++)
+	{
+		Others[i] = new SharedImageMemory(CAPNUM);
+		Registered += (Others[i]->Receive(OnFrame, &Value, 10) == SharedImageMemory::RECEIVERES_NEWFRAME && Value == HOLDERS + 2);
+	}
+	TEST_CHECK(Registered == MAXREADERS); //the last one finds the registry full again
+	for (int i = 0; i != MAXREADERS; i++) delete Others[i];
+	printf("%d killed readers (%d of them holding a frame) got reclaimed\n", MAXREADERS, HOLDERS);
+}
+
+int main()
+{
+	TestRemoveShared(CAPNUM);
+	Shared* s = (Shared*)mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	memset(s, 0, sizeof(Shared));
+	TestNotifications(s);
+	TestRemoveShared(CAPNUM);
+	TestReclaim(s);
+	TestRemoveShared(CAPNUM);
+	return TestResult("test_readers");
+}
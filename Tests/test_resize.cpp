@@ -0,0 +1,119 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Checks that the filter resizes give the same output when their rows are split over the threads of pools of different
+//sizes (every thread keeps its ring of source rows in its own part of the memory set up by ProcessFrame::SetupJob), and
+//that outputs with more than 8 bits per channel keep their precision through the filter and shrinking beyond the area taps
+//still covers the whole source
+
+#include "testing.h"
+#include "process.inl"
+#include "workers.inl"
+#include <vector>
+
+//Halving a ramp of consecutive half floats in [0.5, 1) into ARGB64 gives the average of each pair, a filter through 8 bits would be
+//off by up to 128 (and the same for P010 whose luma of gray is the value itself in full range)
+static void CheckHighBitDepth(ProcessResizeMap::EFilter Filter)
+{
+	enum { W = 1024, H = 4 };
+	std::vector<uint16_t> In(W * H * 4);
+	for (size_t i = 0; i != W * H; i++) In[i * 4] = In[i * 4 + 1] = In[i * 4 + 2] = (uint16_t)(0x3800 + i % W), In[i * 4 + 3] = 0x3C00;
+	std::vector<uint8_t> Out(ProcessJob::OutputSize(ProcessJob::OUTPUT_ARGB64, W / 2, H / 2)), Yuv(ProcessJob::OutputSize(ProcessJob::OUTPUT_P010, W / 2, H / 2));
+	ProcessFrame Frame;
+	ProcessJob Job;
+	TEST_CHECK(Frame.SetupJob(Job, ProcessJob::INPUT_RGBA16_GAMMA, In.data(), W, H, W, ProcessJob::OUTPUT_ARGB64, Out.data(), W / 2, H / 2,
+		false, Filter, ProcessJob::COLORSPACE_BT709_FULL, ProcessToneMap()));
+	Job.Execute();
+	TEST_CHECK(Frame.SetupJob(Job, ProcessJob::INPUT_RGBA16_GAMMA, In.data(), W, H, W, ProcessJob::OUTPUT_P010, Yuv.data(), W / 2, H / 2,
+		false, Filter, ProcessJob::COLORSPACE_BT709_FULL, ProcessToneMap()));
+	Job.Execute();
+
+	double MaxError = 0, MaxErrorY = 0;
+	for (size_t y = 0; y != H / 2; y++)
+		for (size_t x = 0; x != W / 2; x++)
+		{
+			const double Value = 0.5 * (1 + (x * 2 + 0.5) / 1024), Error = fabs(((Out[(y * W / 2 + x) * 8 + 2] << 8) | Out[(y * W / 2 + x) * 8 + 3]) - Value * 65535);
+			const double ErrorY = fabs((((const uint16_t*)Yuv.data())[y * W / 2 + x] >> 6) - Value * 1023);
+			MaxError = (Error > MaxError ? Error : MaxError), MaxErrorY = (ErrorY > MaxErrorY ? ErrorY : MaxErrorY);
+		}
+	TEST_CHECK(MaxError <= 1.0 && MaxErrorY <= 0.51);
+}
+
+//Shrinking a horizontal ramp 128x is beyond ProcessResizeMap::MAXAREATAPS, the area filter falls back to bilinear which samples the
+//center of the covered source pixels, averaging only the first 64 of them would be off by 2
+static void CheckLargeShrink()
+{
+	enum { W = 4096, H = 128, OutW = 32, OutH = 1 };
+	std::vector<uint32_t> In(W * H);
+	for (size_t i = 0; i != W * H; i++) In[i] = 0xFF000000 | 0x010101 * (uint32_t)(i % W / 16);
+	std::vector<uint32_t> Out(OutW * OutH);
+	ProcessFrame Frame;
+	ProcessJob Job;
+	TEST_CHECK(Frame.SetupJob(Job, ProcessJob::INPUT_RGBA8, In.data(), W, H, W, ProcessJob::OUTPUT_BGRA8, Out.data(), OutW, OutH,
+		false, ProcessResizeMap::FILTER_AREA, ProcessJob::COLORSPACE_BT709_LIMITED, ProcessToneMap()));
+	Job.Execute();
+
+	for (size_t x = 0; x != OutW; x++)
+	{
+		const double Average = x * 8 + 3.5, Blue = Out[x] & 0xFF;
+		TEST_CHECK(fabs(Blue - Average) <= 1.0);
+	}
+}
+
+int main()
+{
+	static const int Sizes[][4] = { { 1920, 1080, 1280, 720 }, { 1920, 1080, 480, 270 }, { 3840, 2160, 1920, 1080 }, { 640, 360, 1920, 1080 }, { 333, 211, 100, 77 } };
+	static const size_t ThreadCounts[] = { 1, 2, 4, 7 };
+	static const ProcessResizeMap::EFilter Filters[] = { ProcessResizeMap::FILTER_BILINEAR, ProcessResizeMap::FILTER_AREA };
+	static const ProcessJob::EOutput Outputs[] = { ProcessJob::OUTPUT_BGRA8, ProcessJob::OUTPUT_BGR8, ProcessJob::OUTPUT_NV12, ProcessJob::OUTPUT_P010, ProcessJob::OUTPUT_ARGB64 };
+
+	for (size_t t = 0; t != sizeof(ThreadCounts) / sizeof(ThreadCounts[0]); t++)
+	{
+		ProcessPool Pool(ThreadCounts[t]);
+		const int Slot = Pool.AddClient();
+		ProcessFrame Frame; //reused for all sizes so the filter memory has to grow with them
+		for (size_t s = 0; s != sizeof(Sizes) / sizeof(Sizes[0]); s++)
+			for (size_t f = 0; f != sizeof(Filters) / sizeof(Filters[0]); f++)
+				for (size_t o = 0; o != sizeof(Outputs) / sizeof(Outputs[0]); o++)
+					for (int Mirror = 0; Mirror != 2; Mirror++)
+					{
+						const int InW = Sizes[s][0], InH = Sizes[s][1], OutW = Sizes[s][2], OutH = Sizes[s][3];
+						std::vector<uint32_t> In((size_t)InW * InH);
+						TestFillRandom(In.data(), In.size() * 4, (uint32_t)(s * 5 + f));
+						const size_t OutSize = ProcessJob::OutputSize(Outputs[o], OutW, OutH);
+						std::vector<uint8_t> Res(OutSize, 0xCD), Ref(OutSize, 0xCD);
+
+						ProcessFrame RefFrame;
+						ProcessJob Job;
+						TEST_CHECK(RefFrame.SetupJob(Job, ProcessJob::INPUT_RGBA8, In.data(), InW, InH, InW, Outputs[o], Ref.data(), OutW, OutH,
+							Mirror != 0, Filters[f], ProcessJob::COLORSPACE_BT709_LIMITED, ProcessToneMap()));
+						TEST_CHECK(Job.FilterMem != NULL);
+						Job.Execute();
+
+						TEST_CHECK(Frame.SetupJob(Job, ProcessJob::INPUT_RGBA8, In.data(), InW, InH, InW, Outputs[o], Res.data(), OutW, OutH,
+							Mirror != 0, Filters[f], ProcessJob::COLORSPACE_BT709_LIMITED, ProcessToneMap(), Pool.GetThreadCount()));
+						Pool.Run(Slot, Job);
+						TEST_CHECK(!memcmp(Res.data(), Ref.data(), OutSize));
+					}
+
+		//The nearest resize doesn't need filter memory
+		std::vector<uint32_t> In(64 * 64);
+		std::vector<uint8_t> Out(32 * 32 * 4);
+		ProcessJob Job;
+		TEST_CHECK(Frame.SetupJob(Job, ProcessJob::INPUT_RGBA8, In.data(), 64, 64, 64, ProcessJob::OUTPUT_BGRA8, Out.data(), 32, 32,
+			false, ProcessResizeMap::FILTER_NEAREST, ProcessJob::COLORSPACE_BT709_LIMITED, ProcessToneMap(), Pool.GetThreadCount()));
+		TEST_CHECK(Job.FilterMem == NULL);
+		Pool.RemoveClient(Slot);
+	}
+
+	CheckHighBitDepth(ProcessResizeMap::FILTER_BILINEAR);
+	CheckHighBitDepth(ProcessResizeMap::FILTER_AREA);
+	CheckLargeShrink();
+	return TestResult("test_resize");
+}
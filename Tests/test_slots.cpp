@@ -0,0 +1,144 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Stress test of the frame slot exchange of the shared memory transport (AcquireLatestSlot, PickWriteSlot and the compare exchange
+//of slotState) between a sending process and several receiving processes. Every frame is filled with its number and gets sized by
+//it, receivers check that no frame they get is torn or out of order while they hold their slots for varying times so the sender
+//regularly runs out of free slots. Every 1000 frames the size switches so the sender also has to create new frame segments.
+
+#include "testing.h"
+#include "shared.inl"
+#include <sys/wait.h>
+#include <vector>
+
+enum { CAPNUM = 31, RECEIVERS = 3, FRAMES = 30000, LAST = 0x7FFFFFFF };
+
+struct Stats
+{
+	volatile int32_t Ready, Done; //receivers registered and receivers that got the last frame
+	uint32_t Received[RECEIVERS], Repeated[RECEIVERS], Sent, Failed;
+};
+
+static void FrameSize(uint32_t Value, int& Width, int& Height)
+{
+	const bool Large = (Value != LAST && ((Value / 1000) & 1));
+	Width = (Large ? 320 : 64) + (int)(Value & 7), Height = (Large ? 240 : 64);
+}
+
+static int RunSender(Stats* s)
+{
+	SharedImageMemory Sender(CAPNUM);
+	for (double Timeout = TestNow() + 10; !Sender.SendIsReady() || s->Ready != RECEIVERS;)
+	{
+		if (TestNow() > Timeout) { printf("FAILED: receivers did not start\n"); return 1; }
+		usleep(1000);
+	}
+
+	//Every third frame is written directly into the slot (zero copy), the others go through Send
+	std::vector<uint32_t> Buf(330 * 240);
+	for (uint32_t Value = 1; Value <= FRAMES; Value++)
+	{
+		int w, h, Stride;
+		FrameSize(Value, w, h);
+		if (Value % 3 == 0)
+		{
+			uint32_t* Slot = (uint32_t*)Sender.AcquireWriteSlot(w, h, SharedImageMemory::FORMAT_UINT8, Stride);
+			if (!Slot) { s->Failed++; continue; }
+			for (size_t i = 0; i != (size_t)Stride * h; i++) Slot[i] = Value;
+			Sender.CommitWriteSlot(SharedImageMemory::RESIZEMODE_DISABLED, SharedImageMemory::MIRRORMODE_DISABLED, 10);
+		}
+		else
+		{
+			for (size_t i = 0; i != (size_t)w * h; i++) Buf[i] = Value;
+			Sender.Send(w, h, w, (uint32_t)(w * h * 4), SharedImageMemory::FORMAT_UINT8, SharedImageMemory::RESIZEMODE_DISABLED, SharedImageMemory::MIRRORMODE_DISABLED, 10, (uint8_t*)Buf.data());
+		}
+		s->Sent++;
+	}
+
+	//Send can't tell whether a frame skip warning means that the frame was skipped, so the last frame is repeated until every receiver got it
+	int w, h;
+	FrameSize(LAST, w, h);
+	for (size_t i = 0; i != (size_t)w * h; i++) Buf[i] = LAST;
+	for (double Timeout = TestNow() + 30; s->Done != RECEIVERS && TestNow() < Timeout; usleep(1000))
+		Sender.Send(w, h, w, (uint32_t)(w * h * 4), SharedImageMemory::FORMAT_UINT8, SharedImageMemory::RESIZEMODE_DISABLED, SharedImageMemory::MIRRORMODE_DISABLED, 10, (uint8_t*)Buf.data());
+	return (s->Done == RECEIVERS ? 0 : 1);
+}
+
+static void OnFrame(int width, int height, int stride, SharedImageMemory::EFormat format, SharedImageMemory::EResizeMode, SharedImageMemory::EMirrorMode, int, uint8_t* buffer, void* callback_data)
+{
+	const uint32_t* p = (const uint32_t*)buffer;
+	const uint32_t Value = p[0];
+	int w, h;
+	FrameSize(Value, w, h);
+	TEST_CHECK(width == w && height == h && stride == w && format == SharedImageMemory::FORMAT_UINT8);
+	size_t Torn = 0;
+	for (size_t i = 0; i != (size_t)w * h; i++) Torn += (p[i] != Value);
+	TEST_CHECK(Torn == 0);
+	*(uint32_t*)callback_data = Value;
+	if (Value % 7 == 0) usleep(200 + (Value % 5) * 100); //keep holding the slot while the sender moves on
+}
+
+static int RunReceiver(Stats* s, int Index)
+{
+	SharedImageMemory Receiver(CAPNUM);
+	uint32_t Value = 0, Last = 0;
+	uint64_t LastSequence = 0;
+	Receiver.Receive(OnFrame, &Value, 1); //registers the receiver, nothing has been sent yet
+	__sync_fetch_and_add(&s->Ready, 1);
+	for (double Timeout = TestNow() + 60; Last != LAST;)
+	{
+		if (TestNow() > Timeout) { printf("FAILED: receiver %d timed out after frame %u\n", Index, Last); return 1; }
+		const SharedImageMemory::EReceiveResult Res = Receiver.Receive(OnFrame, &Value, 50);
+		if (Res == SharedImageMemory::RECEIVERES_CAPTUREINACTIVE) continue;
+		if (Res == SharedImageMemory::RECEIVERES_NEWFRAME)
+		{
+			TEST_CHECK(Value > Last && Receiver.GetFrameSequence() > LastSequence);
+			s->Received[Index]++;
+		}
+		else
+		{
+			TEST_CHECK(Value == Last && Receiver.GetFrameSequence() == LastSequence);
+			s->Repeated[Index]++;
+		}
+		Last = Value, LastSequence = Receiver.GetFrameSequence();
+	}
+	__sync_fetch_and_add(&s->Done, 1);
+	return (g_TestFailures ? 1 : 0);
+}
+
+int main()
+{
+	TestRemoveShared(CAPNUM);
+	Stats* s = (Stats*)mmap(NULL, sizeof(Stats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	memset(s, 0, sizeof(Stats));
+
+	pid_t Pids[RECEIVERS + 1];
+	fflush(stdout);
+	for (int i = 0; i != RECEIVERS + 1; i++)
+		if ((Pids[i] = fork()) == 0)
+		{
+			const int Res = (i == RECEIVERS ? RunSender(s) : RunReceiver(s, i));
+			fflush(stdout);
+			_exit(Res);
+		}
+
+	for (int i = 0; i != RECEIVERS + 1; i++)
+	{
+		int Status = 0;
+		waitpid(Pids[i], &Status, 0);
+		TEST_CHECK(WIFEXITED(Status) && WEXITSTATUS(Status) == 0);
+	}
+	printf("%u frames sent, %u zero copy frames without a free slot", s->Sent, s->Failed);
+	for (int i = 0; i != RECEIVERS; i++) printf(", receiver %d got %u (%u repeated)", i, s->Received[i], s->Repeated[i]);
+	printf("\n");
+	TEST_CHECK(s->Sent + s->Failed == FRAMES);
+	for (int i = 0; i != RECEIVERS; i++) TEST_CHECK(s->Received[i] > 0);
+	TestRemoveShared(CAPNUM);
+	return TestResult("test_slots");
+}
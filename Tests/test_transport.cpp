@@ -0,0 +1,188 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Send and Receive of the shared memory transport on the POSIX backend: Frames of different capture numbers stay apart, the frame
+//and its properties arrive unchanged, output requests reach the sender, a header of another layout is left alone by the sender,
+//and frames make a round trip between two processes (sent on one capture number, echoed back on another)
+
+#include "testing.h"
+#include "shared.inl"
+#include <sys/wait.h>
+#include <vector>
+
+enum { CAPNUM_A = 32, CAPNUM_B = 33, ROUNDTRIPS = 500 };
+
+struct Frame
+{
+	int Width, Height, Stride, Timeout;
+	SharedImageMemory::EFormat Format;
+	SharedImageMemory::EResizeMode ResizeMode;
+	SharedImageMemory::EMirrorMode MirrorMode;
+	std::vector<uint8_t> Data;
+};
+
+static void OnFrame(int width, int height, int stride, SharedImageMemory::EFormat format, SharedImageMemory::EResizeMode resizemode, SharedImageMemory::EMirrorMode mirrormode, int timeout, uint8_t* buffer, void* callback_data)
+{
+	Frame& f = *(Frame*)callback_data;
+	f.Width = width, f.Height = height, f.Stride = stride, f.Format = format, f.ResizeMode = resizemode, f.MirrorMode = mirrormode, f.Timeout = timeout;
+	f.Data.assign(buffer, buffer + (size_t)stride * height * (format == SharedImageMemory::FORMAT_UINT8 ? 4 : 8));
+}
+
+static SharedImageMemory::ESendResult SendFrame(SharedImageMemory& Sender, const Frame& f)
+{
+	return Sender.Send(f.Width, f.Height, f.Stride, (uint32_t)f.Data.size(), f.Format, f.ResizeMode, f.MirrorMode, f.Timeout, f.Data.data());
+}
+
+static Frame MakeFrame(int Width, int Height, int Stride, SharedImageMemory::EFormat Format, uint32_t Seed)
+{
+	Frame f;
+	f.Width = Width, f.Height = Height, f.Stride = Stride, f.Format = Format, f.Timeout = (int)(Seed % 1000);
+	f.ResizeMode = (SharedImageMemory::EResizeMode)(Seed % 4), f.MirrorMode = (SharedImageMemory::EMirrorMode)(Seed % 2);
+	f.Data.resize((size_t)Stride * Height * (Format == SharedImageMemory::FORMAT_UINT8 ? 4 : 8));
+	TestFillRandom(f.Data.data(), f.Data.size(), Seed);
+	return f;
+}
+
+static bool SameFrame(const Frame& a, const Frame& b)
+{
+	return (a.Width == b.Width && a.Height == b.Height && a.Stride == b.Stride && a.Format == b.Format && a.ResizeMode == b.ResizeMode &&
+		a.MirrorMode == b.MirrorMode && a.Timeout == b.Timeout && a.Data == b.Data);
+}
+
+//Two capture numbers in one process
+static void TestCaptureNumbers()
+{
+	SharedImageMemory SenderA(CAPNUM_A), SenderB(CAPNUM_B), ReceiverA(CAPNUM_A), ReceiverB(CAPNUM_B);
+	Frame Got;
+	TEST_CHECK(!SenderA.SendIsReady()); //nothing to send to before a receiver opened the capture number
+	TEST_CHECK(ReceiverA.Receive(OnFrame, &Got, 10) == SharedImageMemory::RECEIVERES_CAPTUREINACTIVE);
+	TEST_CHECK(SenderA.SendIsReady());
+	TEST_CHECK(!SenderB.SendIsReady());
+	TEST_CHECK(ReceiverB.Receive(OnFrame, &Got, 10) == SharedImageMemory::RECEIVERES_CAPTUREINACTIVE);
+	TEST_CHECK(SenderB.SendIsReady());
+
+	const Frame a = MakeFrame(640, 480, 640, SharedImageMemory::FORMAT_UINT8, 1), b = MakeFrame(320, 200, 384, SharedImageMemory::FORMAT_FP16_GAMMA, 2);
+	const int64_t Before = SharedImageMemory::GetTimestamp();
+	TEST_CHECK(SendFrame(SenderA, a) == SharedImageMemory::SENDRES_OK);
+	TEST_CHECK(SendFrame(SenderB, b) == SharedImageMemory::SENDRES_OK);
+	TEST_CHECK(ReceiverA.Receive(OnFrame, &Got, 10) == SharedImageMemory::RECEIVERES_NEWFRAME && SameFrame(Got, a));
+	TEST_CHECK(ReceiverA.GetFrameSequence() == 1 && ReceiverA.GetFrameDataSize() == a.Data.size());
+	TEST_CHECK(ReceiverA.GetFrameTimestamp() >= Before && ReceiverA.GetFrameTimestamp() <= SharedImageMemory::GetTimestamp());
+	TEST_CHECK(ReceiverB.Receive(OnFrame, &Got, 10) == SharedImageMemory::RECEIVERES_NEWFRAME && SameFrame(Got, b));
+
+	//Without a new frame the last one is passed again after the wait, which neither ends early nor runs long
+	const double WaitStart = TestNow();
+	TEST_CHECK(ReceiverA.Receive(OnFrame, &Got, 30) == SharedImageMemory::RECEIVERES_OLDFRAME && SameFrame(Got, a));
+	const double Waited = TestNow() - WaitStart;
+	TEST_CHECK(Waited >= 0.030 && Waited < 0.080);
+
+	//A larger frame moves to a new frame segment, a much smaller one back to a smaller one
+	const Frame Large = MakeFrame(1920, 1080, 1920, SharedImageMemory::FORMAT_FP16_LINEAR, 3), Small = MakeFrame(16, 16, 16, SharedImageMemory::FORMAT_UINT8, 4);
+	TEST_CHECK(SendFrame(SenderA, Large) == SharedImageMemory::SENDRES_OK);
+	TEST_CHECK(ReceiverA.Receive(OnFrame, &Got, 10) == SharedImageMemory::RECEIVERES_NEWFRAME && SameFrame(Got, Large) && ReceiverA.GetFrameSequence() == 2);
+	TEST_CHECK(SendFrame(SenderA, Small) == SharedImageMemory::SENDRES_OK);
+	TEST_CHECK(ReceiverA.Receive(OnFrame, &Got, 10) == SharedImageMemory::RECEIVERES_NEWFRAME && SameFrame(Got, Small) && ReceiverA.GetFrameSequence() == 3);
+	TEST_CHECK(ReceiverB.Receive(OnFrame, &Got, 10) == SharedImageMemory::RECEIVERES_OLDFRAME && SameFrame(Got, b));
+
+	//Output requests of a receiver only reach the sender of the same capture number
+	SharedImageMemory::OutputRequest Request = { 1, 1280, 720, 2, 0, 0 }, Read;
+	const int32_t Serial = ReceiverA.RequestOutput(Request);
+	TEST_CHECK(Serial != 0 && ReceiverA.RequestOutput(Request) == Serial);
+	TEST_CHECK(SenderA.GetOutputRequest(Read) == Serial && !memcmp(&Read, &Request, sizeof(Read)));
+	TEST_CHECK(SenderB.GetOutputRequest(Read) == 0);
+	ReceiverA.WithdrawOutput(Serial);
+	TEST_CHECK(SenderA.GetOutputRequest(Read) == 0);
+
+	//Too large frames get refused
+	TEST_CHECK(SenderA.Send(16, 16, 16, (uint32_t)MAX_SHARED_IMAGE_SIZE + 1, SharedImageMemory::FORMAT_UINT8, SharedImageMemory::RESIZEMODE_DISABLED,
+		SharedImageMemory::MIRRORMODE_DISABLED, 0, Small.Data.data()) == SharedImageMemory::SENDRES_TOOLARGE);
+}
+
+//A header of another size (set up by an older or newer receiver) doesn't get used by the sender until a receiver sets it up again
+static void TestHeaderLayout()
+{
+	SharedImageMemory Receiver(CAPNUM_A);
+	TEST_CHECK(Receiver.ReceiveIsReady());
+
+	char Name[64];
+	snprintf(Name, sizeof(Name), "/UnityCapture_Data%c", (char)('0' + CAPNUM_A));
+	const int fd = shm_open(Name, O_RDWR, 0);
+	uint32_t* HeaderSize = (uint32_t*)(fd >= 0 ? mmap(NULL, sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED);
+	if (fd >= 0) close(fd);
+	TEST_CHECK(HeaderSize != MAP_FAILED);
+	if (HeaderSize == MAP_FAILED) return;
+	const uint32_t Size = *HeaderSize;
+	*HeaderSize = Size + 8; //the first member of SharedMemHeader
+
+	SharedImageMemory Sender(CAPNUM_A);
+	TEST_CHECK(!Sender.SendIsReady());
+	TEST_CHECK(!Sender.SendIsReady()); //checks again instead of keeping the rejected header
+	SharedImageMemory NewReceiver(CAPNUM_A);
+	TEST_CHECK(NewReceiver.ReceiveIsReady() && *HeaderSize == Size);
+	TEST_CHECK(Sender.SendIsReady());
+	munmap(HeaderSize, sizeof(uint32_t));
+}
+
+//The child receives on capture number A and sends every frame back on B
+static int RunEcho()
+{
+	SharedImageMemory Receiver(CAPNUM_A), Sender(CAPNUM_B);
+	Frame f;
+	SharedImageMemory::EReceiveResult Res = Receiver.Receive(OnFrame, &f, 1); //creates capture number A, the first frame can already arrive with it
+	if (!Sender.SendIsReady()) return 1;
+	for (int i = 0; i != ROUNDTRIPS; i++)
+	{
+		if (i || Res != SharedImageMemory::RECEIVERES_NEWFRAME) Res = Receiver.Receive(OnFrame, &f, 5000);
+		if (Res != SharedImageMemory::RECEIVERES_NEWFRAME || SendFrame(Sender, f) != SharedImageMemory::SENDRES_OK) { printf("FAILED: echo of frame %d\n", i); return 1; }
+	}
+	return 0;
+}
+
+static void TestRoundTrip()
+{
+	SharedImageMemory Sender(CAPNUM_A), Receiver(CAPNUM_B);
+	Frame Got;
+	Receiver.Receive(OnFrame, &Got, 1); //creates capture number B
+	fflush(stdout);
+	const pid_t Pid = fork();
+	if (Pid == 0) { const int Res = RunEcho(); fflush(stdout); _exit(Res); }
+	for (double Timeout = TestNow() + 10; !Sender.SendIsReady() && TestNow() < Timeout;) usleep(1000);
+
+	double Start = TestNow();
+	int Matched = 0;
+	for (int i = 0; i != ROUNDTRIPS; i++)
+	{
+		const Frame f = MakeFrame(64 + i % 97, 48 + i % 13, 64 + i % 97 + (i & 3), (i & 1 ? SharedImageMemory::FORMAT_FP16_GAMMA : SharedImageMemory::FORMAT_UINT8), 100 + i);
+		if (SendFrame(Sender, f) != SharedImageMemory::SENDRES_OK) break;
+		if (Receiver.Receive(OnFrame, &Got, 5000) != SharedImageMemory::RECEIVERES_NEWFRAME || !SameFrame(Got, f)) break;
+		TEST_CHECK(Receiver.GetFrameSequence() == (uint64_t)i + 1);
+		Matched++;
+	}
+	TEST_CHECK(Matched == ROUNDTRIPS);
+	printf("%d round trips between two processes, %.1f microseconds each\n", Matched, (TestNow() - Start) * 1e6 / (Matched ? Matched : 1));
+
+	int Status = 0;
+	waitpid(Pid, &Status, 0);
+	TEST_CHECK(WIFEXITED(Status) && WEXITSTATUS(Status) == 0);
+}
+
+int main()
+{
+	TestRemoveShared(CAPNUM_A);
+	TestRemoveShared(CAPNUM_B);
+	TestCaptureNumbers();
+	TestRemoveShared(CAPNUM_A);
+	TestRemoveShared(CAPNUM_B);
+	TestHeaderLayout();
+	TestRemoveShared(CAPNUM_A);
+	TestRoundTrip();
+	TestRemoveShared(CAPNUM_A);
+	TestRemoveShared(CAPNUM_B);
+	return TestResult("test_transport");
+}
@@ -0,0 +1,67 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Helpers shared by the Linux tests and benchmarks, a test counts failed checks and exits with 1 if there were any
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+static int g_TestFailures;
+
+#define TEST_CHECK(cond) ((cond) ? (void)0 : (void)(g_TestFailures++, printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond)))
+
+static int TestResult(const char* Name)
+{
+	printf("%s: %s\n", Name, (g_TestFailures ? "FAILED" : "passed"));
+	return (g_TestFailures ? 1 : 0);
+}
+
+//Monotonic time in seconds
+static double TestNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//Deterministic pseudo random bytes
+static void TestFillRandom(void* Buf, size_t Size, uint32_t Seed)
+{
+	uint8_t* p = (uint8_t*)Buf;
+	for (size_t i = 0; i != Size; i++) { Seed = Seed * 1664525u + 1013904223u; p[i] = (uint8_t)(Seed >> 24); }
+}
+
+//Removes the shared memory objects the POSIX backend of shared.inl creates for a capture number (see SharedImageMemory::Open)
+//Tests use capture numbers of their own and call this before and after so they neither see nor leave behind stale objects
+static void TestRemoveShared(int CapNum)
+{
+	char Name[64];
+	const char c = (CapNum ? (char)('0' + CapNum) : '\0');
+	snprintf(Name, sizeof(Name), "/UnityCapture_Mutx%c", c); shm_unlink(Name);
+	snprintf(Name, sizeof(Name), "/UnityCapture_Data%c", c); shm_unlink(Name);
+	for (unsigned Generation = 0; Generation != 4096; Generation++)
+	{
+		snprintf(Name, sizeof(Name), "/UnityCapture_Frms%c_%u", (char)('0' + CapNum), Generation);
+		shm_unlink(Name);
+	}
+}
+
+//Calls Func until at least MinSeconds have passed and returns the average milliseconds per call
+template <class Func> static double BenchMs(Func f, double MinSeconds = 0.5)
+{
+	f(); //warm up caches and lazily built tables
+	double Start = TestNow(), Now;
+	size_t Calls = 0;
+	do { f(); Calls++; } while ((Now = TestNow()) - Start < MinSeconds);
+	return (Now - Start) * 1000.0 / Calls;
+}
@@ -32,7 +32,7 @@ using UnityEngine;
 public class UnityCapture : MonoBehaviour
 {
     public enum ECaptureDevice { CaptureDevice1 = 0, CaptureDevice2 = 1, CaptureDevice3 = 2, CaptureDevice4 = 3, CaptureDevice5 = 4, CaptureDevice6 = 5, CaptureDevice7 = 6, CaptureDevice8 = 7, CaptureDevice9 = 8, CaptureDevice10 = 9 }
-    public enum EResizeMode { Disabled = 0, LinearResize = 1 }
+    public enum EResizeMode { Disabled = 0, LinearResize = 1, BilinearResize = 2, AreaResize = 3 }
     public enum EMirrorMode { Disabled = 0, MirrorHorizontally = 1 }
     public enum ECaptureSendResult { SUCCESS = 0, WARNING_FRAMESKIP = 1, WARNING_CAPTUREINACTIVE = 2, ERROR_UNSUPPORTEDGRAPHICSDEVICE = 100, ERROR_PARAMETER = 101, ERROR_TOOLARGERESOLUTION = 102, ERROR_TEXTUREFORMAT = 103, ERROR_READTEXTURE = 104, ERROR_INVALIDCAPTUREINSTANCEPTR = 200 };
 
@@ -41,6 +41,8 @@ public class UnityCapture : MonoBehaviour
     [SerializeField] [Tooltip("How many milliseconds to wait for a new frame until sending is considered to be stopped")] public int Timeout = 1000;
     [SerializeField] [Tooltip("Mirror captured output image")] public EMirrorMode MirrorMode = EMirrorMode.Disabled;
     [SerializeField] [Tooltip("Introduce a frame of latency in favor of frame rate")] public bool DoubleBuffering = false;
+    [SerializeField] [Tooltip("Frames that can be in flight between the GPU and the capture device (1 to 4, 0 to use Double Buffering), more improve the frame rate at the cost of latency")] [Range(0, 4)] public int ReadbackDepth = 0;
+    [SerializeField] [Tooltip("Only transfer and convert the parts of the image that changed (for mostly static content like UI)")] public bool DirtyTracking = false;
     [SerializeField] [Tooltip("Check to enable VSync during capturing")] public bool EnableVSync = false;
     [SerializeField] [Tooltip("Set the desired render target frame rate")] public int TargetFrameRate = 60;
     [SerializeField] [Tooltip("Check to disable output of warnings")] public bool HideWarnings = false;
@@ -72,6 +74,8 @@ public class UnityCapture : MonoBehaviour
     void OnRenderImage(RenderTexture source, RenderTexture destination)
     {
         Graphics.Blit(source, destination);
+        CaptureInterface.SetDirtyTracking(DirtyTracking);
+        CaptureInterface.SetReadbackDepth(ReadbackDepth);
         switch (CaptureInterface.SendTexture(source, Timeout, DoubleBuffering, ResizeMode, MirrorMode))
         {
             case ECaptureSendResult.SUCCESS: break;
@@ -91,6 +95,8 @@ public class UnityCapture : MonoBehaviour
         [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static System.IntPtr CaptureCreateInstance(int CapNum);
         [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static void CaptureDeleteInstance(System.IntPtr instance);
         [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static ECaptureSendResult CaptureSendTexture(System.IntPtr instance, System.IntPtr nativetexture, int Timeout, bool UseDoubleBuffering, EResizeMode ResizeMode, EMirrorMode MirrorMode, bool IsLinearColorSpace);
+        [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static void CaptureSetDirtyTracking(System.IntPtr instance, bool Enable);
+        [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static void CaptureSetReadbackDepth(System.IntPtr instance, int Depth);
         System.IntPtr CaptureInstance;
 
         public Interface(ECaptureDevice CaptureDevice)
@@ -114,5 +120,15 @@ public class UnityCapture : MonoBehaviour
             if (CaptureInstance == System.IntPtr.Zero) return ECaptureSendResult.ERROR_INVALIDCAPTUREINSTANCEPTR;
             return CaptureSendTexture(CaptureInstance, Source.GetNativeTexturePtr(), Timeout, DoubleBuffering, ResizeMode, MirrorMode, QualitySettings.activeColorSpace == ColorSpace.Linear);
         }
+
+        public void SetDirtyTracking(bool Enable)
+        {
+            if (CaptureInstance != System.IntPtr.Zero) CaptureSetDirtyTracking(CaptureInstance, Enable);
+        }
+
+        public void SetReadbackDepth(int Depth)
+        {
+            if (CaptureInstance != System.IntPtr.Zero) CaptureSetReadbackDepth(CaptureInstance, Depth);
+        }
     }
 }